@@ -34,6 +34,7 @@
 #include <linux/debugfs.h>
 #include <linux/cpuhotplug.h>
 #include <linux/part_stat.h>
+#include <linux/damon.h>
 
 #include "zram_drv.h"
 
@@ -646,91 +647,291 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 #define HUGE_WRITEBACK 1
 #define IDLE_WRITEBACK 2
 
+/* Maximum number of pages that written back with one batch of bios */
+#define ZRAM_WB_BATCH	32
 
-static ssize_t writeback_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
-{
-	struct zram *zram = dev_to_zram(dev);
-	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
-	unsigned long index = 0;
+/*
+ * Idle slots are written back coldest-first, in the granularity of the log2
+ * buckets of their idle time in seconds.
+ */
+#define ZRAM_WB_NR_AGE_BUCKETS	32
+
+struct zram_wb_slot {
+	unsigned long index;
+	unsigned long blk_idx;
+	struct page *page;
 	struct bio bio;
 	struct bio_vec bio_vec;
-	struct page *page;
-	ssize_t ret = len;
-	int mode, err;
-	unsigned long blk_idx = 0;
+};
 
-	if (sysfs_streq(buf, "idle"))
-		mode = IDLE_WRITEBACK;
-	else if (sysfs_streq(buf, "huge"))
-		mode = HUGE_WRITEBACK;
-	else {
-		if (strncmp(buf, PAGE_WB_SIG, sizeof(PAGE_WB_SIG) - 1))
-			return -EINVAL;
+struct zram_wb_batch {
+	struct zram_wb_slot slots[ZRAM_WB_BATCH];
+	unsigned int nr;
+	atomic_t nr_inflight;
+	struct completion done;
+};
 
-		if (kstrtol(buf + sizeof(PAGE_WB_SIG) - 1, 10, &index) ||
-				index >= nr_pages)
-			return -EINVAL;
+static void zram_wb_batch_free(struct zram_wb_batch *wb)
+{
+	unsigned int i;
 
-		nr_pages = 1;
-		mode = PAGE_WRITEBACK;
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		if (wb->slots[i].page)
+			__free_page(wb->slots[i].page);
 	}
+	kfree(wb);
+}
 
-	down_read(&zram->init_lock);
-	if (!init_done(zram)) {
-		ret = -EINVAL;
-		goto release_init_lock;
+static struct zram_wb_batch *zram_wb_batch_alloc(void)
+{
+	struct zram_wb_batch *wb;
+	unsigned int i;
+
+	wb = kzalloc(sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return NULL;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		wb->slots[i].page = alloc_page(GFP_KERNEL);
+		if (!wb->slots[i].page) {
+			zram_wb_batch_free(wb);
+			return NULL;
+		}
 	}
+	init_completion(&wb->done);
+	return wb;
+}
 
-	if (!zram->backing_dev) {
-		ret = -ENODEV;
-		goto release_init_lock;
+/* Number of pages that can be written back under the writeback limit */
+static unsigned long zram_wb_budget(struct zram *zram)
+{
+	unsigned long budget = ULONG_MAX;
+
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable)
+		budget = zram->bd_wb_limit >> (PAGE_SHIFT - 12);
+	spin_unlock(&zram->wb_limit_lock);
+	return budget;
+}
+
+/* Callers should hold the slot lock */
+static bool zram_wb_candidate(struct zram *zram, u32 index, int mode)
+{
+	if (!zram_allocated(zram, index))
+		return false;
+
+	if (zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return false;
+
+	if (mode == IDLE_WRITEBACK &&
+		  !zram_test_flag(zram, index, ZRAM_IDLE))
+		return false;
+	if (mode == HUGE_WRITEBACK &&
+		  !zram_test_flag(zram, index, ZRAM_HUGE))
+		return false;
+	return true;
+}
+
+#ifdef CONFIG_ZRAM_MEMORY_TRACKING
+/* Callers should hold the slot lock */
+static unsigned int zram_age_bucket(struct zram *zram, u32 index, ktime_t now)
+{
+	ktime_t idle = ktime_sub(now, zram->table[index].ac_time);
+
+	if (idle < 0)
+		return 0;
+	return min_t(unsigned int, fls64(ktime_divns(idle, NSEC_PER_SEC)),
+			ZRAM_WB_NR_AGE_BUCKETS - 1);
+}
+
+/*
+ * Find the youngest age bucket of the idle slots that need to be written back
+ * for using up the writeback limit, if the limit is enabled.  Returns zero if
+ * every idle slot can be written back.
+ */
+static unsigned int zram_wb_min_bucket(struct zram *zram)
+{
+	unsigned long histogram[ZRAM_WB_NR_AGE_BUCKETS] = {};
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long budget = zram_wb_budget(zram);
+	unsigned long index, cumulated = 0;
+	ktime_t now = ktime_get_boottime();
+	unsigned int bucket;
+
+	if (budget == ULONG_MAX)
+		return 0;
+
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		if (zram_wb_candidate(zram, index, IDLE_WRITEBACK))
+			histogram[zram_age_bucket(zram, index, now)]++;
+		zram_slot_unlock(zram, index);
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
-		ret = -ENOMEM;
-		goto release_init_lock;
+	for (bucket = ZRAM_WB_NR_AGE_BUCKETS - 1; bucket > 0; bucket--) {
+		cumulated += histogram[bucket];
+		if (cumulated >= budget)
+			break;
 	}
+	return bucket;
+}
+#else
+static unsigned int zram_age_bucket(struct zram *zram, u32 index, ktime_t now)
+{
+	return 0;
+}
 
-	for (; nr_pages != 0; index++, nr_pages--) {
-		struct bio_vec bvec;
+static unsigned int zram_wb_min_bucket(struct zram *zram)
+{
+	return 0;
+}
+#endif
 
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_batch *wb = bio->bi_private;
 
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
-			spin_unlock(&zram->wb_limit_lock);
-			ret = -EIO;
-			break;
-		}
-		spin_unlock(&zram->wb_limit_lock);
+	if (atomic_dec_and_test(&wb->nr_inflight))
+		complete(&wb->done);
+}
 
-		if (!blk_idx) {
-			blk_idx = alloc_block_bdev(zram);
-			if (!blk_idx) {
-				ret = -ENOSPC;
-				break;
-			}
-		}
+/* Update the slot for the result of its writeback */
+static void zram_wb_complete(struct zram *zram, struct zram_wb_slot *slot,
+		int err)
+{
+	unsigned long index = slot->index;
 
+	if (err) {
+		if (slot->blk_idx)
+			free_block_bdev(zram, slot->blk_idx);
 		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index))
-			goto next;
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+		return;
+	}
 
-		if (zram_test_flag(zram, index, ZRAM_WB) ||
-				zram_test_flag(zram, index, ZRAM_SAME) ||
-				zram_test_flag(zram, index, ZRAM_UNDER_WB))
-			goto next;
+	atomic64_inc(&zram->stats.bd_writes);
+	/*
+	 * We released zram_slot_lock so need to check if the slot was
+	 * changed. If there is freeing for the slot, we can catch it
+	 * easily by zram_allocated.
+	 * A subtle case is the slot is freed/reallocated/marked as
+	 * ZRAM_IDLE again. To close the race, idle_store doesn't
+	 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+	 * Thus, we could close the race by checking ZRAM_IDLE bit.
+	 */
+	zram_slot_lock(zram, index);
+	if (!zram_allocated(zram, index) ||
+		  !zram_test_flag(zram, index, ZRAM_IDLE)) {
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+		free_block_bdev(zram, slot->blk_idx);
+		goto out;
+	}
 
-		if (mode == IDLE_WRITEBACK &&
-			  !zram_test_flag(zram, index, ZRAM_IDLE))
-			goto next;
-		if (mode == HUGE_WRITEBACK &&
-			  !zram_test_flag(zram, index, ZRAM_HUGE))
+	zram_free_page(zram, index);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_set_flag(zram, index, ZRAM_WB);
+	zram_set_element(zram, index, slot->blk_idx);
+	atomic64_inc(&zram->stats.pages_stored);
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
+		zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
+	spin_unlock(&zram->wb_limit_lock);
+out:
+	zram_slot_unlock(zram, index);
+}
+
+/*
+ * Write the pages of the batch to the backing device with asynchronous bios,
+ * wait for the completion of the bios, and update the slots.  Returns zero,
+ * the last IO error, or -ENOSPC if the backing device is full.
+ */
+static int zram_wb_submit(struct zram *zram, struct zram_wb_batch *wb)
+{
+	struct zram_wb_slot *slot;
+	struct blk_plug plug;
+	unsigned int i;
+	int ret = 0, err;
+
+	atomic_set(&wb->nr_inflight, 1);
+	reinit_completion(&wb->done);
+	blk_start_plug(&plug);
+	for (i = 0; i < wb->nr; i++) {
+		slot = &wb->slots[i];
+		slot->blk_idx = alloc_block_bdev(zram);
+		if (!slot->blk_idx)
+			continue;
+
+		bio_init(&slot->bio, &slot->bio_vec, 1);
+		bio_set_dev(&slot->bio, zram->bdev);
+		slot->bio.bi_iter.bi_sector = slot->blk_idx * (PAGE_SIZE >> 9);
+		slot->bio.bi_opf = REQ_OP_WRITE | REQ_SYNC;
+		slot->bio.bi_end_io = zram_wb_end_io;
+		slot->bio.bi_private = wb;
+		bio_add_page(&slot->bio, slot->page, PAGE_SIZE, 0);
+		atomic_inc(&wb->nr_inflight);
+		submit_bio(&slot->bio);
+	}
+	blk_finish_plug(&plug);
+	if (!atomic_dec_and_test(&wb->nr_inflight))
+		wait_for_completion_io(&wb->done);
+
+	for (i = 0; i < wb->nr; i++) {
+		slot = &wb->slots[i];
+		if (!slot->blk_idx)
+			err = -ENOSPC;
+		else
+			err = blk_status_to_errno(slot->bio.bi_status);
+		zram_wb_complete(zram, slot, err);
+		/*
+		 * Return last IO error unless every IO were
+		 * not suceeded.
+		 */
+		if (err && ret != -ENOSPC)
+			ret = err;
+	}
+	wb->nr = 0;
+	return ret;
+}
+
+/*
+ * Write back the slots in [@index, @index + @nr_pages) in batches.  For
+ * IDLE_WRITEBACK, only the slots of the age buckets in [@min_bucket,
+ * @max_bucket] are written back.  The last error is stored in @ret.  Returns
+ * true if no more writeback can be done.
+ */
+static bool zram_writeback_slots(struct zram *zram, struct zram_wb_batch *wb,
+		int mode, unsigned long index, unsigned long nr_pages,
+		unsigned int min_bucket, unsigned int max_bucket, ssize_t *ret)
+{
+	ktime_t now = ktime_get_boottime();
+	unsigned long budget = 0;
+	struct bio_vec bvec;
+	unsigned int bucket;
+	bool stop = false;
+	int err;
+
+	for (; nr_pages != 0; index++, nr_pages--) {
+		if (!wb->nr) {
+			budget = zram_wb_budget(zram);
+			if (!budget) {
+				*ret = -EIO;
+				return true;
+			}
+		}
+
+		zram_slot_lock(zram, index);
+		if (!zram_wb_candidate(zram, index, mode))
 			goto next;
+		if (mode == IDLE_WRITEBACK) {
+			bucket = zram_age_bucket(zram, index, now);
+			if (bucket < min_bucket || bucket > max_bucket)
+				goto next;
+		}
 		/*
 		 * Clearing ZRAM_UNDER_WB is duty of caller.
 		 * IOW, zram_free_page never clear it.
@@ -739,6 +940,10 @@ static ssize_t writeback_store(struct device *dev,
 		/* Need for hugepage writeback racing */
 		zram_set_flag(zram, index, ZRAM_IDLE);
 		zram_slot_unlock(zram, index);
+
+		bvec.bv_page = wb->slots[wb->nr].page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
 		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
 			zram_slot_lock(zram, index);
 			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
@@ -747,66 +952,90 @@ static ssize_t writeback_store(struct device *dev,
 			continue;
 		}
 
-		bio_init(&bio, &bio_vec, 1);
-		bio_set_dev(&bio, zram->bdev);
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		bio.bi_opf = REQ_OP_WRITE | REQ_SYNC;
-
-		bio_add_page(&bio, bvec.bv_page, bvec.bv_len,
-				bvec.bv_offset);
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		err = submit_bio_wait(&bio);
-		if (err) {
-			zram_slot_lock(zram, index);
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			zram_slot_unlock(zram, index);
-			/*
-			 * Return last IO error unless every IO were
-			 * not suceeded.
-			 */
-			ret = err;
-			continue;
+		wb->slots[wb->nr++].index = index;
+		if (wb->nr == ZRAM_WB_BATCH || wb->nr == budget) {
+			err = zram_wb_submit(zram, wb);
+			if (err)
+				*ret = err;
+			if (err == -ENOSPC)
+				return true;
 		}
-
-		atomic64_inc(&zram->stats.bd_writes);
-		/*
-		 * We released zram_slot_lock so need to check if the slot was
-		 * changed. If there is freeing for the slot, we can catch it
-		 * easily by zram_allocated.
-		 * A subtle case is the slot is freed/reallocated/marked as
-		 * ZRAM_IDLE again. To close the race, idle_store doesn't
-		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
-		 * Thus, we could close the race by checking ZRAM_IDLE bit.
-		 */
-		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index) ||
-			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			goto next;
-		}
-
-		zram_free_page(zram, index);
-		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
-		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
-			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
-		spin_unlock(&zram->wb_limit_lock);
+		continue;
 next:
 		zram_slot_unlock(zram, index);
 	}
 
-	if (blk_idx)
-		free_block_bdev(zram, blk_idx);
-	__free_page(page);
+	if (wb->nr) {
+		err = zram_wb_submit(zram, wb);
+		if (err)
+			*ret = err;
+		stop = err == -ENOSPC;
+	}
+	return stop;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned int min_bucket = 0, max_bucket = ZRAM_WB_NR_AGE_BUCKETS - 1;
+	unsigned long index = 0;
+	struct zram_wb_batch *wb;
+	ssize_t ret = len;
+	int mode;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_WRITEBACK;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_WRITEBACK;
+	else {
+		if (strncmp(buf, PAGE_WB_SIG, sizeof(PAGE_WB_SIG) - 1))
+			return -EINVAL;
+
+		if (kstrtol(buf + sizeof(PAGE_WB_SIG) - 1, 10, &index) ||
+				index >= nr_pages)
+			return -EINVAL;
+
+		nr_pages = 1;
+		mode = PAGE_WRITEBACK;
+	}
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (!zram->backing_dev) {
+		ret = -ENODEV;
+		goto release_init_lock;
+	}
+
+	wb = zram_wb_batch_alloc();
+	if (!wb) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	/*
+	 * Spend the writeback limit for the coldest idle slots first.  Write
+	 * back the slots older than the age bucket that fills up the limit,
+	 * and then the slots of the bucket.
+	 */
+	if (mode == IDLE_WRITEBACK)
+		min_bucket = zram_wb_min_bucket(zram);
+	if (min_bucket) {
+		if (zram_writeback_slots(zram, wb, mode, index, nr_pages,
+					min_bucket + 1, max_bucket, &ret))
+			goto free_batch;
+		max_bucket = min_bucket;
+	}
+	zram_writeback_slots(zram, wb, mode, index, nr_pages, min_bucket,
+			max_bucket, &ret);
+
+free_batch:
+	zram_wb_batch_free(wb);
 release_init_lock:
 	up_read(&zram->init_lock);
 
@@ -897,10 +1126,20 @@ static void zram_debugfs_destroy(void)
 	debugfs_remove_recursive(zram_debugfs_root);
 }
 
-static void zram_accessed(struct zram *zram, u32 index)
+/*
+ * If the page is written by DAMON paging it out, it was already not accessed
+ * for a while.  Reflect it to ac_time, so that the idle marking and the idle
+ * writeback can find the truly cold slots.
+ */
+static void zram_accessed(struct zram *zram, u32 index, bool write)
 {
+	ktime_t ac_time = ktime_get_boottime();
+	unsigned long idle_us = write ? damon_pageout_age() : 0;
+
 	zram_clear_flag(zram, index, ZRAM_IDLE);
-	zram->table[index].ac_time = ktime_get_boottime();
+	if (idle_us)
+		ac_time = max_t(ktime_t, ktime_sub_us(ac_time, idle_us), 0);
+	zram->table[index].ac_time = ac_time;
 }
 
 static ssize_t read_block_state(struct file *file, char __user *buf,
@@ -983,7 +1222,7 @@ static void zram_debugfs_unregister(struct zram *zram)
 #else
 static void zram_debugfs_create(void) {};
 static void zram_debugfs_destroy(void) {};
-static void zram_accessed(struct zram *zram, u32 index)
+static void zram_accessed(struct zram *zram, u32 index, bool write)
 {
 	zram_clear_flag(zram, index, ZRAM_IDLE);
 };
@@ -1566,7 +1805,7 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	}
 
 	zram_slot_lock(zram, index);
-	zram_accessed(zram, index);
+	zram_accessed(zram, index, op_is_write(op));
 	zram_slot_unlock(zram, index);
 
 	if (unlikely(ret < 0)) {
@@ -8,14 +8,28 @@
 #ifndef _DAMON_H_
 #define _DAMON_H_
 
+#include <linux/jump_label.h>
 #include <linux/mutex.h>
+#include <linux/rcupdate.h>
 #include <linux/time64.h>
 #include <linux/types.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/damon.h>
 
 /* Minimal region size.  Every damon_region is aligned by this. */
 #define DAMON_MIN_REGION	PAGE_SIZE
 /* Max priority score for DAMON-based operation schemes */
 #define DAMOS_MAX_SCORE		(99)
+/* Number of fractional bits of damon_region->hotness */
+#define DAMON_HOTNESS_FRAC_BITS	10
+/* Number of the buckets of damon_target_summary */
+#define DAMON_NR_FREQ_BUCKETS	11
+#define DAMON_NR_AGE_BUCKETS	16
+/* Number of the recent working set sizes for the percentiles */
+#define DAMON_WSS_WINDOW	64
+/* Max number of the working set size percentiles */
+#define DAMON_MAX_WSS_PERCENTILES	8
 
 /**
  * struct damon_addr_range - Represents an address region of [@start, @end).
@@ -32,23 +46,97 @@ struct damon_addr_range {//地址区域
  * @ar:			The address range of the region.
  * @sampling_addr:	Address of the sample for the next access check.
  * @nr_accesses:	Access frequency of this region.
+ * @nr_writes:		Write access frequency of this region.
+ * @hotness:		Moving average of the access frequency of this region.
  * @list:		List head for siblings.
  * @age:		Age of this region.
  *
+ * @nr_writes is updated only if the monitoring primitives support write
+ * accesses checks (e.g., those set by damon_va_set_wr_primitives()), and
+ * aggregated and reset in same manner of @nr_accesses.
+ *
  * @age is initially zero, increased for each aggregation interval, and reset
  * to zero again if the access frequency is significantly changed.  If two
- * regions are merged into a new region, both @nr_accesses and @age of the new
- * region are set as region size-weighted average of those of the two regions.
+ * regions are merged into a new region, @nr_accesses, @nr_writes, @hotness and
+ * @age of the new region are set as region size-weighted average of those of
+ * the two regions.
+ *
+ * @hotness is updated only if &damon_ctx.hotness_weight_shift is non-zero.  It
+ * is an exponentially weighted moving average of the access check results of
+ * every sampling, in the unit of @nr_accesses, and has
+ * DAMON_HOTNESS_FRAC_BITS fractional bits.  Unlike @nr_accesses, it is not
+ * reset for each aggregation interval, so it always reflects the recent
+ * samples.
  */
 struct damon_region {//监控目标区域
 	struct damon_addr_range ar;//其中的地址区域
 	unsigned long sampling_addr;//下次访问检查的地址？
 	unsigned int nr_accesses; //该区域的访问频率
+	unsigned int nr_writes;
+	unsigned int hotness;
 	struct list_head list;
 
 	unsigned int age;
 /* private: Internal value for age calculation. */
 	unsigned int last_nr_accesses;
+/* private: Internal value for hotness calculation. */
+	unsigned int sampled_nr_accesses;
+};
+
+/**
+ * struct damon_region_info - Access pattern of a region.
+ * @ar:			The address range of the region.
+ * @nr_accesses:	Access frequency of the region.
+ * @age:		Age of the region.
+ */
+struct damon_region_info {
+	struct damon_addr_range ar;
+	unsigned int nr_accesses;
+	unsigned int age;
+};
+
+/**
+ * struct damon_region_index - Sorted array of the regions of a target.
+ * @rcu:		RCU head for freeing this.
+ * @nr_regions:		Number of the entries in @regions.
+ * @regions:		The regions, sorted by their start addresses.
+ */
+struct damon_region_index {
+	struct rcu_head rcu;
+	unsigned int nr_regions;
+	struct damon_region_info regions[];
+};
+
+/**
+ * struct damon_target_summary - Summary of the access pattern of a target.
+ * @sz_by_freq:		Total size of the regions of each access frequency.
+ * @sz_by_age:		Total size of the regions of each age.
+ * @wss:		Working set size.
+ * @wss_percentiles:	Percentiles of the recent working set sizes.
+ *
+ * The summary is made after each aggregation interval.  @wss is the total size
+ * of the regions that accessed at least once in the interval.
+ *
+ * Index zero of @sz_by_freq is for the regions that not accessed in the
+ * interval.  Index ``i`` (``1 <= i <= 10``) is for the regions having
+ * &damon_region.nr_accesses of the ``i``-th ten percent of the max possible
+ * value.  Index ``i`` of @sz_by_age is for the regions having
+ * &damon_region.age in ``[2^(i-1), 2^i)``, except index zero for age zero, and
+ * the last index for ages not smaller than that.
+ *
+ * Each entry of @wss_percentiles is the percentile of @wss of the last
+ * DAMON_WSS_WINDOW aggregation intervals, at the corresponding entry of
+ * &damon_ctx.wss_percentiles.
+ */
+struct damon_target_summary {
+	unsigned long sz_by_freq[DAMON_NR_FREQ_BUCKETS];
+	unsigned long sz_by_age[DAMON_NR_AGE_BUCKETS];
+	unsigned long wss;
+	unsigned long wss_percentiles[DAMON_MAX_WSS_PERCENTILES];
+
+/* private: */
+	unsigned long wss_window[DAMON_WSS_WINDOW];
+	unsigned int nr_wss_samples;
 };
 
 /**
@@ -56,19 +144,33 @@ struct damon_region {//监控目标区域
  * @id:			Unique identifier for this target.
  * @nr_regions:		Number of monitoring target regions of this target.
  * @regions_list:	Head of the monitoring target regions of this target.
+ * @index:		The regions as of the last aggregation interval.
+ * @summary:		Summary of the last aggregation interval.
  * @list:		List head for siblings.
+ * @rcu:		RCU head for freeing this.
  *
  * Each monitoring context could have multiple targets.  For example, a context
  * for virtual memory address spaces could have multiple target processes.  The
  * @id of each target should be unique among the targets of the context.  For
  * example, in the virtual address monitoring context, it could be a pidfd or
  * an address of an mm_struct.
+ *
+ * @index is updated for each aggregation interval only if
+ * &damon_ctx.index_regions is set, and read via damon_query_hotness().  For
+ * the lockless reads, the targets are added to and removed from the context
+ * in the RCU-safe way, and freed after an RCU grace period.
+ *
+ * @summary is updated for each aggregation interval only if
+ * &damon_ctx.summarize is set, under &damon_ctx.kdamond_lock.
  */
 struct damon_target {
 	unsigned long id;
 	unsigned int nr_regions;
 	struct list_head regions_list;
+	struct damon_region_index __rcu *index;
+	struct damon_target_summary summary;
 	struct list_head list;
+	struct rcu_head rcu;
 };
 
 /**
@@ -81,6 +183,8 @@ struct damon_target {
  * @DAMOS_HUGEPAGE:	Call ``madvise()`` for the region with MADV_HUGEPAGE.
  * @DAMOS_NOHUGEPAGE:	Call ``madvise()`` for the region with MADV_NOHUGEPAGE.
  * @DAMOS_STAT:		Do nothing but count the stat.
+ * @DAMOS_MERGEABLE:	Call ``madvise()`` for the region with MADV_MERGEABLE.
+ * @DAMOS_UNMERGEABLE:	Call ``madvise()`` for the region with MADV_UNMERGEABLE.
  */
 enum damos_action {
 	DAMOS_WILLNEED,
@@ -89,6 +193,8 @@ enum damos_action {
 	DAMOS_HUGEPAGE,
 	DAMOS_NOHUGEPAGE,
 	DAMOS_STAT,		/* Do nothing but only record the stat */
+	DAMOS_MERGEABLE,
+	DAMOS_UNMERGEABLE,
 };
 
 /**
@@ -101,6 +207,10 @@ enum damos_action {
  * @weight_nr_accesses:	Weight of the region's nr_accesses for prioritization.
  * @weight_age:		Weight of the region's age for prioritization.
  *
+ * @max_refault_permil:	Maximum refaults per thousand paged out pages.
+ * @refault_permil:	Refaults per thousand paged out pages in the last
+ *			&reset_interval.
+ *
  * To avoid consuming too much CPU time or IO resources for applying the
  * &struct damos->action to large memory, DAMON allows users to set time and/or
  * size quotas.  The quotas can be set by writing non-zero values to &ms and
@@ -118,6 +228,22 @@ enum damos_action {
  * You could customize the prioritization logic by setting &weight_sz,
  * &weight_nr_accesses, and &weight_age, because monitoring primitives are
  * encouraged to respect those.
+ *
+ * For &DAMOS_PAGEOUT, DAMON also counts the workingset refaults for each
+ * &reset_interval, and stores the number of the refaults per thousand pages
+ * that the scheme paged out in the interval to &refault_permil.  If
+ * &max_refault_permil is non-zero and &refault_permil exceeds it, the paged
+ * out pages are likely coming back soon.  Then DAMON halves the effective
+ * quota for the next interval, and doubles it back while &refault_permil is
+ * not higher than &max_refault_permil.  The refaults are counted for the
+ * node of &struct damos->wmarks if its metric is
+ * &DAMOS_WMARK_NODE_FREE_MEM_RATE, or for the whole system otherwise.  Hence,
+ * the refaults of the pages that reclaimed by others also make the scheme
+ * back off.  The paged out pages are counted from &struct
+ * damos->stat_sz_applied.  For the virtual address spaces, that is the size of
+ * the memory that ``madvise()``-ed with MADV_PAGEOUT successfully, which
+ * includes the pages that not really paged out.  Hence, the ratio is per
+ * ``madvise()``-ed page and can be lower than the real one.
  */
 struct damos_quota {
 	unsigned long ms;
@@ -128,6 +254,9 @@ struct damos_quota {
 	unsigned int weight_nr_accesses;
 	unsigned int weight_age;
 
+	unsigned long max_refault_permil;
+	unsigned long refault_permil;
+
 /* private: */
 	/* For throughput estimation */
 	unsigned long total_charged_sz;
@@ -144,6 +273,11 @@ struct damos_quota {
 	/* For prioritization */
 	unsigned long histogram[DAMOS_MAX_SCORE + 1];
 	unsigned int min_score;
+
+	/* For the refault feedback */
+	unsigned long fsz;	/* Size quota set by the feedback */
+	unsigned long last_refaults;
+	unsigned long last_sz_applied;
 };
 
 /**
@@ -151,10 +285,13 @@ struct damos_quota {
  *
  * @DAMOS_WMARK_NONE:		Ignore the watermarks of the given scheme.
  * @DAMOS_WMARK_FREE_MEM_RATE:	Free memory rate of the system in [0,1000].
+ * @DAMOS_WMARK_NODE_FREE_MEM_RATE:	Free memory rate of a NUMA node in
+ *					[0,1000].
  */
 enum damos_wmark_metric {
 	DAMOS_WMARK_NONE,
 	DAMOS_WMARK_FREE_MEM_RATE,
+	DAMOS_WMARK_NODE_FREE_MEM_RATE,
 };
 
 /**
@@ -164,6 +301,7 @@ enum damos_wmark_metric {
  * @high:	High watermark.
  * @mid:	Middle watermark.
  * @low:	Low watermark.
+ * @nid:	NUMA node of &DAMOS_WMARK_NODE_FREE_MEM_RATE.
  *
  * If &metric is &DAMOS_WMARK_NONE, the scheme is always active.  Being active
  * means DAMON does monitoring and applying the action of the scheme to
@@ -180,31 +318,68 @@ struct damos_watermarks {
 	unsigned long high;
 	unsigned long mid;
 	unsigned long low;
+	int nid;
 
 /* private: */
 	bool activated;
 };
 
+/**
+ * struct damos_memcg - Memory cgroup specific control of a scheme.
+ * @id:			Cgroup id of the memory cgroup.
+ * @protected:		Never apply the action to the memory of the cgroup.
+ * @quota_sz:		Maximum size of the memory of the cgroup to try the
+ *			action within &damos_quota.reset_interval.
+ * @stat_sz_tried:	Total size of the memory of the cgroup that tried.
+ * @stat_sz_applied:	Total size of the memory of the cgroup that the action
+ *			is succeeded.
+ *
+ * The memory of the descendants of the cgroup is also controlled by this,
+ * unless a control for the descendant is also given.  Zero @quota_sz means no
+ * limit.  The primitives supporting this apply the action to only the memory
+ * that passes this control, and update @stat_sz_tried and @stat_sz_applied.
+ */
+struct damos_memcg {
+	u64 id;
+	bool protected;
+	unsigned long quota_sz;
+	unsigned long stat_sz_tried;
+	unsigned long stat_sz_applied;
+/* private: */
+	unsigned long charged_sz;
+};
+
 /**
  * struct damos - Represents a Data Access Monitoring-based Operation Scheme.
  * @min_sz_region:	Minimum size of target regions.
  * @max_sz_region:	Maximum size of target regions.
  * @min_nr_accesses:	Minimum ``->nr_accesses`` of target regions.
  * @max_nr_accesses:	Maximum ``->nr_accesses`` of target regions.
+ * @min_nr_writes:	Minimum ``->nr_writes`` of target regions.
+ * @max_nr_writes:	Maximum ``->nr_writes`` of target regions.
  * @min_age_region:	Minimum age of target regions.
  * @max_age_region:	Maximum age of target regions.
  * @action:		&damo_action to be applied to the target regions.
  * @quota:		Control the aggressiveness of this scheme.
  * @wmarks:		Watermarks for automated (in)activation of this scheme.
+ * @target_ids:		Identifiers of the targets to apply this scheme to.
+ * @nr_target_ids:	Number of entries in @target_ids.
+ * @memcgs:		Memory cgroup specific controls.
+ * @nr_memcgs:		Number of entries in @memcgs.
  * @stat_count:		Total number of regions that this scheme is applied.
  * @stat_sz:		Total size of regions that this scheme is applied.
+ * @stat_sz_applied:	Total size of memory that &action is succeeded.
+ * @stat_nr_failed:	Number of the failures of &action.
  * @list:		List head for siblings.
  *
  * For each aggregation interval, DAMON finds regions which fit in the
  * condition (&min_sz_region, &max_sz_region, &min_nr_accesses,
- * &max_nr_accesses, &min_age_region, &max_age_region) and applies &action to
- * those.  To avoid consuming too much CPU time or IO resources for the
- * &action, &quota is used.
+ * &max_nr_accesses, &min_nr_writes, &max_nr_writes, &min_age_region,
+ * &max_age_region) and applies &action to those.  &min_nr_writes and
+ * &max_nr_writes are set as zero and UINT_MAX by damon_new_scheme(), so that
+ * the write frequency is ignored unless the user explicitly sets those.  To
+ * avoid consuming too much CPU time or IO resources for the &action, &quota is
+ * used.
  *
  * To do the work only when needed, schemes can be activated for specific
  * system situations using &wmarks.  If all schemes that registered to the
@@ -214,26 +389,63 @@ struct damos_watermarks {
  * If all schemes that registered to a &struct damon_ctx are inactive, DAMON
  * stops monitoring and just repeatedly checks the watermarks.
  *
+ * If @target_ids is set, &action is applied to only the regions of the targets
+ * in @target_ids, and &quota is also shared by only those regions.  Hence,
+ * different policies of different aggressiveness can be applied to different
+ * targets of one monitoring context, by registering a scheme having its own
+ * &quota for each of the targets.  The targets that removed from the context
+ * are removed from @target_ids, and the scheme is not applied to any target if
+ * @nr_target_ids becomes zero in the way.
+ *
+ * If @memcgs is set, the primitives that know the memory cgroups of the memory
+ * of the regions, e.g., those for the physical address space, further filter
+ * the memory of each region before applying &action to it.  The memory of the
+ * cgroups that are protected, or used up their quota within the current
+ * &quota reset interval, is skipped.  The memory of the cgroups not in
+ * @memcgs is not filtered.
+ *
  * After applying the &action to each region, &stat_count and &stat_sz is
  * updated to reflect the number of regions and total size of regions that the
- * &action is applied.
+ * &action is applied.  &stat_sz_applied and &stat_nr_failed are updated by
+ * the primitives that support those, for the results of the &action.  For
+ * example, for the ``madvise()`` based actions of the virtual address spaces,
+ * those are the size of the memory that ``madvise()`` succeeded for and the
+ * number of the failed ``madvise()`` calls.  For &DAMOS_MERGEABLE, &stat_sz_applied is the size of memory that handed to
+ * KSM.
  */
 struct damos {
 	unsigned long min_sz_region;
 	unsigned long max_sz_region;
 	unsigned int min_nr_accesses;
 	unsigned int max_nr_accesses;
+	unsigned int min_nr_writes;
+	unsigned int max_nr_writes;
 	unsigned int min_age_region;
 	unsigned int max_age_region;
 	enum damos_action action;
 	struct damos_quota quota;
 	struct damos_watermarks wmarks;
+	unsigned long *target_ids;
+	unsigned int nr_target_ids;
+	struct damos_memcg *memcgs;
+	unsigned int nr_memcgs;
 	unsigned long stat_count;
 	unsigned long stat_sz;
+	unsigned long stat_sz_applied;
+	unsigned long stat_nr_failed;
 	struct list_head list;
+/* private: internal use only */
+	bool target_matched;
+	/* For &damon_primitive.apply_scheme_ranges */
+	struct damon_addr_range *batch;
+	unsigned int nr_batch;
+	unsigned long batch_age;
 };
 
 struct damon_ctx;
+struct file;
+struct poll_table_struct;
+struct vm_area_struct;
 
 /**
  * struct damon_primitive - Monitoring primitives for given use cases.
@@ -243,8 +455,11 @@ struct damon_ctx;
  * @prepare_access_checks:	Prepare next access check of target regions.
  * @check_accesses:		Check the accesses to target regions.
  * @reset_aggregated:		Reset aggregated accesses monitoring results.
+ * @prepare_page_access_checks:	Prepare page granularity access checks.
+ * @check_page_accesses:	Check page granularity accesses.
  * @get_scheme_score:		Get the score of a region for a scheme.
  * @apply_scheme:		Apply a DAMON-based operation scheme.
+ * @apply_scheme_ranges:	Apply a scheme to address ranges in a batch.
  * @target_valid:		Determine if the target is valid.
  * @cleanup:			Clean up the context.
  *
@@ -271,15 +486,31 @@ struct damon_ctx;
  * of its update.  The value will be used for regions adjustment threshold.
  * @reset_aggregated should reset the access monitoring results that aggregated
  * by @check_accesses.
+ * @prepare_page_access_checks and @check_page_accesses are used only if the
+ * page granularity zooming is enabled (&damon_ctx.zoom_nr_regions is
+ * non-zero).  @prepare_page_access_checks should prepare the access checks of
+ * every page in the given address range of the given target.
+ * @check_page_accesses should set the bits of the given bitmap for the pages
+ * of the given address range that accessed after the last preparation.  The
+ * first bit of the bitmap represents the first page of the range.
  * @get_scheme_score should return the priority score of a region for a scheme
  * as an integer in [0, &DAMOS_MAX_SCORE].
  * @apply_scheme is called from @kdamond when a region for user provided
  * DAMON-based operation scheme is found.  It should apply the scheme's action
  * to the region.  This is not used for &DAMON_ARBITRARY_TARGET case.
+ * If @apply_scheme_ranges is set, it is used instead of @apply_scheme.  In
+ * the case, @kdamond collects the address ranges of the regions of each
+ * target that the action of each scheme should be applied to, merging
+ * adjacent ones, and passes those to @apply_scheme_ranges at once, after
+ * checking all regions of the target or the array of the ranges becomes full.
+ * It should apply the scheme's action to the ranges, so that the overhead
+ * that common for the ranges, e.g., getting the address space, is paid once.
  * @target_valid should check whether the target is still valid for the
  * monitoring.  It receives &damon_ctx.arbitrary_target or &struct damon_target
  * pointer depends on &damon_ctx.target_type.
- * @cleanup is called from @kdamond just before its termination.
+ * @cleanup is called from @kdamond just before its termination.  If
+ * &damon_ctx.target_type is &DAMON_ARBITRARY_TARGET, it is also called when
+ * the context is destroyed.
  */
 struct damon_primitive {
 	void (*init)(struct damon_ctx *context);
@@ -287,11 +518,19 @@ struct damon_primitive {
 	void (*prepare_access_checks)(struct damon_ctx *context);
 	unsigned int (*check_accesses)(struct damon_ctx *context);
 	void (*reset_aggregated)(struct damon_ctx *context);
+	void (*prepare_page_access_checks)(struct damon_ctx *context,
+			struct damon_target *t, struct damon_addr_range *ar);
+	void (*check_page_accesses)(struct damon_ctx *context,
+			struct damon_target *t, struct damon_addr_range *ar,
+			unsigned long *bitmap);
 	int (*get_scheme_score)(struct damon_ctx *context,
 			struct damon_target *t, struct damon_region *r,
 			struct damos *scheme);
 	int (*apply_scheme)(struct damon_ctx *context, struct damon_target *t,
 			struct damon_region *r, struct damos *scheme);
+	int (*apply_scheme_ranges)(struct damon_ctx *context,
+			struct damon_target *t, struct damos *scheme,
+			struct damon_addr_range *ranges, unsigned int nr_ranges);
 	bool (*target_valid)(void *target);
 	void (*cleanup)(struct damon_ctx *context);
 };
@@ -338,6 +577,124 @@ enum damon_target_type {
 	DAMON_ARBITRARY_TARGET,
 };
 
+/**
+ * enum damon_split_policy - Represents the regions split policy.
+ *
+ * @DAMON_SPLIT_RANDOM:		Split every region at random points.
+ * @DAMON_SPLIT_GRADIENT:	Split regions having access pattern changes.
+ * @NR_DAMON_SPLIT_POLICIES:	Total number of the policies.
+ */
+enum damon_split_policy {
+	DAMON_SPLIT_RANDOM,
+	DAMON_SPLIT_GRADIENT,
+	NR_DAMON_SPLIT_POLICIES,
+};
+
+/**
+ * struct damon_zoom_range - An address range zoomed in for page granularity
+ * monitoring.
+ * @target:	The monitoring target that the range belongs to.
+ * @ar:		The address range.
+ * @accessed:	Bitmap of pages accessed in the last aggregation interval.
+ *
+ * The first bit of @accessed represents the page of @ar.start.
+ */
+struct damon_zoom_range {
+	struct damon_target *target;
+	struct damon_addr_range ar;
+	unsigned long *accessed;
+};
+
+/* Maximum number of pages in each &struct damon_zoom_range */
+#define DAMON_ZOOM_MAX_NR_PAGES	(1UL << 18)
+
+/**
+ * enum damon_phase - Represents the phases of the monitoring thread.
+ *
+ * @DAMON_PHASE_PREPARE_ACCESS_CHECKS:	Preparation of the access checks.
+ * @DAMON_PHASE_CHECK_ACCESSES:		Access checks.
+ * @DAMON_PHASE_MERGE:			Regions merge and zoom.
+ * @DAMON_PHASE_SCHEMES:		Schemes scoring and application.
+ * @DAMON_PHASE_REPORT:			Reporting and reset of the results.
+ * @DAMON_PHASE_SPLIT:			Regions split.
+ * @DAMON_PHASE_UPDATE:			Primitives update.
+ * @NR_DAMON_PHASES:			Total number of the phases.
+ */
+enum damon_phase {
+	DAMON_PHASE_PREPARE_ACCESS_CHECKS,
+	DAMON_PHASE_CHECK_ACCESSES,
+	DAMON_PHASE_MERGE,
+	DAMON_PHASE_SCHEMES,
+	DAMON_PHASE_REPORT,
+	DAMON_PHASE_SPLIT,
+	DAMON_PHASE_UPDATE,
+	NR_DAMON_PHASES,
+};
+
+/**
+ * struct damon_phase_stat - CPU time spent for a phase of the monitoring.
+ * @total_ns:	Cumulative CPU time spent for the phase in nanoseconds.
+ * @last_ns:	CPU time spent for the last run of the phase in nanoseconds.
+ */
+struct damon_phase_stat {
+	u64 total_ns;
+	u64 last_ns;
+};
+
+/**
+ * struct damon_ring - Ring buffer of the aggregation snapshots.
+ * @hdr:	The buffer, starting with &struct damon_ring_hdr.
+ * @wq:		Wait queue for the readers.
+ * @target_id:	Translate a target to its identifier in the buffer.
+ *
+ * The buffer can be set by damon_set_ring(), and mapped to the user space via
+ * damon_ring_mmap().  Because &damon_target.id could be a kernel pointer, it
+ * is not written to the buffer as is.  Instead, the return value of
+ * @target_id for the target is written.  If @target_id is NULL, zero is
+ * written.
+ */
+struct damon_ring {
+	struct damon_ring_hdr *hdr;
+	wait_queue_head_t wq;
+	unsigned long (*target_id)(struct damon_ctx *ctx,
+			struct damon_target *t);
+
+/* private: kernel-side copies of the fields of @hdr that users can corrupt */
+	u64 data_sz;
+	u64 head;
+};
+
+/**
+ * struct damon_op - An incremental change to a monitoring context.
+ * @type:	Type of the change.
+ * @target_id:	Identifier of the target to add, remove or change.
+ * @ar:		Address range of the region to add or remove.
+ * @scheme_idx:	Index of the scheme to remove.
+ * @target:	Target to add, or the removed target.
+ * @region:	Region to add.
+ * @spare:	Spare region for splitting a region.
+ * @scheme:	Scheme to add, or the removed scheme.
+ *
+ * For &DAMON_OP_ADD_TARGET, @target should be constructed with @target_id.
+ * For &DAMON_OP_ADD_REGION, @region should be constructed with @ar.  For
+ * &DAMON_OP_ADD_REGION and &DAMON_OP_RM_REGION, @spare should be a region
+ * that can be used for the right part of an existing region that @ar is
+ * inside of.  For &DAMON_OP_ADD_SCHEME, @scheme should be set.  Please refer
+ * to damon_commit_ops() for the ownership of the objects.
+ */
+struct damon_op {
+	enum damon_op_type type;
+	unsigned long target_id;
+	struct damon_addr_range ar;
+	unsigned int scheme_idx;
+	struct damon_target *target;
+	struct damon_region *region;
+	struct damon_region *spare;
+	struct damos *scheme;
+};
+
+struct damon_commit;
+
 /**
  * struct damon_ctx - Represents a context for each monitoring.  This is the
  * main interface that allows users to set the attributes and get the results
@@ -378,18 +735,102 @@ enum damon_target_type {
  * @primitive:	Set of monitoring primitives for given use cases.
  * @callback:	Set of callbacks for monitoring events notifications.
  *
+ * @phase_stats:	CPU time spent for each &enum damon_phase.
+ * @cpu_budget:		Max CPU utilization of the kdamond in per-mille.
+ * @cpu_util:		CPU utilization of the kdamond in per-mille.
+ * @nr_budget_exceeds:	Number of the times @cpu_budget was exceeded.
+ *
+ * The monitoring thread accounts the CPU time that it spent for each phase of
+ * the monitoring to @phase_stats.  After each aggregation interval, it also
+ * updates @cpu_util with its CPU utilization in the interval.  If @cpu_budget
+ * is non-zero and @cpu_util exceeds it, the monitoring thread halves
+ * @max_nr_regions down to @min_nr_regions, merging the regions down to the new
+ * limit, and then doubles @sample_interval and @aggr_interval, and increases
+ * @nr_budget_exceeds.  If @cpu_util becomes lower than the half of
+ * @cpu_budget, the changes are reverted in the reverse order.  The values that
+ * last set by damon_set_attrs() are restored when the monitoring stops.
+ *
  * @target_type:	Type of the monitoring target.
  *
  * @min_nr_regions:	The minimum number of adaptive monitoring regions.
  * @max_nr_regions:	The maximum number of adaptive monitoring regions.
  * @adaptive_targets:	Head of monitoring targets (&damon_target) list.
  * @schemes:		Head of schemes (&damos) list.
+ * @split_policy:	Policy for splitting the regions.
+ * @region_granularity:	Granularity of the regions.
+ * @hotness_weight_shift:	Weight of each sample for &damon_region.hotness.
+ * @index_regions:	Whether to update &damon_target.index.
+ * @summarize:		Whether to update &damon_target.summary.
+ * @wss_percentiles:	Percentiles of the working set size to summarize.
+ * @nr_wss_percentiles:	Number of the entries in @wss_percentiles.
+ * @ring:		Ring buffer of the aggregation snapshots.
  *
  * @arbitrary_target:	Pointer to arbitrary type target.
  *
- * @min_nr_regions, @max_nr_regions, @adaptive_targets and @schemes are valid
- * only if @target_type is &DAMON_ADAPTIVE_TARGET.  @arbitrary_target is valid
- * only if @target_type is &DAMON_ARBITRARY_TARGET.
+ * @zoom_nr_regions:	Number of hottest regions to zoom in.
+ * @zoom_nr_aggrs:	Number of aggregation intervals for each zoom.
+ * @zoom_ranges:	Currently zoomed in address ranges.
+ * @nr_zoom_ranges:	Number of entries in @zoom_ranges.
+ *
+ * If @zoom_nr_regions is non-zero, DAMON selects @zoom_nr_regions regions
+ * having the highest access frequency after each aggregation, and monitors
+ * every page of those using &damon_primitive.prepare_page_access_checks and
+ * &damon_primitive.check_page_accesses for next @zoom_nr_aggrs aggregation
+ * intervals.  After each of the aggregation intervals, &struct
+ * damon_zoom_range->accessed of @zoom_ranges is updated to represent the
+ * pages accessed in the interval, and emitted via the ``damon_zoom``
+ * tracepoint.  Users can also read those from
+ * &damon_callback.after_aggregation.  Then, DAMON selects the hottest regions
+ * again.  The regions of which sampling addresses are in the zoomed in ranges
+ * are not checked by &damon_primitive.check_accesses, but keep the access
+ * frequency of their last aggregation interval.
+ *
+ * If @split_policy is &DAMON_SPLIT_RANDOM, every region is split into two or
+ * three regions at random points after each aggregation interval, if the total
+ * number of regions is not more than the half of @max_nr_regions.  If it is
+ * &DAMON_SPLIT_GRADIENT, only regions whose access frequency has changed in the
+ * last aggregation interval, or that have adjacent regions of significantly
+ * different access frequency, are split.  The number of regions available
+ * under @max_nr_regions is spent for those, so that the regions are
+ * concentrated where the access pattern changes, while stable regions are kept
+ * as is.
+ *
+ * The boundaries of the regions are aligned to @region_granularity, which is
+ * DAMON_MIN_REGION by default.  Setting it as the PMD size makes each region
+ * to be consisting of whole transparent huge pages, so that the access check
+ * of each huge page, which is made via its PMD, is accounted to only one
+ * region, and DAMOS actions are applied to huge page aligned ranges.  The
+ * regions that set by the primitives or the users are aligned when the
+ * monitoring starts and the primitives update the regions.
+ *
+ * If @hotness_weight_shift is non-zero, &damon_region.hotness of each region
+ * is updated after every sampling, giving the weight of ``1 /
+ * 2^@hotness_weight_shift`` to the new sample.  Then, DAMON-based operation
+ * schemes use the rounded &damon_region.hotness instead of
+ * &damon_region.nr_accesses for the access frequency conditions and the
+ * priority scores, so that those reflect the recent samples regardless of the
+ * progress of the current aggregation interval.
+ *
+ * If @index_regions is set, &damon_target.index of each target is updated after
+ * each aggregation interval, so that damon_query_hotness() can find the region
+ * of given addresses in logarithmic time while the monitoring is running.
+ *
+ * If @summarize is set, &damon_target.summary of each target is updated after
+ * each aggregation interval, and a ``damon_summary`` trace event is emitted
+ * for each target.  It is much cheaper than reading every region via the
+ * ``damon_aggregated`` trace events, for getting the working set size and the
+ * distribution of the hotness.
+ *
+ * If &damon_ring.hdr of @ring is set, a snapshot of the regions of every
+ * target is written to @ring after each aggregation interval.  Users can
+ * map the ring buffer to the user space and read the snapshots without
+ * copying, instead of the per-region ``damon_aggregated`` trace events.
+ *
+ * @min_nr_regions, @max_nr_regions, @adaptive_targets, @schemes, @split_policy,
+ * @region_granularity, @hotness_weight_shift, @index_regions, the summary
+ * fields, @ring and the zoom fields are valid only if @target_type is
+ * &DAMON_ADAPTIVE_TARGET.  @arbitrary_target is valid only if @target_type
+ * is &DAMON_ARBITRARY_TARGET.
  */
 struct damon_ctx {
 	unsigned long sample_interval;
@@ -403,10 +844,26 @@ struct damon_ctx {
 /* public: */
 	struct task_struct *kdamond;
 	struct mutex kdamond_lock;
+/* private: internal use only */
+	struct damon_commit *commit;
+	unsigned long pageout_age;
 
+/* public: */
 	struct damon_primitive primitive;
 	struct damon_callback callback;
 
+	struct damon_phase_stat phase_stats[NR_DAMON_PHASES];
+	unsigned int cpu_budget;
+	unsigned int cpu_util;
+	unsigned long nr_budget_exceeds;
+/* private: internal use only */
+	u64 budget_last_cpu_ns;
+	u64 budget_last_ns;
+	unsigned long orig_sample_interval;
+	unsigned long orig_aggr_interval;
+	unsigned long orig_max_nr_regions;
+
+/* public: */
 	enum damon_target_type target_type;
 	union {
 		struct {		/* DAMON_ADAPTIVE_TARGET */
@@ -414,6 +871,23 @@ struct damon_ctx {
 			unsigned long max_nr_regions;
 			struct list_head adaptive_targets;
 			struct list_head schemes;
+			enum damon_split_policy split_policy;
+			unsigned long region_granularity;
+			unsigned int hotness_weight_shift;
+			bool index_regions;
+			bool summarize;
+			unsigned int wss_percentiles[
+				DAMON_MAX_WSS_PERCENTILES];
+			unsigned int nr_wss_percentiles;
+			struct damon_ring ring;
+
+			unsigned int zoom_nr_regions;
+			unsigned int zoom_nr_aggrs;
+			struct damon_zoom_range *zoom_ranges;
+			unsigned int nr_zoom_ranges;
+/* private: internal use only */
+			unsigned int zoom_aggrs_left;
+/* public: */
 		};
 
 		void *arbitrary_target;	/* DAMON_ARBITRARY_TARGET */
@@ -447,6 +921,19 @@ struct damon_ctx {
 #define damon_for_each_scheme_safe(s, next, ctx) \
 	list_for_each_entry_safe(s, next, &(ctx)->schemes, list)
 
+/*
+ * Returns the access frequency of a region that DAMON-based operation schemes
+ * should use, in the unit of &damon_region.nr_accesses.
+ */
+static inline unsigned int damon_region_nr_accesses(struct damon_ctx *ctx,
+		struct damon_region *r)
+{
+	if (!ctx->hotness_weight_shift)
+		return r->nr_accesses;
+	return (r->hotness + (1U << (DAMON_HOTNESS_FRAC_BITS - 1))) >>
+		DAMON_HOTNESS_FRAC_BITS;
+}
+
 #ifdef CONFIG_DAMON
 
 struct damon_region *damon_new_region(unsigned long start, unsigned long end);
@@ -464,6 +951,10 @@ struct damos *damon_new_scheme(
 		struct damos_watermarks *wmarks);
 void damon_add_scheme(struct damon_ctx *ctx, struct damos *s);
 void damon_destroy_scheme(struct damos *s);
+int damon_set_scheme_targets(struct damos *s, unsigned long *ids,
+		unsigned int nr_ids);
+int damon_set_scheme_memcgs(struct damos *s, struct damos_memcg *memcgs,
+		unsigned int nr_memcgs);
 
 struct damon_target *damon_new_target(unsigned long id);
 void damon_add_target(struct damon_ctx *ctx, struct damon_target *t);
@@ -476,23 +967,84 @@ struct damon_ctx *damon_new_ctx(enum damon_target_type type);
 void damon_destroy_ctx(struct damon_ctx *ctx);
 int damon_set_targets(struct damon_ctx *ctx,
 		unsigned long *ids, ssize_t nr_ids);
+int damon_commit_ops(struct damon_ctx *ctx, struct damon_op *ops,
+		unsigned int nr_ops);
+void damon_free_ops(struct damon_op *ops, unsigned int nr_ops);
 int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
 		unsigned long aggr_int, unsigned long primitive_upd_int,
 		unsigned long min_nr_reg, unsigned long max_nr_reg);
 int damon_set_schemes(struct damon_ctx *ctx,
 			struct damos **schemes, ssize_t nr_schemes);
+int damon_set_zoom(struct damon_ctx *ctx, unsigned int nr_regions,
+		unsigned int nr_aggrs);
+bool damon_in_zoom(struct damon_ctx *ctx, struct damon_target *t,
+		unsigned long addr);
+int damon_set_split_policy(struct damon_ctx *ctx,
+		enum damon_split_policy policy);
+int damon_set_region_granularity(struct damon_ctx *ctx,
+		unsigned long granularity);
+int damon_set_hotness_weight_shift(struct damon_ctx *ctx, unsigned int shift);
+int damon_query_hotness(struct damon_ctx *ctx, unsigned long target_id,
+		struct damon_hotness_query *queries, unsigned int nr_queries);
+int damon_set_wss_percentiles(struct damon_ctx *ctx,
+		unsigned int *percentiles, unsigned int nr_percentiles);
+int damon_set_ring(struct damon_ctx *ctx, unsigned long data_sz,
+		unsigned long (*target_id)(struct damon_ctx *ctx,
+			struct damon_target *t));
+int damon_set_cpu_budget(struct damon_ctx *ctx, unsigned int cpu_budget);
+int damon_ring_mmap(struct damon_ctx *ctx, struct vm_area_struct *vma);
+__poll_t damon_ring_poll(struct damon_ctx *ctx, struct file *file,
+		struct poll_table_struct *wait);
 int damon_nr_running_ctxs(void);
 
 int damon_start(struct damon_ctx **ctxs, int nr_ctxs);
 int damon_stop(struct damon_ctx **ctxs, int nr_ctxs);
 
+unsigned long damon_pageout_age(void);
+
+#else	/* CONFIG_DAMON */
+
+static inline unsigned long damon_pageout_age(void)
+{
+	return 0;
+}
+
 #endif	/* CONFIG_DAMON */
 
 #ifdef CONFIG_DAMON_VADDR
 bool damon_va_target_valid(void *t);
 void damon_va_set_primitives(struct damon_ctx *ctx);
+void damon_va_set_wr_primitives(struct damon_ctx *ctx);
+bool damon_va_checks_writes(struct damon_ctx *ctx);
 #endif	/* CONFIG_DAMON_VADDR */
 
+struct mm_struct;
+
+#ifdef CONFIG_DAMON_VADDR_PF
+DECLARE_STATIC_KEY_FALSE(damon_va_pf_enabled);
+void __damon_va_page_fault(struct mm_struct *mm, unsigned long addr);
+void damon_va_set_pf_primitives(struct damon_ctx *ctx);
+bool damon_va_checks_faults(struct damon_ctx *ctx);
+
+/* Notify a page fault to the page fault based virtual address monitoring */
+static inline void damon_va_page_fault(struct mm_struct *mm,
+		unsigned long addr)
+{
+	if (static_branch_unlikely(&damon_va_pf_enabled))
+		__damon_va_page_fault(mm, addr);
+}
+#else
+static inline void damon_va_page_fault(struct mm_struct *mm,
+		unsigned long addr)
+{
+}
+
+static inline bool damon_va_checks_faults(struct damon_ctx *ctx)
+{
+	return false;
+}
+#endif	/* CONFIG_DAMON_VADDR_PF */
+
 #ifdef CONFIG_DAMON_PADDR
 bool damon_pa_target_valid(void *t);
 void damon_pa_set_primitives(struct damon_ctx *ctx);
@@ -500,26 +1052,96 @@ void damon_pa_set_primitives(struct damon_ctx *ctx);
 
 #ifdef CONFIG_DAMON_PGIDLE
 
+enum damon_pgi_op {
+	DAMON_PGI_OP_MKOLD,
+	DAMON_PGI_OP_CHECK,
+	DAMON_PGI_OP_MKOLD_SLICE,
+	DAMON_PGI_OP_CHECK_SLICE,
+};
+
+struct damon_pgi_target;
+
 /*
  * struct damon_pfns_range - Represents a pfn range of [@start, @end).
  * @start:	Start pfn of the range (inclusive).
  * @end:	End pfn of the range (exclusive).
- *
- * In case of the page granularity idleness monitoring, an instance of this
- * struct is pointed by &damon_ctx.arbitrary_target.
  */
 struct damon_pfns_range {
 	unsigned long start;
 	unsigned long end;
+
+/* private: */
+	int nid;
+	unsigned long idx;
+	unsigned long cursor;
+	unsigned long slice_end;
+	unsigned long nr_scanned;
+	enum damon_pgi_op op;
+	struct work_struct work;
+	struct damon_pgi_target *target;
+};
+
+/*
+ * struct damon_pgi_target - Represents a page granularity monitoring target.
+ * @ranges:		Array of the pfn ranges to monitor.
+ * @nr_ranges:		Number of the elements in @ranges.
+ * @per_node_workers:	Whether to scan each range on its node in parallel.
+ * @nr_pfns_per_slice:	Number of pfns of each range to check per sampling.
+ * @trace:		Whether to emit a ``damon_pgi`` trace event for each pfn.
+ * @scan_pfns_per_ms:	Number of pfns scanned per millisecond.
+ *
+ * In case of the page granularity idleness monitoring, an instance of this
+ * struct is pointed by &damon_ctx.arbitrary_target.  @ranges could be, for
+ * example, the ranges of the nodes, which damon_pgi_node_ranges() returns.
+ *
+ * If @per_node_workers is set, the ranges are scanned by unbound workqueue
+ * workers running on the node of each range, and the monitoring thread waits
+ * for those.
+ *
+ * If @nr_pfns_per_slice is zero, all pages are checked for every sampling
+ * interval.  Otherwise, only up to @nr_pfns_per_slice pages of each range are
+ * made old before each sampling interval and checked after it, and the next
+ * sampling continues from where the last one stopped.  The results of each
+ * page therefore show the accesses in the sampling interval of its last check,
+ * and are updated once per the full pass of its range.  This bounds the time
+ * that spent for each sampling, for large ranges.
+ *
+ * The monitoring results are stored in a buffer that starts with &struct
+ * damon_pgi_buffer_hdr, which users can map to the user space via
+ * &damon_pgi_buffer_fops.  Because emitting one trace event per pfn for each
+ * sampling incurs high overhead, the ``damon_pgi`` trace events are emitted
+ * only if @trace is set.  It is for only debugging purpose.
+ *
+ * Free, reserved, offline and non-LRU pages are skipped without the access
+ * checks, and compound pages are checked at once.  @scan_pfns_per_ms is
+ * updated after each access check to show the resulting scan speed.
+ */
+struct damon_pgi_target {
+	struct damon_pfns_range *ranges;
+	unsigned int nr_ranges;
+	bool per_node_workers;
+	unsigned long nr_pfns_per_slice;
+	bool trace;
+	unsigned long scan_pfns_per_ms;
+
+/* private: */
+	u64 prepare_ns;
+	struct damon_pgi_buffer_hdr *buf;
+	unsigned long buf_sz;
 };
 
+extern const struct file_operations damon_pgi_buffer_fops;
+
 bool damon_pgi_is_idle(unsigned long pfn, unsigned long *pg_size);
+struct damon_pfns_range *damon_pgi_node_ranges(unsigned int *nr_ranges);
 
 /* Monitoring primitives for page granularity idleness monitoring */
 
+void damon_pgi_init(struct damon_ctx *ctx);
 void damon_pgi_prepare_access_checks(struct damon_ctx *ctx);
 unsigned int damon_pgi_check_accesses(struct damon_ctx *ctx);
 bool damon_pgi_target_valid(void *t);
+void damon_pgi_cleanup(struct damon_ctx *ctx);
 void damon_pgi_set_primitives(struct damon_ctx *ctx);
 
 #endif	/* CONFIG_DAMON_PGIDLE */
@@ -22,6 +22,7 @@ TRACE_EVENT(damon_aggregated,
 		__field(unsigned long, start)
 		__field(unsigned long, end)
 		__field(unsigned int, nr_accesses)
+		__field(unsigned int, nr_writes)
 		__field(unsigned int, age)
 	),
 
@@ -31,13 +32,71 @@ TRACE_EVENT(damon_aggregated,
 		__entry->start = r->ar.start;
 		__entry->end = r->ar.end;
 		__entry->nr_accesses = r->nr_accesses;
+		__entry->nr_writes = r->nr_writes;
 		__entry->age = r->age;
 	),
 
-	TP_printk("target_id=%lu nr_regions=%u %lu-%lu: %u %u",
+	TP_printk("target_id=%lu nr_regions=%u %lu-%lu: %u %u %u",
 			__entry->target_id, __entry->nr_regions,
 			__entry->start, __entry->end,
-			__entry->nr_accesses, __entry->age)
+			__entry->nr_accesses, __entry->age,
+			__entry->nr_writes)
+);
+
+TRACE_EVENT(damon_summary,
+
+	TP_PROTO(struct damon_target *t),
+
+	TP_ARGS(t),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, target_id)
+		__field(unsigned long, wss)
+		__array(unsigned long, sz_by_freq, DAMON_NR_FREQ_BUCKETS)
+		__array(unsigned long, sz_by_age, DAMON_NR_AGE_BUCKETS)
+	),
+
+	TP_fast_assign(
+		__entry->target_id = t->id;
+		__entry->wss = t->summary.wss;
+		memcpy(__entry->sz_by_freq, t->summary.sz_by_freq,
+				sizeof(__entry->sz_by_freq));
+		memcpy(__entry->sz_by_age, t->summary.sz_by_age,
+				sizeof(__entry->sz_by_age));
+	),
+
+	TP_printk("target_id=%lu wss=%lu sz_by_freq=%s sz_by_age=%s",
+			__entry->target_id, __entry->wss,
+			__print_array(__entry->sz_by_freq,
+				DAMON_NR_FREQ_BUCKETS, sizeof(unsigned long)),
+			__print_array(__entry->sz_by_age,
+				DAMON_NR_AGE_BUCKETS, sizeof(unsigned long)))
+);
+
+TRACE_EVENT(damon_zoom,
+
+	TP_PROTO(struct damon_target *t, unsigned long start,
+		unsigned int nr_pages, unsigned long *accessed),
+
+	TP_ARGS(t, start, nr_pages, accessed),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, target_id)
+		__field(unsigned long, start)
+		__field(unsigned int, nr_pages)
+		__bitmask(accessed, nr_pages)
+	),
+
+	TP_fast_assign(
+		__entry->target_id = t->id;
+		__entry->start = start;
+		__entry->nr_pages = nr_pages;
+		__assign_bitmask(accessed, accessed, nr_pages);
+	),
+
+	TP_printk("target_id=%lu start=%lu nr_pages=%u accessed=%s",
+			__entry->target_id, __entry->start,
+			__entry->nr_pages, __get_bitmask(accessed))
 );
 
 TRACE_EVENT(damon_pgi,
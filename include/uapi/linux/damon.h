@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * DAMON user space ABI
+ */
+
+#ifndef _UAPI_LINUX_DAMON_H
+#define _UAPI_LINUX_DAMON_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/**
+ * struct damon_pgi_buffer_range - A pfn range in the page granularity idleness
+ * monitoring results buffer.
+ * @start_pfn:		First pfn of the range.
+ * @nr_pfns:		Number of pfns in the range.
+ * @idx:		Index of the results for @start_pfn.
+ *
+ * The results for pfn ``P`` of the range are stored at index
+ * ``@idx + P - @start_pfn`` of the bitmap and the array of the buffer.
+ */
+struct damon_pgi_buffer_range {
+	__u64 start_pfn;
+	__u64 nr_pfns;
+	__u64 idx;
+};
+
+/**
+ * struct damon_pgi_buffer_hdr - Header of the page granularity idleness
+ * monitoring results buffer.
+ * @generation:		Generation counter of the results.
+ * @nr_ranges:		Number of the monitoring target pfn ranges.
+ * @nr_pfns:		Number of the results in the bitmap and the array.
+ * @accessed_off:	Offset of the accessed pages bitmap from the header.
+ * @idle_ages_off:	Offset of the idle ages array from the header.
+ * @scan_pfns_per_ms:	Number of pfns scanned per millisecond.
+ * @ranges:		The monitoring target pfn ranges.
+ *
+ * The header is placed at the beginning of the buffer that mapped by
+ * ``mmap()`` of the buffer file.  The bitmap at @accessed_off has one bit per
+ * pfn, which is set if the page was accessed in the last sampling interval
+ * that the page was checked for.  The array at @idle_ages_off has one byte per
+ * pfn, which is the number of the last consecutive checks that found the page
+ * not accessed, up to 255.  Each page is checked for every sampling interval,
+ * or, if the monitoring is time-sliced, once per the full pass of the range of
+ * the page.  In the latter case, the accesses between the checks are not seen,
+ * and the idle age is in the number of the passes, each of which takes as many
+ * sampling intervals as the number of the slices of the range.
+ *
+ * @scan_pfns_per_ms is the number of pfns checked in the last sampling
+ * divided by the time spent for the access check preparation and the access
+ * check.
+ *
+ * @generation is odd while the results are being updated, and increased to an
+ * even number once the update is done.  Readers should read @generation before
+ * and after reading the results, and retry if those are odd or different.
+ */
+struct damon_pgi_buffer_hdr {
+	__u64 generation;
+	__u64 nr_ranges;
+	__u64 nr_pfns;
+	__u64 accessed_off;
+	__u64 idle_ages_off;
+	__u64 scan_pfns_per_ms;
+	struct damon_pgi_buffer_range ranges[];
+};
+
+/**
+ * struct damon_hotness_query - Query of the access pattern of an address.
+ * @addr:		The address to query.
+ * @start:		Start address of the region containing @addr.
+ * @end:		End address of the region containing @addr.
+ * @nr_accesses:	Access frequency of the region.
+ * @age:		Age of the region.
+ *
+ * @addr is filled by the user, and the other fields are filled by DAMON with
+ * the information of the region that contains @addr, as of the last
+ * aggregation interval.  If no region contains @addr, @start and @end are set
+ * to zero.
+ */
+struct damon_hotness_query {
+	__u64 addr;
+	__u64 start;
+	__u64 end;
+	__u32 nr_accesses;
+	__u32 age;
+};
+
+/**
+ * struct damon_hotness_queries - Batch of &struct damon_hotness_query.
+ * @target_id:		Identifier of the monitoring target to query.
+ * @nr_queries:		Number of the queries.
+ * @queries:		User space pointer to the array of the queries.
+ */
+struct damon_hotness_queries {
+	__u64 target_id;
+	__u64 nr_queries;
+	__u64 queries;
+};
+
+/**
+ * struct damon_ring_hdr - Header of the aggregation snapshots ring buffer.
+ * @data_off:		Offset of the data area from the header.
+ * @data_sz:		Size of the data area.
+ * @head:		Position that the next snapshot will be written to.
+ * @tail:		Position that the reader will read the next snapshot.
+ * @nr_snapshots:	Number of the snapshots that written.
+ * @nr_overruns:	Number of the snapshots dropped due to lack of space.
+ *
+ * The header is placed at the beginning of the buffer that mapped by
+ * ``mmap()`` of the ring buffer file, and followed by the data area at
+ * @data_off.  @head and @tail are monotonically increasing byte positions,
+ * which are mapped to the data area by ``position % @data_sz``.
+ *
+ * After each aggregation interval, DAMON writes a snapshot at @head, advances
+ * @head, and wakes up the waiters of ``poll()``.  The reader should read
+ * the snapshots in ``[@tail, @head)``, and then advance @tail to notify the
+ * reader is done with those.  @head should be read with acquire semantics, and
+ * @tail should be written with release semantics.  The reader should write
+ * nothing other than @tail.  If the space between @head and @tail is not
+ * enough for a snapshot, the snapshot is dropped, and @nr_overruns is
+ * increased.
+ */
+struct damon_ring_hdr {
+	__u64 data_off;
+	__u64 data_sz;
+	__u64 head;
+	__u64 tail;
+	__u64 nr_snapshots;
+	__u64 nr_overruns;
+};
+
+/* Alignment of the size of each snapshot in the ring buffer */
+#define DAMON_RING_ALIGN		32
+
+/* The snapshot is a padding to the end of the data area */
+#define DAMON_RING_SNAPSHOT_PAD		(1 << 0)
+
+/**
+ * struct damon_ring_snapshot - Header of a snapshot in the ring buffer.
+ * @size:		Size of the snapshot, including this header.
+ * @flags:		Flags of the snapshot.
+ * @nr_targets:		Number of the targets in the snapshot.
+ * @time_ns:		Time of the aggregation in nanoseconds.
+ * @reserved:		Reserved for future use.
+ *
+ * Each snapshot is aligned to DAMON_RING_ALIGN, and doesn't cross the end of
+ * the data area.  Instead, if DAMON_RING_SNAPSHOT_PAD is set in @flags, the
+ * snapshot is only for padding the rest of the data area, and the next
+ * snapshot starts from the beginning of the data area.  Otherwise, this
+ * header is followed by @nr_targets of &struct damon_ring_target, each of
+ * which is followed by its &struct damon_ring_region entries.  @time_ns is
+ * from CLOCK_MONOTONIC.
+ */
+struct damon_ring_snapshot {
+	__u64 size;
+	__u32 flags;
+	__u32 nr_targets;
+	__u64 time_ns;
+	__u64 reserved;
+};
+
+/**
+ * struct damon_ring_target - A target in a snapshot of the ring buffer.
+ * @id:			Identifier of the target.
+ * @nr_regions:		Number of the regions of the target that follow this.
+ *
+ * @id is the identifier that the user interface uses for the target, e.g.,
+ * the pid of the process in the initial pid namespace, or zero if the
+ * interface doesn't provide one.
+ */
+struct damon_ring_target {
+	__u64 id;
+	__u64 nr_regions;
+};
+
+/**
+ * struct damon_ring_region - A region in a snapshot of the ring buffer.
+ * @start:		Start address of the region.
+ * @end:		End address of the region.
+ * @nr_accesses:	Access frequency of the region.
+ * @age:		Age of the region.
+ */
+struct damon_ring_region {
+	__u64 start;
+	__u64 end;
+	__u32 nr_accesses;
+	__u32 age;
+};
+
+/**
+ * enum damon_op_type - Type of an incremental change to a DAMON context.
+ *
+ * @DAMON_OP_ADD_TARGET:	Add a monitoring target.
+ * @DAMON_OP_RM_TARGET:		Remove a monitoring target.
+ * @DAMON_OP_ADD_REGION:	Add a monitoring region to a target.
+ * @DAMON_OP_RM_REGION:		Remove an address range from a target.
+ * @DAMON_OP_ADD_SCHEME:	Add a DAMON-based operation scheme.
+ * @DAMON_OP_RM_SCHEME:		Remove a DAMON-based operation scheme.
+ * @NR_DAMON_OP_TYPES:		Number of the types.
+ */
+enum damon_op_type {
+	DAMON_OP_ADD_TARGET,
+	DAMON_OP_RM_TARGET,
+	DAMON_OP_ADD_REGION,
+	DAMON_OP_RM_REGION,
+	DAMON_OP_ADD_SCHEME,
+	DAMON_OP_RM_SCHEME,
+	NR_DAMON_OP_TYPES,
+};
+
+/**
+ * struct damon_scheme_desc - Description of a DAMON-based operation scheme.
+ *
+ * The fields are same to those of the ``schemes`` file of the DAMON debugfs
+ * interface, in the same order.  Unlike the file, @min_nr_writes and
+ * @max_nr_writes are not optional.  Set those as zero and ``UINT_MAX`` to
+ * ignore the write frequency of the regions.
+ */
+struct damon_scheme_desc {
+	__u64 min_sz_region;
+	__u64 max_sz_region;
+	__u32 min_nr_accesses;
+	__u32 max_nr_accesses;
+	__u32 min_age_region;
+	__u32 max_age_region;
+	__u32 action;
+	__u32 reserved;
+	__u64 quota_ms;
+	__u64 quota_sz;
+	__u64 quota_reset_interval;
+	__u32 quota_weight_sz;
+	__u32 quota_weight_nr_accesses;
+	__u32 quota_weight_age;
+	__u32 wmarks_metric;
+	__u64 wmarks_interval;
+	__u64 wmarks_high;
+	__u64 wmarks_mid;
+	__u64 wmarks_low;
+	__u32 min_nr_writes;
+	__u32 max_nr_writes;
+};
+
+/**
+ * struct damon_config_op - An incremental change to a DAMON context.
+ * @type:		Type of the change (&enum damon_op_type).
+ * @reserved:		Reserved.  Should be zero.
+ * @target_id:		Identifier of the target to add, remove or change.
+ * @start:		Start address of the region to add or remove.
+ * @end:		End address of the region to add or remove.
+ * @scheme_idx:		Index of the scheme to remove.
+ * @scheme:		Description of the scheme to add.
+ *
+ * Adding a region removes the existing regions of the target in the range
+ * first.  Removing an address range removes the parts of the regions of the
+ * target in the range.
+ */
+struct damon_config_op {
+	__u32 type;
+	__u32 reserved;
+	__u64 target_id;
+	__u64 start;
+	__u64 end;
+	__u64 scheme_idx;
+	struct damon_scheme_desc scheme;
+};
+
+/**
+ * struct damon_config_ops - Batch of &struct damon_config_op.
+ * @nr_ops:		Number of the changes.
+ * @ops:		User space pointer to the array of the changes.
+ *
+ * The changes are applied to the context in order, all or nothing.  If the
+ * monitoring is running, the changes are applied between two samplings.
+ */
+struct damon_config_ops {
+	__u64 nr_ops;
+	__u64 ops;
+};
+
+#define DAMON_IOC_MAGIC		0xDA
+
+#define DAMON_IOC_QUERY_HOTNESS	_IOWR(DAMON_IOC_MAGIC, 0x01, \
+		struct damon_hotness_queries)
+#define DAMON_IOC_COMMIT	_IOW(DAMON_IOC_MAGIC, 0x02, \
+		struct damon_config_ops)
+
+#endif /* _UAPI_LINUX_DAMON_H */
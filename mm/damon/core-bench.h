@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Data Access Monitor Microbenchmarks
+ *
+ * Measure the time that the core data paths of DAMON spend for synthetic
+ * targets of 1,000 to 1,000,000 regions, and print it in nanoseconds per
+ * region.
+ */
+
+#ifdef CONFIG_DAMON_KUNIT_BENCH
+
+#ifndef _DAMON_CORE_BENCH_H
+#define _DAMON_CORE_BENCH_H
+
+#include <kunit/test.h>
+
+#define DAMON_BENCH_REGION_SZ	(DAMON_MIN_REGION * 16)
+
+static const unsigned int damon_bench_nr_regions[] = {
+	1000, 10000, 100000, 1000000,
+};
+
+static void damon_bench_nr_regions_desc(const unsigned int *nr_regions,
+		char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%u regions", *nr_regions);
+}
+
+KUNIT_ARRAY_PARAM(damon_bench, damon_bench_nr_regions,
+		damon_bench_nr_regions_desc);
+
+/* Repeat the measurement for small targets to get a stable result */
+static unsigned int damon_bench_nr_iters(unsigned int nr_regions)
+{
+	return clamp(1000000 / nr_regions, 1u, 100u);
+}
+
+/*
+ * Synthetic access pattern.  Runs of 32 hot regions having slightly different
+ * access frequencies alternate with runs of 32 cold regions.
+ */
+static unsigned int damon_bench_nr_accesses(unsigned int i)
+{
+	if ((i / 32) % 2)
+		return 0;
+	return 10 + i % 5;
+}
+
+/* Construct a context having a target of the given number of regions */
+static struct damon_ctx *damon_bench_new_ctx(unsigned int nr_regions)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned int i;
+
+	if (!c)
+		return NULL;
+
+	t = damon_new_target(42);
+	if (!t)
+		goto fail;
+	damon_add_target(c, t);
+
+	for (i = 0; i < nr_regions; i++) {
+		r = damon_new_region(i * DAMON_BENCH_REGION_SZ,
+				(i + 1) * DAMON_BENCH_REGION_SZ);
+		if (!r)
+			goto fail;
+		r->nr_accesses = damon_bench_nr_accesses(i);
+		r->last_nr_accesses = damon_bench_nr_accesses(i + 1);
+		r->age = i % 10;
+		damon_add_region(r, t);
+	}
+	return c;
+
+fail:
+	damon_destroy_ctx(c);
+	return NULL;
+}
+
+static void damon_bench_report(struct kunit *test, const char *name,
+		unsigned int nr_regions, unsigned int nr_iters, u64 ns)
+{
+	kunit_info(test, "%s: %u regions: %llu ns/region\n", name, nr_regions,
+			div_u64(ns, (u64)nr_regions * nr_iters));
+}
+
+static void damon_bench_new_regions(struct kunit *test)
+{
+	unsigned int nr_regions = *(unsigned int *)test->param_value;
+	unsigned int nr_iters = damon_bench_nr_iters(nr_regions);
+	struct damon_ctx *c;
+	u64 begin, ns = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_iters; i++) {
+		begin = ktime_get_ns();
+		c = damon_bench_new_ctx(nr_regions);
+		ns += ktime_get_ns() - begin;
+		if (!c)
+			kunit_skip(test, "failed to construct the target");
+		damon_destroy_ctx(c);
+	}
+	damon_bench_report(test, "new_regions", nr_regions, nr_iters, ns);
+}
+
+static void damon_bench_split_regions_of(struct kunit *test)
+{
+	unsigned int nr_regions = *(unsigned int *)test->param_value;
+	unsigned int nr_iters = damon_bench_nr_iters(nr_regions);
+	struct damon_ctx *c;
+	u64 begin, ns = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_iters; i++) {
+		c = damon_bench_new_ctx(nr_regions);
+		if (!c)
+			kunit_skip(test, "failed to construct the target");
+		begin = ktime_get_ns();
+		damon_split_regions_of(c, damon_find_target(c, 42), 2);
+		ns += ktime_get_ns() - begin;
+		damon_destroy_ctx(c);
+	}
+	damon_bench_report(test, "split_regions_of", nr_regions, nr_iters, ns);
+}
+
+static void damon_bench_merge_regions_of(struct kunit *test)
+{
+	unsigned int nr_regions = *(unsigned int *)test->param_value;
+	unsigned int nr_iters = damon_bench_nr_iters(nr_regions);
+	struct damon_ctx *c;
+	u64 begin, ns = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_iters; i++) {
+		c = damon_bench_new_ctx(nr_regions);
+		if (!c)
+			kunit_skip(test, "failed to construct the target");
+		begin = ktime_get_ns();
+		damon_merge_regions_of(damon_find_target(c, 42), 2,
+				DAMON_BENCH_REGION_SZ * 64);
+		ns += ktime_get_ns() - begin;
+		damon_destroy_ctx(c);
+	}
+	damon_bench_report(test, "merge_regions_of", nr_regions, nr_iters, ns);
+}
+
+static int damon_bench_scheme_score(struct damon_ctx *c,
+		struct damon_target *t, struct damon_region *r,
+		struct damos *s)
+{
+	return DAMOS_MAX_SCORE - min_t(unsigned int, r->nr_accesses,
+			DAMOS_MAX_SCORE);
+}
+
+static int damon_bench_apply_scheme(struct damon_ctx *c,
+		struct damon_target *t, struct damon_region *r,
+		struct damos *s)
+{
+	return 0;
+}
+
+static void damon_bench_apply_schemes(struct kunit *test)
+{
+	unsigned int nr_regions = *(unsigned int *)test->param_value;
+	unsigned int nr_iters = damon_bench_nr_iters(nr_regions);
+	/* Apply the scheme to the colder half of the memory */
+	struct damos_quota quota = {
+		.sz = nr_regions / 2 * DAMON_BENCH_REGION_SZ,
+		.weight_nr_accesses = 1,
+	};
+	struct damos_watermarks wmarks = {};
+	struct damon_ctx *c;
+	struct damos *s;
+	u64 begin, ns = 0;
+	unsigned int i;
+
+	c = damon_bench_new_ctx(nr_regions);
+	if (!c)
+		kunit_skip(test, "failed to construct the target");
+	c->primitive.get_scheme_score = damon_bench_scheme_score;
+	c->primitive.apply_scheme = damon_bench_apply_scheme;
+	s = damon_new_scheme(0, ULONG_MAX, 0, UINT_MAX, 0, UINT_MAX,
+			DAMOS_STAT, &quota, &wmarks);
+	if (!s) {
+		damon_destroy_ctx(c);
+		kunit_skip(test, "failed to construct the scheme");
+	}
+	damon_add_scheme(c, s);
+
+	for (i = 0; i < nr_iters; i++) {
+		begin = ktime_get_ns();
+		kdamond_apply_schemes(c);
+		ns += ktime_get_ns() - begin;
+	}
+	damon_destroy_ctx(c);
+	damon_bench_report(test, "apply_schemes", nr_regions, nr_iters, ns);
+}
+
+static void damon_bench_reset_aggregated(struct kunit *test)
+{
+	unsigned int nr_regions = *(unsigned int *)test->param_value;
+	unsigned int nr_iters = damon_bench_nr_iters(nr_regions);
+	struct damon_ctx *c;
+	u64 begin, ns = 0;
+	unsigned int i;
+
+	c = damon_bench_new_ctx(nr_regions);
+	if (!c)
+		kunit_skip(test, "failed to construct the target");
+	for (i = 0; i < nr_iters; i++) {
+		begin = ktime_get_ns();
+		kdamond_reset_aggregated(c);
+		ns += ktime_get_ns() - begin;
+	}
+	damon_destroy_ctx(c);
+	damon_bench_report(test, "reset_aggregated", nr_regions, nr_iters, ns);
+}
+
+static struct kunit_case damon_bench_cases[] = {
+	KUNIT_CASE_PARAM(damon_bench_new_regions, damon_bench_gen_params),
+	KUNIT_CASE_PARAM(damon_bench_split_regions_of, damon_bench_gen_params),
+	KUNIT_CASE_PARAM(damon_bench_merge_regions_of, damon_bench_gen_params),
+	KUNIT_CASE_PARAM(damon_bench_apply_schemes, damon_bench_gen_params),
+	KUNIT_CASE_PARAM(damon_bench_reset_aggregated, damon_bench_gen_params),
+	{},
+};
+
+static struct kunit_suite damon_bench_suite = {
+	.name = "damon-bench",
+	.test_cases = damon_bench_cases,
+};
+kunit_test_suite(damon_bench_suite);
+
+#endif /* _DAMON_CORE_BENCH_H */
+
+#endif	/* CONFIG_DAMON_KUNIT_BENCH */
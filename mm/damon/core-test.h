@@ -146,15 +146,21 @@ static void damon_test_merge_two(struct kunit *test)
 	t = damon_new_target(42);
 	r = damon_new_region(0, 100);
 	r->nr_accesses = 10;
+	r->nr_writes = 4;
+	r->hotness = 1024;
 	damon_add_region(r, t);
 	r2 = damon_new_region(100, 300);
 	r2->nr_accesses = 20;
+	r2->nr_writes = 10;
+	r2->hotness = 2560;
 	damon_add_region(r2, t);
 
 	damon_merge_two_regions(t, r, r2);
 	KUNIT_EXPECT_EQ(test, r->ar.start, 0ul);
 	KUNIT_EXPECT_EQ(test, r->ar.end, 300ul);
 	KUNIT_EXPECT_EQ(test, r->nr_accesses, 16u);
+	KUNIT_EXPECT_EQ(test, r->nr_writes, 8u);
+	KUNIT_EXPECT_EQ(test, r->hotness, 2048u);
 
 	i = 0;
 	damon_for_each_region(r3, t) {
@@ -231,6 +237,493 @@ static void damon_test_split_regions_of(struct kunit *test)
 	damon_destroy_ctx(c);
 }
 
+static void damon_test_split_changing_regions(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sa[] = {0, 100, 200, 300, 400};
+	unsigned long ea[] = {100, 200, 300, 400, 500};
+	unsigned int last_nrs[] = {0, 0, 10, 10, 10};
+	unsigned int ages[] = {5, 5, 5, 0, 5};
+	int i;
+
+	t = damon_new_target(42);
+	for (i = 0; i < ARRAY_SIZE(sa); i++) {
+		r = damon_new_region(sa[i], ea[i]);
+		r->last_nr_accesses = last_nrs[i];
+		r->age = ages[i];
+		damon_add_region(r, t);
+	}
+	damon_add_target(c, t);
+
+	/* Only the middle three regions are changing */
+	kdamond_split_changing_regions(c, 3, damon_nr_regions(t));
+	KUNIT_EXPECT_GT(test, damon_nr_regions(t), 5u);
+	KUNIT_EXPECT_LE(test, damon_nr_regions(t), 11u);
+	r = __nth_region_of(t, 0);
+	KUNIT_EXPECT_EQ(test, r->ar.end, 100ul);
+	r = damon_last_region(t);
+	KUNIT_EXPECT_EQ(test, r->ar.start, 400ul);
+
+	/* No room under the max_nr_regions */
+	kdamond_split_changing_regions(c, 3, c->max_nr_regions);
+	KUNIT_EXPECT_LE(test, damon_nr_regions(t), 11u);
+
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_align_regions_of(struct kunit *test)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sa[] = {3, 12, 18, 41, 70};
+	unsigned long ea[] = {12, 18, 33, 44, 71};
+	unsigned long expected_sa[] = {3, 16, 32, 41, 70};
+	unsigned long expected_ea[] = {16, 32, 33, 44, 71};
+	int i;
+
+	t = damon_new_target(42);
+	for (i = 0; i < ARRAY_SIZE(sa); i++) {
+		r = damon_new_region(sa[i], ea[i]);
+		damon_add_region(r, t);
+	}
+
+	/* Only the boundaries inside the run of 3-33 are aligned */
+	damon_align_regions_of(t, 16);
+	KUNIT_EXPECT_EQ(test, damon_nr_regions(t), 5u);
+	for (i = 0; i < ARRAY_SIZE(expected_sa); i++) {
+		r = __nth_region_of(t, i);
+		KUNIT_EXPECT_EQ(test, r->ar.start, expected_sa[i]);
+		KUNIT_EXPECT_EQ(test, r->ar.end, expected_ea[i]);
+	}
+	damon_free_target(t);
+}
+
+static void damon_test_update_region_hotness(struct kunit *test)
+{
+	struct damon_region *r = damon_new_region(0, 100);
+
+	/* Accessed in the last sampling */
+	r->nr_accesses = 1;
+	damon_update_region_hotness(r, 20 << DAMON_HOTNESS_FRAC_BITS, 2);
+	KUNIT_EXPECT_EQ(test, r->hotness, 5u << DAMON_HOTNESS_FRAC_BITS);
+
+	/* Not accessed in the last sampling */
+	damon_update_region_hotness(r, 20 << DAMON_HOTNESS_FRAC_BITS, 2);
+	KUNIT_EXPECT_EQ(test, r->hotness, 15u << (DAMON_HOTNESS_FRAC_BITS - 2));
+
+	damon_free_region(r);
+}
+
+static void damon_test_query_hotness(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sa[] = {0, 10, 30};
+	unsigned long ea[] = {10, 20, 40};
+	unsigned int nrs[] = {3, 9, 1};
+	struct damon_hotness_query queries[] = {
+		{.addr = 5}, {.addr = 10}, {.addr = 25}, {.addr = 39},
+		{.addr = 40},
+	};
+	unsigned long expected_starts[] = {0, 10, 0, 30, 0};
+	unsigned int expected_nrs[] = {3, 9, 0, 1, 0};
+	int i;
+
+	t = damon_new_target(42);
+	for (i = 0; i < ARRAY_SIZE(sa); i++) {
+		r = damon_new_region(sa[i], ea[i]);
+		r->nr_accesses = nrs[i];
+		damon_add_region(r, t);
+	}
+	damon_add_target(c, t);
+
+	/* The index is not made yet */
+	KUNIT_EXPECT_EQ(test, damon_query_hotness(c, 42, queries, 1), 0);
+	KUNIT_EXPECT_EQ(test, queries[0].end, 0ull);
+
+	damon_update_region_index(t);
+	KUNIT_EXPECT_EQ(test, damon_query_hotness(c, 43, queries, 1),
+			-ENOENT);
+	KUNIT_EXPECT_EQ(test, damon_query_hotness(c, 42, queries,
+				ARRAY_SIZE(queries)), 0);
+	for (i = 0; i < ARRAY_SIZE(queries); i++) {
+		KUNIT_EXPECT_EQ(test, queries[i].start,
+				(u64)expected_starts[i]);
+		KUNIT_EXPECT_EQ(test, queries[i].nr_accesses,
+				expected_nrs[i]);
+	}
+
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_summarize_target(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sa[] = {0, 10, 30};
+	unsigned long ea[] = {10, 30, 40};
+	unsigned int nrs[] = {0, 20, 3};
+	unsigned int ages[] = {0, 1, 5};
+	int i;
+
+	t = damon_new_target(42);
+	for (i = 0; i < ARRAY_SIZE(sa); i++) {
+		r = damon_new_region(sa[i], ea[i]);
+		r->nr_accesses = nrs[i];
+		r->age = ages[i];
+		damon_add_region(r, t);
+	}
+	damon_add_target(c, t);
+
+	damon_summarize_target(c, t, 20);
+	KUNIT_EXPECT_EQ(test, t->summary.wss, 30ul);
+	KUNIT_EXPECT_EQ(test, t->summary.sz_by_freq[0], 10ul);
+	KUNIT_EXPECT_EQ(test, t->summary.sz_by_freq[2], 10ul);
+	KUNIT_EXPECT_EQ(test, t->summary.sz_by_freq[10], 20ul);
+	KUNIT_EXPECT_EQ(test, t->summary.sz_by_age[0], 10ul);
+	KUNIT_EXPECT_EQ(test, t->summary.sz_by_age[1], 20ul);
+	KUNIT_EXPECT_EQ(test, t->summary.sz_by_age[3], 10ul);
+	KUNIT_EXPECT_EQ(test, t->summary.wss_percentiles[0], 30ul);
+
+	/* The working set size shrinks */
+	r = __nth_region_of(t, 1);
+	r->nr_accesses = 0;
+	damon_summarize_target(c, t, 20);
+	KUNIT_EXPECT_EQ(test, t->summary.wss, 10ul);
+	/* Percentiles below 100 of {10, 30} pick the lower one */
+	KUNIT_EXPECT_EQ(test, t->summary.wss_percentiles[0], 10ul);
+	KUNIT_EXPECT_EQ(test, t->summary.wss_percentiles[1], 10ul);
+	KUNIT_EXPECT_EQ(test, t->summary.wss_percentiles[2], 10ul);
+
+	damon_destroy_ctx(c);
+}
+
+static unsigned long damon_test_ring_target_id(struct damon_ctx *ctx,
+		struct damon_target *t)
+{
+	return t->id + 1;
+}
+
+static void damon_test_write_ring(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_ring_snapshot *snapshot;
+	struct damon_ring_target *rt;
+	struct damon_ring_region *rr;
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long sa[] = {0, 10, 30};
+	unsigned long ea[] = {10, 30, 40};
+	unsigned long i;
+
+	KUNIT_EXPECT_EQ(test, damon_set_ring(c, PAGE_SIZE + 1, NULL), -EINVAL);
+	KUNIT_ASSERT_EQ(test, damon_set_ring(c, PAGE_SIZE,
+				damon_test_ring_target_id), 0);
+
+	t = damon_new_target(42);
+	for (i = 0; i < ARRAY_SIZE(sa); i++) {
+		r = damon_new_region(sa[i], ea[i]);
+		r->nr_accesses = i;
+		damon_add_region(r, t);
+	}
+	damon_add_target(c, t);
+
+	/* 32 bytes header, 16 bytes target and three 24 bytes regions */
+	kdamond_write_ring(c);
+	KUNIT_EXPECT_EQ(test, c->ring.hdr->head, 128ull);
+	KUNIT_EXPECT_EQ(test, c->ring.hdr->nr_snapshots, 1ull);
+
+	snapshot = (void *)c->ring.hdr + c->ring.hdr->data_off;
+	KUNIT_EXPECT_EQ(test, snapshot->size, 128ull);
+	KUNIT_EXPECT_EQ(test, snapshot->nr_targets, 1u);
+	rt = (void *)(snapshot + 1);
+	KUNIT_EXPECT_EQ(test, rt->id, 43ull);
+	KUNIT_EXPECT_EQ(test, rt->nr_regions, 3ull);
+	rr = (void *)(rt + 1);
+	KUNIT_EXPECT_EQ(test, rr[1].start, 10ull);
+	KUNIT_EXPECT_EQ(test, rr[2].nr_accesses, 2u);
+
+	/* Fill up the ring buffer without the reader */
+	for (i = 1; i < PAGE_SIZE / 128; i++)
+		kdamond_write_ring(c);
+	KUNIT_EXPECT_EQ(test, c->ring.hdr->nr_overruns, 0ull);
+	kdamond_write_ring(c);
+	KUNIT_EXPECT_EQ(test, c->ring.hdr->nr_overruns, 1ull);
+
+	/* The reader consumed the first snapshot */
+	c->ring.hdr->tail = 128;
+	kdamond_write_ring(c);
+	KUNIT_EXPECT_EQ(test, c->ring.hdr->head, (u64)PAGE_SIZE + 128);
+
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_cpu_budget(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+
+	KUNIT_EXPECT_EQ(test, damon_set_cpu_budget(c, 1001), -EINVAL);
+	damon_set_attrs(c, 5000, 100000, 1000000, 10, 40);
+	kdamond_init_cpu_budget(c);
+
+	/* Reduce the regions first, and then stretch the intervals */
+	kdamond_tighten_budget(c);
+	KUNIT_EXPECT_EQ(test, c->max_nr_regions, 20ul);
+	kdamond_tighten_budget(c);
+	KUNIT_EXPECT_EQ(test, c->max_nr_regions, 10ul);
+	kdamond_tighten_budget(c);
+	KUNIT_EXPECT_EQ(test, c->max_nr_regions, 10ul);
+	KUNIT_EXPECT_EQ(test, c->sample_interval, 10000ul);
+	KUNIT_EXPECT_EQ(test, c->aggr_interval, 200000ul);
+
+	/* Revert in the reverse order */
+	kdamond_relax_budget(c);
+	KUNIT_EXPECT_EQ(test, c->sample_interval, 5000ul);
+	KUNIT_EXPECT_EQ(test, c->max_nr_regions, 10ul);
+	kdamond_relax_budget(c);
+	KUNIT_EXPECT_EQ(test, c->max_nr_regions, 20ul);
+
+	kdamond_tighten_budget(c);
+	kdamond_restore_cpu_budget(c);
+	KUNIT_EXPECT_EQ(test, c->max_nr_regions, 40ul);
+
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_commit_ops(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_op ops[3] = {};
+	struct damon_target *t, *t2;
+	struct damon_region *r;
+	unsigned long sa[] = {0, 50, 60};
+	unsigned long ea[] = {30, 60, 100};
+	int i = 0;
+
+	t = damon_new_target(42);
+	damon_add_region(damon_new_region(0, 100), t);
+	damon_add_target(c, t);
+
+	/* Add a region inside of an existing region */
+	ops[0].type = DAMON_OP_ADD_REGION;
+	ops[0].target_id = 42;
+	ops[0].ar = (struct damon_addr_range){.start = 40, .end = 60};
+	ops[0].region = damon_new_region(40, 60);
+	ops[0].spare = damon_new_region(40, 60);
+	/* Remove a range over two regions */
+	ops[1].type = DAMON_OP_RM_REGION;
+	ops[1].target_id = 42;
+	ops[1].ar = (struct damon_addr_range){.start = 30, .end = 50};
+	ops[1].spare = damon_new_region(30, 50);
+	/* Remove a target that does not exist */
+	ops[2].type = DAMON_OP_RM_TARGET;
+	ops[2].target_id = 7;
+
+	/* Nothing is applied if any op fails */
+	KUNIT_EXPECT_EQ(test, damon_commit_ops(c, ops, 3), -ENOENT);
+	KUNIT_EXPECT_EQ(test, damon_nr_regions(t), 1u);
+
+	ops[2].type = DAMON_OP_ADD_TARGET;
+	t2 = damon_new_target(7);
+	ops[2].target = t2;
+	KUNIT_EXPECT_EQ(test, damon_commit_ops(c, ops, 3), 0);
+	KUNIT_EXPECT_EQ(test, damon_nr_regions(t), 3u);
+	damon_for_each_region(r, t) {
+		KUNIT_EXPECT_EQ(test, r->ar.start, sa[i]);
+		KUNIT_EXPECT_EQ(test, r->ar.end, ea[i++]);
+	}
+	KUNIT_EXPECT_PTR_EQ(test, ops[0].region, NULL);
+	KUNIT_EXPECT_PTR_EQ(test, ops[0].spare, NULL);
+	KUNIT_EXPECT_PTR_EQ(test, ops[2].target, NULL);
+	KUNIT_EXPECT_PTR_EQ(test, damon_find_target(c, 7), t2);
+
+	damon_free_ops(ops, 3);
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_scheme_targets(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damos_quota quota = {};
+	struct damos_watermarks wmarks = {};
+	struct damon_target *t1, *t2;
+	unsigned long ids[] = {2};
+	struct damos *s;
+
+	t1 = damon_new_target(1);
+	damon_add_target(c, t1);
+	t2 = damon_new_target(2);
+	damon_add_target(c, t2);
+	s = damon_new_scheme(0, ULONG_MAX, 0, UINT_MAX, 0, UINT_MAX,
+			DAMOS_STAT, &quota, &wmarks);
+	damon_add_scheme(c, s);
+
+	KUNIT_EXPECT_TRUE(test, damos_has_target(s, t1));
+	KUNIT_EXPECT_EQ(test, damon_set_scheme_targets(s, ids, 1), 0);
+	KUNIT_EXPECT_FALSE(test, damos_has_target(s, t1));
+	KUNIT_EXPECT_TRUE(test, damos_has_target(s, t2));
+
+	/* The scheme is not applied to new targets after its targets removed */
+	damon_set_targets(c, ids, 1);
+	KUNIT_EXPECT_EQ(test, s->nr_target_ids, 0u);
+	KUNIT_EXPECT_FALSE(test, damos_has_target(s, damon_find_target(c, 2)));
+
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_scheme_memcgs(struct kunit *test)
+{
+	struct damos_quota quota = {};
+	struct damos_watermarks wmarks = {};
+	struct damos_memcg memcgs[] = {
+		{ .id = 42, .protected = true, .charged_sz = 4096 },
+		{ .id = 43, .quota_sz = 8192 },
+	};
+	struct damos *s;
+
+	s = damon_new_scheme(0, ULONG_MAX, 0, UINT_MAX, 0, UINT_MAX,
+			DAMOS_PAGEOUT, &quota, &wmarks);
+	KUNIT_EXPECT_EQ(test, damon_set_scheme_memcgs(s, memcgs, 2), 0);
+	KUNIT_EXPECT_EQ(test, s->nr_memcgs, 2u);
+	KUNIT_EXPECT_TRUE(test, s->memcgs != memcgs);
+	KUNIT_EXPECT_EQ(test, s->memcgs[0].id, 42ull);
+	KUNIT_EXPECT_TRUE(test, s->memcgs[0].protected);
+	KUNIT_EXPECT_EQ(test, s->memcgs[0].charged_sz, 0ul);
+	KUNIT_EXPECT_EQ(test, s->memcgs[1].quota_sz, 8192ul);
+
+	KUNIT_EXPECT_EQ(test, damon_set_scheme_memcgs(s, NULL, 0), 0);
+	KUNIT_EXPECT_EQ(test, s->nr_memcgs, 0u);
+	KUNIT_EXPECT_PTR_EQ(test, s->memcgs, (struct damos_memcg *)NULL);
+
+	damon_destroy_scheme(s);
+}
+
+static void damon_test_refault_feedback(struct kunit *test)
+{
+	struct damos_quota quota = { .sz = 1024 * 1024 };
+	struct damos_watermarks wmarks = {};
+	struct damos *s;
+
+	s = damon_new_scheme(0, ULONG_MAX, 0, UINT_MAX, 0, UINT_MAX,
+			DAMOS_PAGEOUT, &quota, &wmarks);
+
+	/* The size quota of the feedback overrides only smaller quotas */
+	s->quota.fsz = 4096;
+	damos_set_effective_quota(&s->quota);
+	KUNIT_EXPECT_EQ(test, s->quota.esz, 4096ul);
+	s->quota.fsz = 0;
+	damos_set_effective_quota(&s->quota);
+	KUNIT_EXPECT_EQ(test, s->quota.esz, 1024ul * 1024);
+	s->quota.sz = 0;
+	s->quota.fsz = 8192;
+	damos_set_effective_quota(&s->quota);
+	KUNIT_EXPECT_EQ(test, s->quota.esz, 8192ul);
+
+	/* The back off is removed if the feedback is disabled */
+	s->quota.charged_from = 1;
+	damos_update_refault_feedback(s);
+	KUNIT_EXPECT_EQ(test, s->quota.fsz, 0ul);
+
+	/* The back off is doubled, and removed once it is not limiting */
+	s->quota.max_refault_permil = ULONG_MAX;
+	s->quota.fsz = 8192;
+	s->quota.charged_sz = 8192;
+	damos_update_refault_feedback(s);
+	KUNIT_EXPECT_EQ(test, s->quota.fsz, 16384ul);
+	s->quota.charged_sz = 4096;
+	damos_update_refault_feedback(s);
+	KUNIT_EXPECT_EQ(test, s->quota.fsz, 0ul);
+
+	damon_destroy_scheme(s);
+}
+
+static unsigned int damon_test_nr_applies;
+
+static int damon_test_apply_scheme_ranges(struct damon_ctx *c,
+		struct damon_target *t, struct damos *s,
+		struct damon_addr_range *ranges, unsigned int nr_ranges)
+{
+	damon_test_nr_applies++;
+	return 0;
+}
+
+static void damon_test_batch_range(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damos_quota quota = {};
+	struct damos_watermarks wmarks = {};
+	struct damon_addr_range ar;
+	struct damon_target *t;
+	struct damos *s;
+	int i;
+
+	c->primitive.apply_scheme_ranges = damon_test_apply_scheme_ranges;
+	t = damon_new_target(42);
+	damon_add_target(c, t);
+	s = damon_new_scheme(0, ULONG_MAX, 0, UINT_MAX, 0, UINT_MAX,
+			DAMOS_PAGEOUT, &quota, &wmarks);
+	damon_add_scheme(c, s);
+	damon_test_nr_applies = 0;
+
+	/* Adjacent ranges are merged */
+	for (i = 0; i < 3; i++) {
+		ar = (struct damon_addr_range){.start = i * 10,
+			.end = (i + 1) * 10};
+		damos_batch_range(c, t, s, &ar, 0);
+	}
+	ar = (struct damon_addr_range){.start = 40, .end = 50};
+	damos_batch_range(c, t, s, &ar, 0);
+	KUNIT_EXPECT_EQ(test, s->nr_batch, 2u);
+	KUNIT_EXPECT_EQ(test, s->batch[0].end, 30ul);
+	damos_flush_batch(c, t, s);
+	KUNIT_EXPECT_EQ(test, damon_test_nr_applies, 1u);
+	KUNIT_EXPECT_EQ(test, s->nr_batch, 0u);
+
+	/* Full batch is applied before adding a new range */
+	for (i = 0; i <= DAMOS_MAX_BATCH; i++) {
+		ar = (struct damon_addr_range){.start = i * 20,
+			.end = i * 20 + 10};
+		damos_batch_range(c, t, s, &ar, 0);
+	}
+	KUNIT_EXPECT_EQ(test, damon_test_nr_applies, 2u);
+	KUNIT_EXPECT_EQ(test, s->nr_batch, 1u);
+
+	damon_destroy_ctx(c);
+}
+
+static void damon_test_zoom_hottest(struct kunit *test)
+{
+	struct damon_ctx *c = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	struct damon_target *t, *targets[3];
+	struct damon_region *r, *regions[3];
+	unsigned long sa[] = {0, 10, 20, 30, 40};
+	unsigned long ea[] = {10, 20, 30, 40, 50};
+	unsigned int nrs[] = {3, 9, 1, 7, 8};
+	unsigned long expected_starts[] = {10, 40, 30};
+	int i;
+
+	t = damon_new_target(42);
+	for (i = 0; i < ARRAY_SIZE(sa); i++) {
+		r = damon_new_region(sa[i], ea[i]);
+		r->nr_accesses = nrs[i];
+		damon_add_region(r, t);
+	}
+	damon_add_target(c, t);
+
+	KUNIT_EXPECT_EQ(test, damon_zoom_hottest(c, targets, regions, 3), 3u);
+	for (i = 0; i < 3; i++) {
+		KUNIT_EXPECT_PTR_EQ(test, targets[i], t);
+		KUNIT_EXPECT_EQ(test, regions[i]->ar.start,
+				expected_starts[i]);
+	}
+
+	damon_destroy_ctx(c);
+}
+
 static struct kunit_case damon_test_cases[] = {
 	KUNIT_CASE(damon_test_target),
 	KUNIT_CASE(damon_test_regions),
@@ -239,6 +732,19 @@ static struct kunit_case damon_test_cases[] = {
 	KUNIT_CASE(damon_test_merge_two),
 	KUNIT_CASE(damon_test_merge_regions_of),
 	KUNIT_CASE(damon_test_split_regions_of),
+	KUNIT_CASE(damon_test_split_changing_regions),
+	KUNIT_CASE(damon_test_align_regions_of),
+	KUNIT_CASE(damon_test_update_region_hotness),
+	KUNIT_CASE(damon_test_query_hotness),
+	KUNIT_CASE(damon_test_summarize_target),
+	KUNIT_CASE(damon_test_write_ring),
+	KUNIT_CASE(damon_test_cpu_budget),
+	KUNIT_CASE(damon_test_commit_ops),
+	KUNIT_CASE(damon_test_scheme_targets),
+	KUNIT_CASE(damon_test_scheme_memcgs),
+	KUNIT_CASE(damon_test_refault_feedback),
+	KUNIT_CASE(damon_test_batch_range),
+	KUNIT_CASE(damon_test_zoom_hottest),
 	{},
 };
 
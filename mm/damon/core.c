@@ -7,13 +7,21 @@
 
 #define pr_fmt(fmt) "damon: " fmt
 
+#include <linux/bitmap.h>
+#include <linux/completion.h>
 #include <linux/damon.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
+#include <linux/poll.h>
 #include <linux/random.h>
+#include <linux/sched/cputime.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/string.h>
+#include <linux/vmalloc.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/damon.h>
@@ -26,6 +34,9 @@
 /* Get a random number in [l, r) */
 #define damon_rand(l, r) (l + prandom_u32_max(r - l))
 
+/* Get the difference of two unsigned values */
+#define diff_of(a, b) (a > b ? a - b : b - a)
+
 static DEFINE_MUTEX(damon_lock);
 static int nr_running_ctxs;
 
@@ -51,10 +62,13 @@ struct damon_region *damon_new_region(unsigned long start, unsigned long end)
 	region->ar.start = start;
 	region->ar.end = end;
 	region->nr_accesses = 0;
+	region->nr_writes = 0;
 	INIT_LIST_HEAD(&region->list);
 
 	region->age = 0;
 	region->last_nr_accesses = 0;
+	region->hotness = 0;
+	region->sampled_nr_accesses = 0;
 
 	return region;
 }
@@ -113,12 +127,23 @@ struct damos *damon_new_scheme(
 	scheme->max_sz_region = max_sz_region;
 	scheme->min_nr_accesses = min_nr_accesses;
 	scheme->max_nr_accesses = max_nr_accesses;
+	scheme->min_nr_writes = 0;
+	scheme->max_nr_writes = UINT_MAX;
 	scheme->min_age_region = min_age_region;
 	scheme->max_age_region = max_age_region;
 	scheme->action = action;
 	scheme->stat_count = 0;
 	scheme->stat_sz = 0;
+	scheme->stat_sz_applied = 0;
+	scheme->stat_nr_failed = 0;
+	scheme->target_ids = NULL;
+	scheme->nr_target_ids = 0;
+	scheme->memcgs = NULL;
+	scheme->nr_memcgs = 0;
 	INIT_LIST_HEAD(&scheme->list);
+	scheme->batch = NULL;
+	scheme->nr_batch = 0;
+	scheme->batch_age = 0;
 
 	scheme->quota.ms = quota->ms;
 	scheme->quota.sz = quota->sz;
@@ -126,6 +151,8 @@ struct damos *damon_new_scheme(
 	scheme->quota.weight_sz = quota->weight_sz;
 	scheme->quota.weight_nr_accesses = quota->weight_nr_accesses;
 	scheme->quota.weight_age = quota->weight_age;
+	scheme->quota.max_refault_permil = quota->max_refault_permil;
+	scheme->quota.refault_permil = 0;
 	scheme->quota.total_charged_sz = 0;
 	scheme->quota.total_charged_ns = 0;
 	scheme->quota.esz = 0;
@@ -133,12 +160,16 @@ struct damos *damon_new_scheme(
 	scheme->quota.charged_from = 0;
 	scheme->quota.charge_target_from = NULL;
 	scheme->quota.charge_addr_from = 0;
+	scheme->quota.fsz = 0;
+	scheme->quota.last_refaults = 0;
+	scheme->quota.last_sz_applied = 0;
 
 	scheme->wmarks.metric = wmarks->metric;
 	scheme->wmarks.interval = wmarks->interval;
 	scheme->wmarks.high = wmarks->high;
 	scheme->wmarks.mid = wmarks->mid;
 	scheme->wmarks.low = wmarks->low;
+	scheme->wmarks.nid = wmarks->nid;
 	scheme->wmarks.activated = true;
 
 	return scheme;
@@ -156,6 +187,9 @@ static void damon_del_scheme(struct damos *s)
 
 static void damon_free_scheme(struct damos *s)
 {
+	kfree(s->target_ids);
+	kfree(s->memcgs);
+	kfree(s->batch);
 	kfree(s);
 }
 
@@ -181,13 +215,15 @@ struct damon_target *damon_new_target(unsigned long id)
 	t->id = id;
 	t->nr_regions = 0;
 	INIT_LIST_HEAD(&t->regions_list);
+	RCU_INIT_POINTER(t->index, NULL);
+	memset(&t->summary, 0, sizeof(t->summary));
 
 	return t;
 }
 
 void damon_add_target(struct damon_ctx *ctx, struct damon_target *t)
 {
-	list_add_tail(&t->list, &ctx->adaptive_targets);
+	list_add_tail_rcu(&t->list, &ctx->adaptive_targets);
 }
 
 bool damon_targets_empty(struct damon_ctx *ctx)
@@ -197,7 +233,15 @@ bool damon_targets_empty(struct damon_ctx *ctx)
 
 static void damon_del_target(struct damon_target *t)
 {
-	list_del(&t->list);
+	list_del_rcu(&t->list);
+}
+
+static void damon_free_target_rcu(struct rcu_head *head)
+{
+	struct damon_target *t = container_of(head, struct damon_target, rcu);
+
+	kfree(rcu_dereference_protected(t->index, true));
+	kfree(t);
 }
 
 void damon_free_target(struct damon_target *t)
@@ -206,7 +250,8 @@ void damon_free_target(struct damon_target *t)
 
 	damon_for_each_region_safe(r, next, t)
 		damon_free_region(r);
-	kfree(t);
+	/* damon_query_hotness() reads the target and its index under RCU */
+	call_rcu(&t->rcu, damon_free_target_rcu);
 }
 
 void damon_destroy_target(struct damon_target *t)
@@ -260,6 +305,12 @@ struct damon_ctx *damon_new_ctx(enum damon_target_type type)
 	if (type != DAMON_ARBITRARY_TARGET) {
 		ctx->min_nr_regions = 10;
 		ctx->max_nr_regions = 1000;
+		ctx->region_granularity = DAMON_MIN_REGION;
+		ctx->wss_percentiles[0] = 50;
+		ctx->wss_percentiles[1] = 90;
+		ctx->wss_percentiles[2] = 99;
+		ctx->nr_wss_percentiles = 3;
+		init_waitqueue_head(&ctx->ring.wq);
 
 		INIT_LIST_HEAD(&ctx->adaptive_targets);
 		INIT_LIST_HEAD(&ctx->schemes);
@@ -268,15 +319,34 @@ struct damon_ctx *damon_new_ctx(enum damon_target_type type)
 	return ctx;
 }
 
+/* Remove a target from the targets of the schemes that applied to it */
+static void damon_unbind_target(struct damon_ctx *ctx, struct damon_target *t)
+{
+	struct damos *s;
+	unsigned int i;
+
+	damon_for_each_scheme(s, ctx) {
+		for (i = 0; i < s->nr_target_ids; i++) {
+			if (s->target_ids[i] != t->id)
+				continue;
+			s->target_ids[i] = s->target_ids[--s->nr_target_ids];
+			break;
+		}
+	}
+}
+
 static void damon_destroy_targets(struct damon_ctx *ctx)
 {
 	struct damon_target *t, *next_t;
 
-	if (ctx->primitive.cleanup) {
-		ctx->primitive.cleanup(ctx);
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET) {
+		if (ctx->primitive.cleanup)
+			ctx->primitive.cleanup(ctx);
 		return;
 	}
 
+	damon_for_each_target(t, ctx)
+		damon_unbind_target(ctx, t);
 	damon_for_each_target_safe(t, next_t, ctx)
 		damon_destroy_target(t);
 }
@@ -290,6 +360,8 @@ void damon_destroy_ctx(struct damon_ctx *ctx)
 	damon_for_each_scheme_safe(s, next_s, ctx)
 		damon_destroy_scheme(s);
 
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+		vfree(ctx->ring.hdr);
 	kfree(ctx);
 }
 
@@ -362,6 +434,11 @@ int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
 		ctx->min_nr_regions = min_nr_reg;
 		ctx->max_nr_regions = max_nr_reg;
 	}
+	/* Restored instead of the old values when the monitoring stops */
+	ctx->orig_sample_interval = sample_int;
+	ctx->orig_aggr_interval = aggr_int;
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+		ctx->orig_max_nr_regions = max_nr_reg;
 
 	return 0;
 }
@@ -390,6 +467,767 @@ int damon_set_schemes(struct damon_ctx *ctx, struct damos **schemes,
 	return 0;
 }
 
+/**
+ * damon_set_scheme_targets() - Set the targets to apply a scheme to.
+ * @s:		the scheme
+ * @ids:	array of the target ids
+ * @nr_ids:	number of entries in @ids
+ *
+ * Setting @nr_ids as zero makes @s to be applied to every target.  The targets
+ * that are removed from the context are removed from &damos.target_ids of @s,
+ * too.
+ *
+ * This function should not be called while the kdamond of the context of @s
+ * is running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_scheme_targets(struct damos *s, unsigned long *ids,
+		unsigned int nr_ids)
+{
+	unsigned long *target_ids = NULL;
+
+	if (nr_ids) {
+		target_ids = kmemdup(ids, sizeof(*ids) * nr_ids, GFP_KERNEL);
+		if (!target_ids)
+			return -ENOMEM;
+	}
+
+	kfree(s->target_ids);
+	s->target_ids = target_ids;
+	s->nr_target_ids = nr_ids;
+	return 0;
+}
+
+/**
+ * damon_set_scheme_memcgs() - Set the memory cgroup specific controls.
+ * @s:		the scheme
+ * @memcgs:	array of the memory cgroup specific controls
+ * @nr_memcgs:	number of entries in @memcgs
+ *
+ * Setting @nr_memcgs as zero removes the memory cgroup specific controls of
+ * @s.  The private fields of @memcgs are initialized by this function.
+ *
+ * This function should not be called while the kdamond of the context of @s
+ * is running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_scheme_memcgs(struct damos *s, struct damos_memcg *memcgs,
+		unsigned int nr_memcgs)
+{
+	struct damos_memcg *new_memcgs = NULL;
+	unsigned int i;
+
+	if (nr_memcgs) {
+		new_memcgs = kmemdup(memcgs, sizeof(*memcgs) * nr_memcgs,
+				GFP_KERNEL);
+		if (!new_memcgs)
+			return -ENOMEM;
+		for (i = 0; i < nr_memcgs; i++)
+			new_memcgs[i].charged_sz = 0;
+	}
+
+	kfree(s->memcgs);
+	s->memcgs = new_memcgs;
+	s->nr_memcgs = nr_memcgs;
+	return 0;
+}
+
+/**
+ * damon_set_zoom() - Set page granularity zooming of the hottest regions.
+ * @ctx:	monitoring context
+ * @nr_regions:	number of the hottest regions to zoom in
+ * @nr_aggrs:	number of aggregation intervals to zoom in each region
+ *
+ * Setting @nr_regions as zero disables the zooming.  The primitives of @ctx
+ * should implement &damon_primitive.prepare_page_access_checks and
+ * &damon_primitive.check_page_accesses for the zooming.
+ *
+ * This function should not be called while the kdamond of the context is
+ * running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_zoom(struct damon_ctx *ctx, unsigned int nr_regions,
+		unsigned int nr_aggrs)
+{
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+	if (nr_regions && (!nr_aggrs ||
+			!ctx->primitive.prepare_page_access_checks ||
+			!ctx->primitive.check_page_accesses))
+		return -EINVAL;
+
+	ctx->zoom_nr_regions = nr_regions;
+	ctx->zoom_nr_aggrs = nr_aggrs;
+	return 0;
+}
+
+/**
+ * damon_set_region_granularity() - Set the granularity of the regions.
+ * @ctx:		monitoring context
+ * @granularity:	the granularity of the regions
+ *
+ * @granularity should be a power of two that not smaller than
+ * DAMON_MIN_REGION.  For example, setting it as the PMD size aligns the regions
+ * to the transparent huge pages.  This function should not be called while the
+ * kdamond of the context is running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_region_granularity(struct damon_ctx *ctx,
+		unsigned long granularity)
+{
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+	if (granularity < DAMON_MIN_REGION || !is_power_of_2(granularity))
+		return -EINVAL;
+
+	ctx->region_granularity = granularity;
+	return 0;
+}
+
+/**
+ * damon_set_hotness_weight_shift() - Set the weight of each sample for the
+ * moving average of the access frequency of the regions.
+ * @ctx:	monitoring context
+ * @shift:	the weight shift, or zero for disabling the moving average
+ *
+ * This function should not be called while the kdamond of the context is
+ * running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_hotness_weight_shift(struct damon_ctx *ctx, unsigned int shift)
+{
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+	if (shift >= BITS_PER_TYPE(int) - DAMON_HOTNESS_FRAC_BITS)
+		return -EINVAL;
+
+	ctx->hotness_weight_shift = shift;
+	return 0;
+}
+
+/**
+ * damon_set_split_policy() - Set the regions split policy.
+ * @ctx:	monitoring context
+ * @policy:	the split policy
+ *
+ * This function should not be called while the kdamond of the context is
+ * running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_split_policy(struct damon_ctx *ctx,
+		enum damon_split_policy policy)
+{
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+	if (policy >= NR_DAMON_SPLIT_POLICIES)
+		return -EINVAL;
+
+	ctx->split_policy = policy;
+	return 0;
+}
+
+/**
+ * damon_set_wss_percentiles() - Set the working set size percentiles.
+ * @ctx:		monitoring context
+ * @percentiles:	array of the percentiles
+ * @nr_percentiles:	number of entries in @percentiles
+ *
+ * This function should not be called while the kdamond of the context is
+ * running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_wss_percentiles(struct damon_ctx *ctx,
+		unsigned int *percentiles, unsigned int nr_percentiles)
+{
+	unsigned int i;
+
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+	if (nr_percentiles > DAMON_MAX_WSS_PERCENTILES)
+		return -EINVAL;
+	for (i = 0; i < nr_percentiles; i++) {
+		if (percentiles[i] > 100)
+			return -EINVAL;
+	}
+
+	for (i = 0; i < nr_percentiles; i++)
+		ctx->wss_percentiles[i] = percentiles[i];
+	ctx->nr_wss_percentiles = nr_percentiles;
+	return 0;
+}
+
+/**
+ * damon_set_cpu_budget() - Set the CPU utilization budget of the monitoring.
+ * @ctx:	monitoring context
+ * @cpu_budget:	max CPU utilization in per-mille, or zero for no budget
+ *
+ * This function should not be called while the kdamond of the context is
+ * running.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_cpu_budget(struct damon_ctx *ctx, unsigned int cpu_budget)
+{
+	if (cpu_budget > 1000)
+		return -EINVAL;
+
+	ctx->cpu_budget = cpu_budget;
+	return 0;
+}
+
+/**
+ * damon_set_ring() - Set the ring buffer of the aggregation snapshots.
+ * @ctx:	monitoring context
+ * @data_sz:	size of the data area of the ring buffer
+ * @target_id:	function translating the targets to their identifiers, or NULL
+ *
+ * @data_sz should be a power of two that not smaller than PAGE_SIZE.  Setting
+ * @data_sz as zero removes the ring buffer.  @target_id is used for the
+ * identifiers of the targets in the buffer, as &damon_ring.target_id.  The
+ * pages of the old ring buffer that mapped to the user space are kept until
+ * those are unmapped.
+ *
+ * This function should not be called while the kdamond of the context is
+ * running.  The caller should hold &damon_ctx.kdamond_lock of @ctx.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_set_ring(struct damon_ctx *ctx, unsigned long data_sz,
+		unsigned long (*target_id)(struct damon_ctx *ctx,
+			struct damon_target *t))
+{
+	struct damon_ring_hdr *hdr = NULL;
+
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+	if (data_sz && (data_sz < PAGE_SIZE || !is_power_of_2(data_sz)))
+		return -EINVAL;
+
+	if (data_sz) {
+		hdr = vmalloc_user(PAGE_SIZE + data_sz);
+		if (!hdr)
+			return -ENOMEM;
+		hdr->data_off = PAGE_SIZE;
+		hdr->data_sz = data_sz;
+	}
+
+	vfree(ctx->ring.hdr);
+	ctx->ring.hdr = hdr;
+	ctx->ring.target_id = target_id;
+	ctx->ring.data_sz = data_sz;
+	ctx->ring.head = 0;
+	return 0;
+}
+
+/**
+ * damon_ring_mmap() - Map the ring buffer of a context to the user space.
+ * @ctx:	monitoring context
+ * @vma:	the user space memory area to map the ring buffer to
+ *
+ * This is for the &file_operations.mmap of the interfaces.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_ring_mmap(struct damon_ctx *ctx, struct vm_area_struct *vma)
+{
+	int err = -ENODEV;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->ring.hdr)
+		err = remap_vmalloc_range(vma, ctx->ring.hdr, vma->vm_pgoff);
+	mutex_unlock(&ctx->kdamond_lock);
+	return err;
+}
+
+/**
+ * damon_ring_poll() - Poll the ring buffer of a context.
+ * @ctx:	monitoring context
+ * @file:	the file that being polled
+ * @wait:	the poll table
+ *
+ * This is for the &file_operations.poll of the interfaces.
+ *
+ * Return: EPOLLIN if there are unread snapshots, zero otherwise.
+ */
+__poll_t damon_ring_poll(struct damon_ctx *ctx, struct file *file,
+		struct poll_table_struct *wait)
+{
+	__poll_t events = 0;
+
+	poll_wait(file, &ctx->ring.wq, wait);
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->ring.hdr &&
+			READ_ONCE(ctx->ring.head) != READ_ONCE(ctx->ring.hdr->tail))
+		events = EPOLLIN | EPOLLRDNORM;
+	mutex_unlock(&ctx->kdamond_lock);
+	return events;
+}
+
+/* Returns the address of a position of the ring buffer */
+static void *damon_ring_ptr(struct damon_ring *ring, u64 pos)
+{
+	return (void *)ring->hdr + PAGE_SIZE + (pos & (ring->data_sz - 1));
+}
+
+/*
+ * Write a snapshot of the regions of every target to the ring buffer
+ *
+ * The reader can write anything to the buffer, so only '->tail' of the header
+ * is read from the buffer.
+ */
+static void kdamond_write_ring(struct damon_ctx *c)
+{
+	struct damon_ring *ring = &c->ring;
+	struct damon_ring_hdr *hdr = ring->hdr;
+	struct damon_ring_snapshot *snapshot;
+	struct damon_ring_target *rt;
+	struct damon_ring_region *rr;
+	struct damon_target *t;
+	struct damon_region *r;
+	u64 sz = sizeof(*snapshot), pad = 0, head = ring->head, tail;
+	unsigned int nr_targets = 0;
+
+	damon_for_each_target(t, c) {
+		sz += sizeof(*rt) + t->nr_regions * sizeof(*rr);
+		nr_targets++;
+	}
+	sz = ALIGN(sz, DAMON_RING_ALIGN);
+
+	if ((head & (ring->data_sz - 1)) + sz > ring->data_sz)
+		pad = ring->data_sz - (head & (ring->data_sz - 1));
+
+	/* Pairs with the release of '->tail' by the reader */
+	tail = smp_load_acquire(&hdr->tail);
+	if (sz + pad > ring->data_sz || head - tail > ring->data_sz ||
+			sz + pad > ring->data_sz - (head - tail)) {
+		hdr->nr_overruns++;
+		goto out;
+	}
+
+	if (pad) {
+		snapshot = damon_ring_ptr(ring, head);
+		snapshot->size = pad;
+		snapshot->flags = DAMON_RING_SNAPSHOT_PAD;
+		snapshot->nr_targets = 0;
+		head += pad;
+	}
+
+	snapshot = damon_ring_ptr(ring, head);
+	snapshot->size = sz;
+	snapshot->flags = 0;
+	snapshot->nr_targets = nr_targets;
+	snapshot->time_ns = ktime_get_ns();
+	snapshot->reserved = 0;
+
+	rt = (void *)(snapshot + 1);
+	damon_for_each_target(t, c) {
+		rt->id = ring->target_id ? ring->target_id(c, t) : 0;
+		rt->nr_regions = t->nr_regions;
+		rr = (void *)(rt + 1);
+		damon_for_each_region(r, t) {
+			rr->start = r->ar.start;
+			rr->end = r->ar.end;
+			rr->nr_accesses = r->nr_accesses;
+			rr->age = r->age;
+			rr++;
+		}
+		rt = (void *)rr;
+	}
+
+	WRITE_ONCE(ring->head, head + sz);
+	/* Make the snapshot visible before the new head */
+	smp_store_release(&hdr->head, head + sz);
+	hdr->nr_snapshots++;
+out:
+	wake_up_interruptible(&ring->wq);
+}
+
+/* Returns the region of the index that contains the address, or NULL */
+static struct damon_region_info *damon_index_lookup(
+		struct damon_region_index *index, unsigned long addr)
+{
+	unsigned int lo = 0, hi, mid;
+	struct damon_region_info *r;
+
+	if (!index)
+		return NULL;
+
+	/* Find the last region that starts at or before the address */
+	hi = index->nr_regions;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->regions[mid].ar.start <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return NULL;
+
+	r = &index->regions[lo - 1];
+	if (addr >= r->ar.end)
+		return NULL;
+	return r;
+}
+
+/**
+ * damon_query_hotness() - Query the access pattern of addresses.
+ * @ctx:	monitoring context
+ * @target_id:	identifier of the monitoring target to query
+ * @queries:	array of the queries
+ * @nr_queries:	number of entries in @queries
+ *
+ * For each entry of @queries, find the region that contains
+ * &damon_hotness_query.addr of the entry from &damon_target.index of the
+ * target, and fill the other fields of the entry with the region.  Each lookup
+ * takes logarithmic time to the number of the regions.  This function can be
+ * called while the kdamond of the context is running, and reads the targets
+ * and their indexes under rcu_read_lock() only.
+ *
+ * Return: 0 if success, or negative error code otherwise.
+ */
+int damon_query_hotness(struct damon_ctx *ctx, unsigned long target_id,
+		struct damon_hotness_query *queries, unsigned int nr_queries)
+{
+	struct damon_region_index *index;
+	struct damon_region_info *r;
+	struct damon_target *t;
+	unsigned int i;
+	int err = -ENOENT;
+
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(t, &ctx->adaptive_targets, list) {
+		if (t->id != target_id)
+			continue;
+
+		index = rcu_dereference(t->index);
+		for (i = 0; i < nr_queries; i++) {
+			r = damon_index_lookup(index, queries[i].addr);
+			queries[i].start = r ? r->ar.start : 0;
+			queries[i].end = r ? r->ar.end : 0;
+			queries[i].nr_accesses = r ? r->nr_accesses : 0;
+			queries[i].age = r ? r->age : 0;
+		}
+		err = 0;
+		break;
+	}
+	rcu_read_unlock();
+
+	return err;
+}
+
+/* A batch of &struct damon_op that waiting for the kdamond to apply */
+struct damon_commit {
+	struct damon_op *ops;
+	unsigned int nr_ops;
+	int err;
+	struct completion done;
+};
+
+static struct damon_target *damon_find_target(struct damon_ctx *ctx,
+		unsigned long id)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx) {
+		if (t->id == id)
+			return t;
+	}
+	return NULL;
+}
+
+/*
+ * Check whether every op of a batch can be applied to the context, by
+ * simulating the changes of the targets and the schemes in order.
+ */
+static int damon_check_ops(struct damon_ctx *ctx, struct damon_op *ops,
+		unsigned int nr_ops)
+{
+	struct damon_target *t;
+	struct damos *s;
+	unsigned long *ids;
+	unsigned int nr_ids = 0, nr_schemes = 0, i, j;
+	int err = 0;
+
+	damon_for_each_target(t, ctx)
+		nr_ids++;
+	ids = kmalloc_array(nr_ids + nr_ops, sizeof(*ids), GFP_KERNEL);
+	if (!ids)
+		return -ENOMEM;
+	nr_ids = 0;
+	damon_for_each_target(t, ctx)
+		ids[nr_ids++] = t->id;
+	damon_for_each_scheme(s, ctx)
+		nr_schemes++;
+
+	for (i = 0; i < nr_ops && !err; i++) {
+		struct damon_op *op = &ops[i];
+
+		for (j = 0; j < nr_ids; j++) {
+			if (ids[j] == op->target_id)
+				break;
+		}
+
+		switch (op->type) {
+		case DAMON_OP_ADD_TARGET:
+			if (!op->target || op->target->id != op->target_id)
+				err = -EINVAL;
+			else if (j < nr_ids)
+				err = -EEXIST;
+			else
+				ids[nr_ids++] = op->target_id;
+			break;
+		case DAMON_OP_RM_TARGET:
+			if (j == nr_ids)
+				err = -ENOENT;
+			else
+				ids[j] = ids[--nr_ids];
+			break;
+		case DAMON_OP_ADD_REGION:
+			if (!op->region || op->region->ar.start != op->ar.start ||
+					op->region->ar.end != op->ar.end) {
+				err = -EINVAL;
+				break;
+			}
+			fallthrough;
+		case DAMON_OP_RM_REGION:
+			if (!op->spare || op->ar.start >= op->ar.end)
+				err = -EINVAL;
+			else if (j == nr_ids)
+				err = -ENOENT;
+			break;
+		case DAMON_OP_ADD_SCHEME:
+			if (!op->scheme)
+				err = -EINVAL;
+			else
+				nr_schemes++;
+			break;
+		case DAMON_OP_RM_SCHEME:
+			if (op->scheme_idx >= nr_schemes)
+				err = -ENOENT;
+			else
+				nr_schemes--;
+			break;
+		default:
+			err = -EINVAL;
+		}
+	}
+
+	kfree(ids);
+	return err;
+}
+
+/*
+ * Remove the parts of the regions of a target that intersect with a range
+ *
+ * '*spare' is used for the right part of a region that the range is inside of,
+ * and set to NULL if it is used.
+ *
+ * Returns the last region before the range, or NULL if there is no such region.
+ */
+static struct damon_region *damon_remove_range(struct damon_target *t,
+		struct damon_addr_range *ar, struct damon_region **spare)
+{
+	struct damon_region *r, *next, *right, *prev = NULL;
+
+	damon_for_each_region_safe(r, next, t) {
+		if (r->ar.end <= ar->start) {
+			prev = r;
+			continue;
+		}
+		if (r->ar.start >= ar->end)
+			break;
+
+		if (r->ar.start < ar->start && r->ar.end > ar->end) {
+			right = *spare;
+			*spare = NULL;
+			right->ar.start = ar->end;
+			right->ar.end = r->ar.end;
+			right->nr_accesses = r->nr_accesses;
+			right->nr_writes = r->nr_writes;
+			right->hotness = r->hotness;
+			right->sampled_nr_accesses = r->sampled_nr_accesses;
+			right->age = r->age;
+			right->last_nr_accesses = r->last_nr_accesses;
+			r->ar.end = ar->start;
+			damon_insert_region(right, r, next, t);
+			return r;
+		}
+		if (r->ar.start < ar->start) {
+			r->ar.end = ar->start;
+			prev = r;
+		} else if (r->ar.end > ar->end) {
+			r->ar.start = ar->end;
+			break;
+		} else {
+			damon_destroy_region(r, t);
+		}
+	}
+	return prev;
+}
+
+/* Apply a batch of ops that checked by damon_check_ops() */
+static void damon_apply_ops(struct damon_ctx *ctx, struct damon_op *ops,
+		unsigned int nr_ops)
+{
+	struct damon_region *prev;
+	struct damon_target *t;
+	struct damos *s;
+	unsigned int i, j;
+
+	for (i = 0; i < nr_ops; i++) {
+		struct damon_op *op = &ops[i];
+
+		switch (op->type) {
+		case DAMON_OP_ADD_TARGET:
+			damon_add_target(ctx, op->target);
+			op->target = NULL;
+			break;
+		case DAMON_OP_RM_TARGET:
+			t = damon_find_target(ctx, op->target_id);
+			damon_unbind_target(ctx, t);
+			damon_del_target(t);
+			damon_for_each_scheme(s, ctx) {
+				if (s->quota.charge_target_from != t)
+					continue;
+				s->quota.charge_target_from = NULL;
+				s->quota.charge_addr_from = 0;
+			}
+			op->target = t;
+			break;
+		case DAMON_OP_ADD_REGION:
+			t = damon_find_target(ctx, op->target_id);
+			prev = damon_remove_range(t, &op->ar, &op->spare);
+			list_add(&op->region->list,
+					prev ? &prev->list : &t->regions_list);
+			t->nr_regions++;
+			op->region = NULL;
+			break;
+		case DAMON_OP_RM_REGION:
+			t = damon_find_target(ctx, op->target_id);
+			damon_remove_range(t, &op->ar, &op->spare);
+			break;
+		case DAMON_OP_ADD_SCHEME:
+			damon_add_scheme(ctx, op->scheme);
+			op->scheme = NULL;
+			break;
+		case DAMON_OP_RM_SCHEME:
+			j = 0;
+			damon_for_each_scheme(s, ctx) {
+				if (j++ == op->scheme_idx)
+					break;
+			}
+			damon_del_scheme(s);
+			op->scheme = s;
+			break;
+		}
+	}
+}
+
+/**
+ * damon_commit_ops() - Apply a batch of incremental changes to a context.
+ * @ctx:	monitoring context
+ * @ops:	array of the changes
+ * @nr_ops:	number of entries in @ops
+ *
+ * Apply the entries of @ops to @ctx in order, all or nothing.  If any entry
+ * of @ops cannot be applied, e.g., removal of a target that does not exist,
+ * nothing is applied.  This function can be called while the kdamond of the
+ * context is running.  In the case, the kdamond applies the changes between
+ * two samplings, or while it waits for the activation of the schemes, and this
+ * function waits for it, so that the kdamond never sees partially applied
+ * changes.  If the kdamond stops before applying the changes, or the calling
+ * task is killed while waiting, nothing is applied.
+ *
+ * The objects in @ops that added to the context are removed from @ops, and
+ * the targets and the schemes that removed from the context are stored in
+ * @ops.  The caller should free the objects left in @ops after the call, using
+ * damon_free_ops().  The caller should not hold &damon_ctx.kdamond_lock of
+ * @ctx.
+ *
+ * Return: 0 if success, -ESRCH if the kdamond stopped before applying the
+ * changes, -ERESTARTSYS if the calling task is killed, or other negative error
+ * code otherwise.
+ */
+int damon_commit_ops(struct damon_ctx *ctx, struct damon_op *ops,
+		unsigned int nr_ops)
+{
+	struct damon_commit commit = {
+		.ops = ops,
+		.nr_ops = nr_ops,
+	};
+	int err;
+
+	if (ctx->target_type == DAMON_ARBITRARY_TARGET)
+		return -EINVAL;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (!ctx->kdamond) {
+		err = damon_check_ops(ctx, ops, nr_ops);
+		if (!err)
+			damon_apply_ops(ctx, ops, nr_ops);
+		mutex_unlock(&ctx->kdamond_lock);
+		return err;
+	}
+	if (ctx->commit) {
+		mutex_unlock(&ctx->kdamond_lock);
+		return -EBUSY;
+	}
+	init_completion(&commit.done);
+	ctx->commit = &commit;
+	/* Wake up the kdamond if it is waiting for the schemes activation */
+	wake_up_process(ctx->kdamond);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	err = wait_for_completion_killable(&commit.done);
+	if (!err)
+		return commit.err;
+
+	/*
+	 * The kdamond takes and completes the commit under kdamond_lock, so
+	 * the commit is either still pending or already completed here.
+	 */
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->commit == &commit)
+		ctx->commit = NULL;
+	else
+		err = commit.err;
+	mutex_unlock(&ctx->kdamond_lock);
+	return err;
+}
+
+/**
+ * damon_free_ops() - Free the objects left in changes of a context.
+ * @ops:	array of the changes
+ * @nr_ops:	number of entries in @ops
+ */
+void damon_free_ops(struct damon_op *ops, unsigned int nr_ops)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_ops; i++) {
+		if (ops[i].target)
+			damon_free_target(ops[i].target);
+		if (ops[i].region)
+			damon_free_region(ops[i].region);
+		if (ops[i].spare)
+			damon_free_region(ops[i].spare);
+		if (ops[i].scheme)
+			damon_free_scheme(ops[i].scheme);
+	}
+}
+
 /**
  * damon_nr_running_ctxs() - Return number of currently running contexts.
  */
@@ -418,12 +1256,74 @@ static unsigned long damon_region_sz_limit(struct damon_ctx *ctx)
 
 	if (ctx->min_nr_regions)
 		sz /= ctx->min_nr_regions;
-	if (sz < DAMON_MIN_REGION)
-		sz = DAMON_MIN_REGION;
+	if (sz < ctx->region_granularity)
+		sz = ctx->region_granularity;
 
 	return sz;
 }
 
+/*
+ * Align the boundaries of the regions of a target to a granularity
+ *
+ * t		the target of the regions
+ * granularity	the granularity to align the regions to
+ *
+ * Each region is expanded to the granularity, unless it overlaps with the
+ * previous region.  The regions are not expanded beyond the run of the
+ * adjacent regions that they belong to, though, as the gaps between the runs,
+ * e.g., the unmapped areas between the three regions of the virtual address
+ * spaces, are not for the monitoring.  Regions that become empty are removed.
+ */
+static void damon_align_regions_of(struct damon_target *t,
+		unsigned long granularity)
+{
+	struct damon_region *r, *next, *prev = NULL, *n;
+	unsigned long run_start = 0, run_end = 0;
+
+	damon_for_each_region_safe(r, next, t) {
+		/* Find the bounds of the run of adjacent regions */
+		if (r->ar.start >= run_end) {
+			run_start = r->ar.start;
+			run_end = r->ar.end;
+			for (n = r; !list_is_last(&n->list, &t->regions_list);) {
+				n = damon_next_region(n);
+				if (n->ar.start != run_end)
+					break;
+				run_end = n->ar.end;
+			}
+		}
+
+		r->ar.start = max(ALIGN_DOWN(r->ar.start, granularity),
+				run_start);
+		r->ar.end = min(ALIGN(r->ar.end, granularity), run_end);
+		if (prev && r->ar.start < prev->ar.end)
+			r->ar.start = prev->ar.end;
+		if (r->ar.start >= r->ar.end) {
+			damon_destroy_region(r, t);
+			continue;
+		}
+		prev = r;
+	}
+}
+
+/*
+ * Align the regions of every target to '->region_granularity'
+ *
+ * Regions are set by the primitives and the users, but the splits and merges
+ * of DAMON keep the alignment once it is made.  Hence this function is called
+ * only after the regions are set or updated.
+ */
+static void kdamond_align_regions(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	if (ctx->region_granularity <= DAMON_MIN_REGION)
+		return;
+
+	damon_for_each_target(t, ctx)
+		damon_align_regions_of(t, ctx->region_granularity);
+}
+
 static int kdamond_fn(void *data);
 
 /*
@@ -565,6 +1465,124 @@ static bool kdamond_aggregate_interval_passed(struct damon_ctx *ctx)
 			ctx->aggr_interval);
 }
 
+/*
+ * Update the index of a target with its current regions
+ */
+static void damon_update_region_index(struct damon_target *t)
+{
+	struct damon_region_index *index, *old;
+	struct damon_region *r;
+	unsigned int i = 0;
+
+	index = kmalloc(struct_size(index, regions, t->nr_regions),
+			GFP_KERNEL);
+	if (!index)
+		return;
+
+	damon_for_each_region(r, t) {
+		index->regions[i].ar = r->ar;
+		index->regions[i].nr_accesses = r->nr_accesses;
+		index->regions[i].age = r->age;
+		i++;
+	}
+	index->nr_regions = i;
+
+	/* Only kdamond updates the index */
+	old = rcu_replace_pointer(t->index, index, true);
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
+/*
+ * Update the index of every target for the point queries
+ */
+static void kdamond_update_region_index(struct damon_ctx *c)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, c)
+		damon_update_region_index(t);
+}
+
+static unsigned int damon_freq_bucket(unsigned int nr_accesses,
+		unsigned int max_nr_accesses)
+{
+	if (!nr_accesses)
+		return 0;
+	return min_t(unsigned int,
+			DIV_ROUND_UP(nr_accesses * 10, max_nr_accesses),
+			DAMON_NR_FREQ_BUCKETS - 1);
+}
+
+static unsigned int damon_age_bucket(unsigned int age)
+{
+	return min(fls(age), DAMON_NR_AGE_BUCKETS - 1);
+}
+
+static int damon_cmp_ulong(const void *a, const void *b)
+{
+	unsigned long l = *(const unsigned long *)a;
+	unsigned long r = *(const unsigned long *)b;
+
+	return l < r ? -1 : l > r;
+}
+
+/*
+ * Make the summary of a target for the last aggregation interval
+ *
+ * c			the monitoring context of the target
+ * t			the target to summarize
+ * max_nr_accesses	max possible '->nr_accesses' of the regions
+ */
+static void damon_summarize_target(struct damon_ctx *c,
+		struct damon_target *t, unsigned int max_nr_accesses)
+{
+	struct damon_target_summary *summary = &t->summary;
+	unsigned long sorted[DAMON_WSS_WINDOW];
+	unsigned long sz, wss = 0;
+	struct damon_region *r;
+	unsigned int i, nr;
+
+	memset(summary->sz_by_freq, 0, sizeof(summary->sz_by_freq));
+	memset(summary->sz_by_age, 0, sizeof(summary->sz_by_age));
+	damon_for_each_region(r, t) {
+		sz = r->ar.end - r->ar.start;
+		summary->sz_by_freq[damon_freq_bucket(r->nr_accesses,
+				max_nr_accesses)] += sz;
+		summary->sz_by_age[damon_age_bucket(r->age)] += sz;
+		if (r->nr_accesses)
+			wss += sz;
+	}
+	summary->wss = wss;
+
+	summary->wss_window[summary->nr_wss_samples++ % DAMON_WSS_WINDOW] =
+		wss;
+	nr = min_t(unsigned int, summary->nr_wss_samples, DAMON_WSS_WINDOW);
+	memcpy(sorted, summary->wss_window, nr * sizeof(*sorted));
+	sort(sorted, nr, sizeof(*sorted), damon_cmp_ulong, NULL);
+	for (i = 0; i < c->nr_wss_percentiles; i++)
+		summary->wss_percentiles[i] =
+			sorted[c->wss_percentiles[i] * (nr - 1) / 100];
+}
+
+/*
+ * Make the summary of every target for the last aggregation interval
+ */
+static void kdamond_summarize(struct damon_ctx *c)
+{
+	unsigned int max_nr_accesses = c->aggr_interval / c->sample_interval;
+	struct damon_target *t;
+
+	/* Readers of the summaries hold the lock */
+	mutex_lock(&c->kdamond_lock);
+	damon_for_each_target(t, c)
+		damon_summarize_target(c, t, max(max_nr_accesses, 1u));
+	mutex_unlock(&c->kdamond_lock);
+
+	damon_for_each_target(t, c)
+		trace_damon_summary(t);
+}
+
 /*
  * Reset the aggregated monitoring results ('nr_accesses' of each region).
  */
@@ -579,29 +1597,76 @@ static void kdamond_reset_aggregated(struct damon_ctx *c)
 			trace_damon_aggregated(t, r, damon_nr_regions(t));
 			r->last_nr_accesses = r->nr_accesses;
 			r->nr_accesses = 0;
+			r->nr_writes = 0;
+			r->sampled_nr_accesses = 0;
 		}
 	}
 }
 
+/*
+ * Update the moving average of the access frequency of a region
+ *
+ * r		the region to update
+ * max_hotness	'->hotness' of a region that accessed for every sampling
+ * shift	the weight shift of the new sample
+ */
+static void damon_update_region_hotness(struct damon_region *r,
+		unsigned int max_hotness, unsigned int shift)
+{
+	unsigned int sample = 0;
+
+	if (r->nr_accesses != r->sampled_nr_accesses) {
+		sample = max_hotness;
+		r->sampled_nr_accesses = r->nr_accesses;
+	}
+
+	if (sample > r->hotness)
+		r->hotness += (sample - r->hotness) >> shift;
+	else
+		r->hotness -= (r->hotness - sample) >> shift;
+}
+
+/*
+ * Update '->hotness' of every region with the result of the last sampling
+ */
+static void kdamond_update_hotness(struct damon_ctx *c)
+{
+	unsigned int max_hotness;
+	struct damon_target *t;
+	struct damon_region *r;
+
+	max_hotness = (c->aggr_interval / c->sample_interval) <<
+		DAMON_HOTNESS_FRAC_BITS;
+	damon_for_each_target(t, c) {
+		damon_for_each_region(r, t)
+			damon_update_region_hotness(r, max_hotness,
+					c->hotness_weight_shift);
+	}
+}
+
 static void damon_split_region_at(struct damon_ctx *ctx,
 		struct damon_target *t, struct damon_region *r,
 		unsigned long sz_r);
 
-static bool __damos_valid_target(struct damon_region *r, struct damos *s)
+static bool __damos_valid_target(struct damon_ctx *c, struct damon_region *r,
+		struct damos *s)
 {
+	unsigned int nr_accesses = damon_region_nr_accesses(c, r);
 	unsigned long sz;
 
 	sz = r->ar.end - r->ar.start;
 	return s->min_sz_region <= sz && sz <= s->max_sz_region &&
-		s->min_nr_accesses <= r->nr_accesses &&
-		r->nr_accesses <= s->max_nr_accesses &&
+		s->min_nr_accesses <= nr_accesses &&
+		nr_accesses <= s->max_nr_accesses &&
+		s->min_nr_writes <= r->nr_writes &&
+		r->nr_writes <= s->max_nr_writes &&
 		s->min_age_region <= r->age && r->age <= s->max_age_region;
 }
 
 static bool damos_valid_target(struct damon_ctx *c, struct damon_target *t,
 		struct damon_region *r, struct damos *s)
 {
-	bool ret = __damos_valid_target(r, s);
+	bool ret = __damos_valid_target(c, r, s);
 
 	if (!ret || !s->quota.esz || !c->primitive.get_scheme_score)
 		return ret;
@@ -609,6 +1674,106 @@ static bool damos_valid_target(struct damon_ctx *c, struct damon_target *t,
 	return c->primitive.get_scheme_score(c, t, r, s) >= s->quota.min_score;
 }
 
+static bool damos_has_target(struct damos *s, struct damon_target *t)
+{
+	unsigned int i;
+
+	if (!s->target_ids)
+		return true;
+
+	for (i = 0; i < s->nr_target_ids; i++) {
+		if (s->target_ids[i] == t->id)
+			return true;
+	}
+	return false;
+}
+
+/* Max number of the address ranges in &damos.batch */
+#define DAMOS_MAX_BATCH		64
+
+/**
+ * damon_pageout_age() - Get the age of the memory that DAMON is paging out.
+ *
+ * The block devices that store the swapped out pages, e.g., zram, can use this
+ * for knowing how long the pages that they are storing were not accessed.
+ *
+ * Return: the time in microseconds that the memory which the calling DAMON
+ * thread is applying &DAMOS_PAGEOUT to was not accessed, or zero if the caller
+ * is not a DAMON thread paging out memory.
+ */
+unsigned long damon_pageout_age(void)
+{
+	struct damon_ctx *ctx;
+
+	if (!(current->flags & PF_KTHREAD) ||
+			kthread_func(current) != kdamond_fn)
+		return 0;
+	ctx = kthread_data(current);
+	return ctx->pageout_age;
+}
+EXPORT_SYMBOL_GPL(damon_pageout_age);
+
+/* Time in microseconds that a region was not accessed */
+static unsigned long damon_region_idle_us(struct damon_ctx *c,
+		struct damon_region *r)
+{
+	return r->nr_accesses ? 0 : r->age * c->aggr_interval;
+}
+
+/* Apply the action of a scheme to the ranges in its batch */
+static void damos_flush_batch(struct damon_ctx *c, struct damon_target *t,
+		struct damos *s)
+{
+	struct timespec64 begin, end;
+
+	if (!s->nr_batch)
+		return;
+
+	if (s->action == DAMOS_PAGEOUT)
+		c->pageout_age = s->batch_age;
+	ktime_get_coarse_ts64(&begin);
+	c->primitive.apply_scheme_ranges(c, t, s, s->batch, s->nr_batch);
+	ktime_get_coarse_ts64(&end);
+	c->pageout_age = 0;
+	s->quota.total_charged_ns += timespec64_to_ns(&end) -
+		timespec64_to_ns(&begin);
+	s->nr_batch = 0;
+}
+
+/*
+ * Add an address range that was not accessed for @age microseconds to the
+ * batch of a scheme.  The age of the batch is that of its youngest range.
+ */
+static void damos_batch_range(struct damon_ctx *c, struct damon_target *t,
+		struct damos *s, struct damon_addr_range *ar, unsigned long age)
+{
+	struct damon_addr_range *last;
+
+	if (s->nr_batch) {
+		last = &s->batch[s->nr_batch - 1];
+		if (last->end == ar->start) {
+			last->end = ar->end;
+			s->batch_age = min(s->batch_age, age);
+			return;
+		}
+	}
+	if (s->nr_batch == DAMOS_MAX_BATCH)
+		damos_flush_batch(c, t, s);
+
+	if (!s->batch)
+		s->batch = kmalloc_array(DAMOS_MAX_BATCH, sizeof(*s->batch),
+				GFP_KERNEL);
+	if (!s->batch) {
+		if (s->action == DAMOS_PAGEOUT)
+			c->pageout_age = age;
+		c->primitive.apply_scheme_ranges(c, t, s, ar, 1);
+		c->pageout_age = 0;
+		return;
+	}
+	s->batch_age = s->nr_batch ? min(s->batch_age, age) : age;
+	s->batch[s->nr_batch++] = *ar;
+}
+
 static void damon_do_apply_schemes(struct damon_ctx *c,
 				   struct damon_target *t,
 				   struct damon_region *r)
@@ -620,7 +1785,7 @@ static void damon_do_apply_schemes(struct damon_ctx *c,
 		unsigned long sz = r->ar.end - r->ar.start;
 		struct timespec64 begin, end;
 
-		if (!s->wmarks.activated)
+		if (!s->wmarks.activated || !s->target_matched)
 			continue;
 
 		/* Check the quota */
@@ -643,12 +1808,13 @@ static void damon_do_apply_schemes(struct damon_ctx *c,
 			if (quota->charge_addr_from && r->ar.start <
 					quota->charge_addr_from) {
 				sz = ALIGN_DOWN(quota->charge_addr_from -
-						r->ar.start, DAMON_MIN_REGION);
+						r->ar.start,
+						c->region_granularity);
 				if (!sz) {
 					if (r->ar.end - r->ar.start <=
-							DAMON_MIN_REGION)
+							c->region_granularity)
 						continue;
-					sz = DAMON_MIN_REGION;
+					sz = c->region_granularity;
 				}
 				damon_split_region_at(c, t, r, sz);
 				r = damon_next_region(r);
@@ -662,11 +1828,12 @@ static void damon_do_apply_schemes(struct damon_ctx *c,
 			continue;
 
 		/* Apply the scheme */
-		if (c->primitive.apply_scheme) {
+		if (c->primitive.apply_scheme ||
+				c->primitive.apply_scheme_ranges) {
 			if (quota->esz &&
 					quota->charged_sz + sz > quota->esz) {
 				sz = ALIGN_DOWN(quota->esz - quota->charged_sz,
-						DAMON_MIN_REGION);
+						c->region_granularity);
 				if (!sz)
 					goto update_stat;
 				if (sz >= r->ar.end - r->ar.start) {
@@ -680,11 +1847,21 @@ static void damon_do_apply_schemes(struct damon_ctx *c,
 				}
 				damon_split_region_at(c, t, r, sz);
 			}
-			ktime_get_coarse_ts64(&begin);
-			c->primitive.apply_scheme(c, t, r, s);
-			ktime_get_coarse_ts64(&end);
-			quota->total_charged_ns += timespec64_to_ns(&end) -
-				timespec64_to_ns(&begin);
+			if (c->primitive.apply_scheme_ranges) {
+				damos_batch_range(c, t, s, &r->ar,
+						damon_region_idle_us(c, r));
+			} else {
+				if (s->action == DAMOS_PAGEOUT)
+					c->pageout_age =
+						damon_region_idle_us(c, r);
+				ktime_get_coarse_ts64(&begin);
+				c->primitive.apply_scheme(c, t, r, s);
+				ktime_get_coarse_ts64(&end);
+				c->pageout_age = 0;
+				quota->total_charged_ns +=
+					timespec64_to_ns(&end) -
+					timespec64_to_ns(&begin);
+			}
 			quota->charged_sz += sz;
 			if (quota->esz && quota->charged_sz >= quota->esz) {
 				quota->charge_target_from = t;
@@ -700,64 +1877,146 @@ static void damon_do_apply_schemes(struct damon_ctx *c,
 	}
 }
 
-/* Shouldn't be called if quota->ms and quota->sz are zero */
+/*
+ * Set the effective size quota for the next charge window
+ *
+ * The effective quota is the smaller one of the size quota and the size that
+ * could be applied within the time quota, which is estimated from the
+ * throughput so far.  It is further limited to the back off size that
+ * damos_update_refault_feedback() set from the refault ratio of the last charge
+ * window, if any.  The refaults for the ratio are counted for the node of the
+ * watermarks or the whole system, rather than for the regions that the scheme
+ * paged out, so the refaults of other memory also limit the quota.  The
+ * effective quota is zero, which means no limit, if none of those is set.
+ */
 static void damos_set_effective_quota(struct damos_quota *quota)
 {
 	unsigned long throughput;
 	unsigned long esz;
 
 	if (!quota->ms) {
-		quota->esz = quota->sz;
-		return;
-	}
+		esz = quota->sz;
+	} else {
+		if (quota->total_charged_ns)
+			throughput = quota->total_charged_sz * 1000000 /
+				quota->total_charged_ns;
+		else
+			throughput = PAGE_SIZE * 1024;
+		esz = throughput * quota->ms;
 
-	if (quota->total_charged_ns)
-		throughput = quota->total_charged_sz * 1000000 /
-			quota->total_charged_ns;
-	else
-		throughput = PAGE_SIZE * 1024;
-	esz = throughput * quota->ms;
+		if (quota->sz && quota->sz < esz)
+			esz = quota->sz;
+	}
 
-	if (quota->sz && quota->sz < esz)
-		esz = quota->sz;
+	if (quota->fsz && (!esz || quota->fsz < esz))
+		esz = quota->fsz;
 	quota->esz = esz;
 }
 
+/* Count the workingset refaults of the node of the watermarks or the system */
+static unsigned long damos_nr_refaults(struct damos *s)
+{
+	int nid = s->wmarks.nid;
+
+	if (s->wmarks.metric == DAMOS_WMARK_NODE_FREE_MEM_RATE &&
+			nid >= 0 && nid < nr_node_ids &&
+			node_state(nid, N_MEMORY))
+		return node_page_state(NODE_DATA(nid),
+				WORKINGSET_REFAULT_ANON) +
+			node_page_state(NODE_DATA(nid),
+					WORKINGSET_REFAULT_FILE);
+	return global_node_page_state(WORKINGSET_REFAULT_ANON) +
+		global_node_page_state(WORKINGSET_REFAULT_FILE);
+}
+
+/*
+ * Measure the refaults per thousand paged out pages in the charge window that
+ * just finished, and back off the size quota if the ratio is too high.
+ *
+ * The paged out pages are counted from stat_sz_applied, so those are the pages
+ * given to MADV_PAGEOUT rather than the pages really paged out, for the virtual
+ * address spaces.
+ */
+static void damos_update_refault_feedback(struct damos *s)
+{
+	struct damos_quota *quota = &s->quota;
+	unsigned long refaults = damos_nr_refaults(s);
+	unsigned long nr_refaults = refaults - quota->last_refaults;
+	unsigned long nr_paged_out = (s->stat_sz_applied -
+			quota->last_sz_applied) / PAGE_SIZE;
+	bool first_window = !quota->charged_from;
+
+	quota->last_refaults = refaults;
+	quota->last_sz_applied = s->stat_sz_applied;
+	if (first_window)
+		return;
+
+	quota->refault_permil = nr_paged_out ?
+		nr_refaults * 1000 / nr_paged_out : 0;
+	if (!quota->max_refault_permil) {
+		quota->fsz = 0;
+		return;
+	}
+
+	if (quota->refault_permil > quota->max_refault_permil) {
+		quota->fsz = max(min(quota->fsz ?: ULONG_MAX,
+					quota->charged_sz) / 2, PAGE_SIZE);
+	} else if (quota->fsz) {
+		/* Remove the back off once it is not limiting */
+		if (quota->charged_sz < quota->fsz)
+			quota->fsz = 0;
+		else
+			quota->fsz *= 2;
+	}
+}
+
 static void kdamond_apply_schemes(struct damon_ctx *c)
 {
 	struct damon_target *t;
 	struct damon_region *r, *next_r;
 	struct damos *s;
+	unsigned int nr_matched;
 
 	damon_for_each_scheme(s, c) {
 		struct damos_quota *quota = &s->quota;
 		unsigned long cumulated_sz;
 		unsigned int score, max_score = 0;
+		unsigned int i;
 
 		if (!s->wmarks.activated)
 			continue;
 
-		if (!quota->ms && !quota->sz)
+		if (!quota->ms && !quota->sz && !s->nr_memcgs &&
+				s->action != DAMOS_PAGEOUT)
 			continue;
 
 		/* New charge window starts */
 		if (time_after_eq(jiffies, quota->charged_from +
 					msecs_to_jiffies(
 						quota->reset_interval))) {
+			if (s->action == DAMOS_PAGEOUT)
+				damos_update_refault_feedback(s);
 			quota->total_charged_sz += quota->charged_sz;
 			quota->charged_from = jiffies;
 			quota->charged_sz = 0;
 			damos_set_effective_quota(quota);
+			for (i = 0; i < s->nr_memcgs; i++)
+				s->memcgs[i].charged_sz = 0;
 		}
 
+		if (!quota->esz)
+			continue;
+
 		if (!c->primitive.get_scheme_score)
 			continue;
 
 		/* Fill up the score histogram */
 		memset(quota->histogram, 0, sizeof(quota->histogram));
 		damon_for_each_target(t, c) {
+			if (!damos_has_target(s, t))
+				continue;
 			damon_for_each_region(r, t) {
-				if (!__damos_valid_target(r, s))
+				if (!__damos_valid_target(c, r, s))
 					continue;
 				score = c->primitive.get_scheme_score(
 						c, t, r, s);
@@ -778,8 +2037,21 @@ static void kdamond_apply_schemes(struct damon_ctx *c)
 	}
 
 	damon_for_each_target(t, c) {
+		nr_matched = 0;
+		damon_for_each_scheme(s, c) {
+			s->target_matched = damos_has_target(s, t);
+			if (s->target_matched && s->wmarks.activated)
+				nr_matched++;
+		}
+		if (!nr_matched)
+			continue;
+
 		damon_for_each_region_safe(r, next_r, t)
 			damon_do_apply_schemes(c, t, r);
+		if (!c->primitive.apply_scheme_ranges)
+			continue;
+		damon_for_each_scheme(s, c)
+			damos_flush_batch(c, t, s);
 	}
 }
 
@@ -795,6 +2067,11 @@ static void damon_merge_two_regions(struct damon_target *t,
 
 	l->nr_accesses = (l->nr_accesses * sz_l + r->nr_accesses * sz_r) /
 			(sz_l + sz_r);
+	l->nr_writes = (l->nr_writes * sz_l + r->nr_writes * sz_r) /
+			(sz_l + sz_r);
+	l->hotness = ((u64)l->hotness * sz_l + (u64)r->hotness * sz_r) /
+			(sz_l + sz_r);
+	l->sampled_nr_accesses = l->nr_accesses;
 	l->age = (l->age * sz_l + r->age * sz_r) / (sz_l + sz_r);
 	l->ar.end = r->ar.end;
 
@@ -821,13 +2098,13 @@ static void damon_merge_regions_of(struct damon_target *t, unsigned int thres,
 	struct damon_region *r, *prev = NULL, *next;
 
 	damon_for_each_region_safe(r, next, t) {
-		if (abs(r->nr_accesses - r->last_nr_accesses) > thres)
+		if (diff_of(r->nr_accesses, r->last_nr_accesses) > thres)
 			r->age = 0;
 		else
 			r->age++;
 
 		if (prev && prev->ar.end == r->ar.start &&
-		    abs(prev->nr_accesses - r->nr_accesses) <= thres &&
+		    diff_of(prev->nr_accesses, r->nr_accesses) <= thres &&
 		    sz_damon_region(prev) + sz_damon_region(r) <= sz_limit)
 			damon_merge_two_regions(t, prev, r);
 		else
@@ -879,37 +2156,140 @@ static void damon_split_region_at(struct damon_ctx *ctx,
 
 	r->ar.end = new->ar.start;
 
+	new->nr_accesses = r->nr_accesses;
+	new->nr_writes = r->nr_writes;
+	new->hotness = r->hotness;
+	new->sampled_nr_accesses = r->sampled_nr_accesses;
 	new->age = r->age;
 	new->last_nr_accesses = r->last_nr_accesses;
 
 	damon_insert_region(new, r, damon_next_region(r), t);
 }
 
+/* Split a region into 'nr_subs' regions of random sizes */
+static void damon_split_region_randomly(struct damon_ctx *ctx,
+		struct damon_target *t, struct damon_region *r, int nr_subs)
+{
+	unsigned long granularity = ctx->region_granularity;
+	unsigned long sz_region, sz_sub = 0;
+	int i;
+
+	sz_region = r->ar.end - r->ar.start;
+
+	for (i = 0; i < nr_subs - 1 &&
+			sz_region > 2 * granularity; i++) {
+		/*
+		 * Randomly select size of left sub-region to be at least
+		 * 10 percent and at most 90% of original region.  The split
+		 * point is aligned to the granularity even if the region
+		 * starts at an unaligned address, at the edge of the area.
+		 */
+		sz_sub = ALIGN_DOWN(r->ar.start + damon_rand(1, 10) *
+				sz_region / 10, granularity);
+		/* Do not allow blank region */
+		if (sz_sub <= r->ar.start)
+			continue;
+		sz_sub -= r->ar.start;
+		if (sz_sub >= sz_region)
+			continue;
+
+		damon_split_region_at(ctx, t, r, sz_sub);
+		sz_region = sz_sub;
+	}
+}
+
 /* Split every region in the given target into 'nr_subs' regions */
 static void damon_split_regions_of(struct damon_ctx *ctx,
 				     struct damon_target *t, int nr_subs)
 {
 	struct damon_region *r, *next;
-	unsigned long sz_region, sz_sub = 0;
-	int i;
 
-	damon_for_each_region_safe(r, next, t) {
-		sz_region = r->ar.end - r->ar.start;
-
-		for (i = 0; i < nr_subs - 1 &&
-				sz_region > 2 * DAMON_MIN_REGION; i++) {
-			/*
-			 * Randomly select size of left sub-region to be at
-			 * least 10 percent and at most 90% of original region
-			 */
-			sz_sub = ALIGN_DOWN(damon_rand(1, 10) *
-					sz_region / 10, DAMON_MIN_REGION);
-			/* Do not allow blank region */
-			if (sz_sub == 0 || sz_sub >= sz_region)
-				continue;
+	damon_for_each_region_safe(r, next, t)
+		damon_split_region_randomly(ctx, t, r, nr_subs);
+}
+
+/*
+ * Returns whether the access pattern of a region seems changing
+ *
+ * t		target of the region
+ * r		the region to check
+ * thres	'->last_nr_accesses' diff threshold for the adjacent regions
+ *
+ * A region is regarded as changing if its access frequency has significantly
+ * changed in the last aggregation interval, or if an adjacent region has
+ * significantly different access frequency, because the boundary of the
+ * different access patterns could be inside the region.
+ */
+static bool damon_region_changing(struct damon_target *t,
+		struct damon_region *r, unsigned int thres)
+{
+	struct damon_region *adj;
+
+	if (!r->age)
+		return true;
+
+	if (!list_is_first(&r->list, &t->regions_list)) {
+		adj = damon_prev_region(r);
+		if (adj->ar.end == r->ar.start &&
+				diff_of(adj->last_nr_accesses,
+					r->last_nr_accesses) > thres)
+			return true;
+	}
+	if (!list_is_last(&r->list, &t->regions_list)) {
+		adj = damon_next_region(r);
+		if (adj->ar.start == r->ar.end &&
+				diff_of(adj->last_nr_accesses,
+					r->last_nr_accesses) > thres)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Split the regions having changing access pattern
+ *
+ * thres	'->last_nr_accesses' diff threshold for the adjacent regions
+ * nr_regions	current total number of the regions
+ *
+ * This function splits only the regions that damon_region_changing() says
+ * true into two or three regions, as many as the room under
+ * '->max_nr_regions' allows.
+ */
+static void kdamond_split_changing_regions(struct damon_ctx *ctx,
+		unsigned int thres, unsigned int nr_regions)
+{
+	struct damon_target *t;
+	struct damon_region *r, *next;
+	unsigned int nr_changing = 0, room, nr_before;
+	int nr_subs;
+
+	if (nr_regions >= ctx->max_nr_regions)
+		return;
+	room = ctx->max_nr_regions - nr_regions;
+
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region(r, t)
+			nr_changing += damon_region_changing(t, r, thres);
+	}
+	if (!nr_changing)
+		return;
 
-			damon_split_region_at(ctx, t, r, sz_sub);
-			sz_region = sz_sub;
+	nr_subs = clamp(1 + room / nr_changing, 2u, 3u);
+
+	/*
+	 * Regions made by the split inherit '->last_nr_accesses' and '->age',
+	 * so splitting a region doesn't change the decisions for the others.
+	 */
+	damon_for_each_target(t, ctx) {
+		damon_for_each_region_safe(r, next, t) {
+			if (!room)
+				return;
+			if (!damon_region_changing(t, r, thres))
+				continue;
+			nr_before = t->nr_regions;
+			damon_split_region_randomly(ctx, t, r,
+					min_t(unsigned int, nr_subs, room + 1));
+			room -= min(t->nr_regions - nr_before, room);
 		}
 	}
 }
@@ -917,14 +2297,20 @@ static void damon_split_regions_of(struct damon_ctx *ctx,
 /*
  * Split every target region into randomly-sized small regions
  *
+ * threshold	'->nr_accesses' diff threshold that used for the merge
+ *
  * This function splits every target region into random-sized small regions if
  * current total number of the regions is equal or smaller than half of the
  * user-specified maximum number of regions.  This is for maximizing the
  * monitoring accuracy under the dynamically changeable access patterns.  If a
  * split was unnecessarily made, later 'kdamond_merge_regions()' will revert
  * it.
+ *
+ * If '->split_policy' of the context is DAMON_SPLIT_GRADIENT, only the regions
+ * having changing access pattern are split.
  */
-static void kdamond_split_regions(struct damon_ctx *ctx)
+static void kdamond_split_regions(struct damon_ctx *ctx,
+		unsigned int threshold)
 {
 	struct damon_target *t;
 	unsigned int nr_regions = 0;
@@ -934,6 +2320,11 @@ static void kdamond_split_regions(struct damon_ctx *ctx)
 	damon_for_each_target(t, ctx)
 		nr_regions += damon_nr_regions(t);
 
+	if (ctx->split_policy == DAMON_SPLIT_GRADIENT) {
+		kdamond_split_changing_regions(ctx, threshold, nr_regions);
+		return;
+	}
+
 	if (nr_regions > ctx->max_nr_regions / 2)
 		return;
 
@@ -948,6 +2339,181 @@ static void kdamond_split_regions(struct damon_ctx *ctx)
 	last_nr_regions = nr_regions;
 }
 
+/*
+ * Functions for the page granularity zooming of the hottest regions
+ */
+
+/*
+ * Find up to @nr hottest regions
+ *
+ * targets	array for storing the targets of the found regions
+ * regions	array for storing the found regions in descending hotness order
+ * nr		size of @targets and @regions
+ *
+ * Returns the number of found regions.
+ */
+static unsigned int damon_zoom_hottest(struct damon_ctx *c,
+		struct damon_target **targets, struct damon_region **regions,
+		unsigned int nr)
+{
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned int nr_found = 0, i;
+
+	damon_for_each_target(t, c) {
+		damon_for_each_region(r, t) {
+			/* Find the insertion point of this region */
+			for (i = nr_found; i > 0; i--) {
+				if (regions[i - 1]->nr_accesses >=
+						r->nr_accesses)
+					break;
+				if (i < nr) {
+					regions[i] = regions[i - 1];
+					targets[i] = targets[i - 1];
+				}
+			}
+			if (i >= nr)
+				continue;
+			regions[i] = r;
+			targets[i] = t;
+			if (nr_found < nr)
+				nr_found++;
+		}
+	}
+	return nr_found;
+}
+
+/**
+ * damon_in_zoom() - Check whether an address is in a zoomed in range.
+ * @ctx:	monitoring context
+ * @t:		monitoring target of the address
+ * @addr:	the address to check
+ *
+ * The accessed bits of the pages in the zoomed in ranges are used by the page
+ * granularity access checks.  The primitives should not clear those for the
+ * regular access checks of the regions, so use this for skipping the checks.
+ *
+ * Return: true if @addr of @t is in a zoomed in range, false otherwise.
+ */
+bool damon_in_zoom(struct damon_ctx *ctx, struct damon_target *t,
+		unsigned long addr)
+{
+	struct damon_zoom_range *zr;
+	unsigned int i;
+
+	for (i = 0; i < ctx->nr_zoom_ranges; i++) {
+		zr = &ctx->zoom_ranges[i];
+		if (zr->target == t && zr->ar.start <= addr &&
+				addr < zr->ar.end)
+			return true;
+	}
+	return false;
+}
+
+static void kdamond_zoom_out(struct damon_ctx *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->nr_zoom_ranges; i++)
+		kfree(c->zoom_ranges[i].accessed);
+	kfree(c->zoom_ranges);
+	c->zoom_ranges = NULL;
+	c->nr_zoom_ranges = 0;
+	c->zoom_aggrs_left = 0;
+}
+
+/* Start page granularity monitoring of the hottest regions */
+static void kdamond_zoom_in(struct damon_ctx *c)
+{
+	struct damon_target **targets;
+	struct damon_region **regions;
+	struct damon_zoom_range *zr;
+	unsigned long nr_pages;
+	unsigned int nr, i;
+
+	targets = kmalloc_array(c->zoom_nr_regions, sizeof(*targets),
+			GFP_KERNEL);
+	regions = kmalloc_array(c->zoom_nr_regions, sizeof(*regions),
+			GFP_KERNEL);
+	if (!targets || !regions)
+		goto out;
+
+	nr = damon_zoom_hottest(c, targets, regions, c->zoom_nr_regions);
+	c->zoom_ranges = kcalloc(nr, sizeof(*c->zoom_ranges), GFP_KERNEL);
+	if (!c->zoom_ranges)
+		goto out;
+
+	for (i = 0; i < nr; i++) {
+		/* Zoom in only the not-yet-accessed regions is meaningless */
+		if (!regions[i]->nr_accesses)
+			break;
+		zr = &c->zoom_ranges[c->nr_zoom_ranges];
+		zr->target = targets[i];
+		zr->ar = regions[i]->ar;
+		nr_pages = (zr->ar.end - zr->ar.start) / PAGE_SIZE;
+		if (nr_pages > DAMON_ZOOM_MAX_NR_PAGES) {
+			nr_pages = DAMON_ZOOM_MAX_NR_PAGES;
+			zr->ar.end = zr->ar.start + nr_pages * PAGE_SIZE;
+		}
+		if (!nr_pages)
+			continue;
+		zr->accessed = bitmap_zalloc(nr_pages, GFP_KERNEL);
+		if (!zr->accessed)
+			break;
+		c->primitive.prepare_page_access_checks(c, zr->target,
+				&zr->ar);
+		c->nr_zoom_ranges++;
+	}
+	c->zoom_aggrs_left = c->zoom_nr_aggrs;
+
+out:
+	kfree(targets);
+	kfree(regions);
+}
+
+/*
+ * Check page granularity accesses to the zoomed in ranges, and then select
+ * new ranges if the zooming for current ranges is done.
+ */
+static void kdamond_zoom(struct damon_ctx *c)
+{
+	struct damon_zoom_range *zr;
+	unsigned long nr_pages, start;
+	unsigned int i, nr;
+
+	if (!c->zoom_ranges) {
+		kdamond_zoom_in(c);
+		return;
+	}
+
+	for (i = 0; i < c->nr_zoom_ranges; i++) {
+		zr = &c->zoom_ranges[i];
+		nr_pages = (zr->ar.end - zr->ar.start) / PAGE_SIZE;
+		bitmap_zero(zr->accessed, nr_pages);
+		c->primitive.check_page_accesses(c, zr->target, &zr->ar,
+				zr->accessed);
+
+		/* Keep each event small enough to fit in the trace buffer */
+		for (start = 0; start < nr_pages; start += 1024) {
+			nr = min(nr_pages - start, 1024UL);
+			trace_damon_zoom(zr->target,
+					zr->ar.start + start * PAGE_SIZE, nr,
+					zr->accessed + start / BITS_PER_LONG);
+		}
+	}
+
+	if (--c->zoom_aggrs_left) {
+		for (i = 0; i < c->nr_zoom_ranges; i++) {
+			zr = &c->zoom_ranges[i];
+			c->primitive.prepare_page_access_checks(c,
+					zr->target, &zr->ar);
+		}
+		return;
+	}
+	kdamond_zoom_out(c);
+	kdamond_zoom_in(c);
+}
+
 /*
  * Check whether it is time to check and apply the target monitoring regions
  *
@@ -988,14 +2554,24 @@ static bool kdamond_need_stop(struct damon_ctx *ctx)
 	return true;
 }
 
-static unsigned long damos_wmark_metric_value(enum damos_wmark_metric metric)
+static unsigned long damos_wmark_metric_value(struct damos_watermarks *wmarks)
 {
 	struct sysinfo i;
 
-	switch (metric) {
+	switch (wmarks->metric) {
 	case DAMOS_WMARK_FREE_MEM_RATE:
 		si_meminfo(&i);
 		return i.freeram * 1000 / i.totalram;
+	case DAMOS_WMARK_NODE_FREE_MEM_RATE:
+		if (wmarks->nid < 0 || wmarks->nid >= nr_node_ids ||
+				!node_state(wmarks->nid, N_MEMORY))
+			break;
+#ifdef CONFIG_NUMA
+		si_meminfo_node(&i, wmarks->nid);
+#else
+		si_meminfo(&i);
+#endif
+		return i.freeram * 1000 / i.totalram;
 	default:
 		break;
 	}
@@ -1013,7 +2589,7 @@ static unsigned long damos_wmark_wait_us(struct damos *scheme)
 	if (scheme->wmarks.metric == DAMOS_WMARK_NONE)
 		return 0;
 
-	metric = damos_wmark_metric_value(scheme->wmarks.metric);
+	metric = damos_wmark_metric_value(&scheme->wmarks);
 	/* higher than high watermark or lower than low watermark */
 	if (metric > scheme->wmarks.high || scheme->wmarks.low > metric) {
 		if (scheme->wmarks.activated)
@@ -1044,7 +2620,10 @@ static void kdamond_usleep(unsigned long usecs)
 		usleep_range(usecs, usecs + 1);
 }
 
-/* Returns negative error code if it's not activated but should return */
+/*
+ * Returns negative error code if it's not activated but should return, e.g.,
+ * to stop or to apply the changes that committed via damon_commit_ops()
+ */
 static int kdamond_wait_activation(struct damon_ctx *ctx)
 {
 	struct damos *s;
@@ -1052,6 +2631,8 @@ static int kdamond_wait_activation(struct damon_ctx *ctx)
 	unsigned long min_wait_time = 0;
 
 	while (!kdamond_need_stop(ctx)) {
+		if (READ_ONCE(ctx->commit))
+			return -EAGAIN;
 		damon_for_each_scheme(s, ctx) {
 			wait_time = damos_wmark_wait_us(s);
 			if (!min_wait_time || wait_time < min_wait_time)
@@ -1065,6 +2646,180 @@ static int kdamond_wait_activation(struct damon_ctx *ctx)
 	return -EBUSY;
 }
 
+/*
+ * Functions for the accounting of the CPU time of the monitoring thread
+ */
+
+/* Returns the CPU time that the kdamond has spent so far */
+static u64 kdamond_cpu_ns(void)
+{
+	return task_sched_runtime(current);
+}
+
+/* Account the CPU time spent for a phase that started at 'begin' */
+static void kdamond_account_phase(struct damon_ctx *ctx,
+		enum damon_phase phase, u64 begin)
+{
+	struct damon_phase_stat *stat = &ctx->phase_stats[phase];
+	u64 ns = kdamond_cpu_ns() - begin;
+
+	WRITE_ONCE(stat->last_ns, ns);
+	WRITE_ONCE(stat->total_ns, stat->total_ns + ns);
+}
+
+/* Max times of the user-set sampling interval for the CPU budget */
+#define DAMON_BUDGET_MAX_STRETCH	64
+
+/*
+ * Merge adjacent regions until the number of the regions becomes no more than
+ * '->max_nr_regions'
+ *
+ * The threshold of the access frequency difference for the merge starts from
+ * zero and doubles up to the max possible access frequency until the limit is
+ * met.  This is called after the
+ * aggregated results are reset, so '->last_nr_accesses' is compared.
+ */
+static void kdamond_merge_regions_to_limit(struct damon_ctx *c)
+{
+	unsigned int thres = 0, max_thres = c->aggr_interval /
+		(c->sample_interval ? c->sample_interval : 1);
+	struct damon_region *r, *prev, *next;
+	struct damon_target *t;
+	unsigned long sz_l, sz_r, nr_regions;
+	unsigned int last_nr_accesses;
+
+	for (;;) {
+		nr_regions = 0;
+		damon_for_each_target(t, c)
+			nr_regions += damon_nr_regions(t);
+		if (nr_regions <= c->max_nr_regions)
+			return;
+
+		damon_for_each_target(t, c) {
+			prev = NULL;
+			damon_for_each_region_safe(r, next, t) {
+				if (!prev || prev->ar.end != r->ar.start ||
+						diff_of(prev->last_nr_accesses,
+							r->last_nr_accesses) >
+						thres) {
+					prev = r;
+					continue;
+				}
+				sz_l = sz_damon_region(prev);
+				sz_r = sz_damon_region(r);
+				last_nr_accesses = (prev->last_nr_accesses *
+						sz_l + r->last_nr_accesses *
+						sz_r) / (sz_l + sz_r);
+				damon_merge_two_regions(t, prev, r);
+				prev->last_nr_accesses = last_nr_accesses;
+			}
+		}
+		if (thres >= max_thres)
+			return;
+		thres = min(thres ? thres * 2 : 1, max_thres);
+	}
+}
+
+/* Reduce the monitoring overhead for the CPU budget */
+static void kdamond_tighten_budget(struct damon_ctx *ctx)
+{
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET &&
+			ctx->max_nr_regions / 2 >= ctx->min_nr_regions) {
+		ctx->max_nr_regions /= 2;
+		/* The splits stop at the limit, but the merges don't start */
+		kdamond_merge_regions_to_limit(ctx);
+	} else if (ctx->sample_interval < ctx->orig_sample_interval *
+			DAMON_BUDGET_MAX_STRETCH) {
+		ctx->sample_interval *= 2;
+		ctx->aggr_interval *= 2;
+	}
+}
+
+/* Revert the latest change for the CPU budget */
+static void kdamond_relax_budget(struct damon_ctx *ctx)
+{
+	if (ctx->sample_interval > ctx->orig_sample_interval) {
+		ctx->sample_interval /= 2;
+		ctx->aggr_interval /= 2;
+	} else if (ctx->target_type != DAMON_ARBITRARY_TARGET &&
+			ctx->max_nr_regions < ctx->orig_max_nr_regions) {
+		ctx->max_nr_regions = min(ctx->max_nr_regions * 2,
+				ctx->orig_max_nr_regions);
+	}
+}
+
+/*
+ * Update the CPU utilization of the kdamond and apply the CPU budget
+ *
+ * This function is called after each aggregation interval.
+ */
+static void kdamond_check_cpu_budget(struct damon_ctx *ctx)
+{
+	u64 cpu_ns = kdamond_cpu_ns(), now = ktime_get_ns();
+
+	if (now > ctx->budget_last_ns)
+		WRITE_ONCE(ctx->cpu_util, div64_u64(
+				(cpu_ns - ctx->budget_last_cpu_ns) * 1000,
+				now - ctx->budget_last_ns));
+	ctx->budget_last_cpu_ns = cpu_ns;
+	ctx->budget_last_ns = now;
+
+	if (!ctx->cpu_budget)
+		return;
+
+	if (ctx->cpu_util > ctx->cpu_budget) {
+		ctx->nr_budget_exceeds++;
+		pr_info_ratelimited("kdamond (%d) exceeds cpu budget (%u > %u)\n",
+				current->pid, ctx->cpu_util, ctx->cpu_budget);
+		kdamond_tighten_budget(ctx);
+	} else if (ctx->cpu_util < ctx->cpu_budget / 2) {
+		kdamond_relax_budget(ctx);
+	}
+}
+
+/* Save the user-set attributes that the CPU budget could change */
+static void kdamond_init_cpu_budget(struct damon_ctx *ctx)
+{
+	ctx->orig_sample_interval = ctx->sample_interval;
+	ctx->orig_aggr_interval = ctx->aggr_interval;
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+		ctx->orig_max_nr_regions = ctx->max_nr_regions;
+	ctx->budget_last_cpu_ns = kdamond_cpu_ns();
+	ctx->budget_last_ns = ktime_get_ns();
+}
+
+/* Restore the user-set attributes that the CPU budget could change */
+static void kdamond_restore_cpu_budget(struct damon_ctx *ctx)
+{
+	ctx->sample_interval = ctx->orig_sample_interval;
+	ctx->aggr_interval = ctx->orig_aggr_interval;
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+		ctx->max_nr_regions = ctx->orig_max_nr_regions;
+}
+
+/*
+ * Apply the changes that committed via damon_commit_ops() while the kdamond is
+ * running
+ *
+ * The zoomed in ranges are dropped, as those could point to removed targets.
+ */
+static void kdamond_commit(struct damon_ctx *ctx)
+{
+	struct damon_commit *commit;
+
+	mutex_lock(&ctx->kdamond_lock);
+	commit = ctx->commit;
+	ctx->commit = NULL;
+	commit->err = damon_check_ops(ctx, commit->ops, commit->nr_ops);
+	if (!commit->err) {
+		kdamond_zoom_out(ctx);
+		damon_apply_ops(ctx, commit->ops, commit->nr_ops);
+		kdamond_align_regions(ctx);
+	}
+	complete(&commit->done);
+	mutex_unlock(&ctx->kdamond_lock);
+}
+
 /*
  * The monitoring daemon that runs as a kernel thread
  */
@@ -1076,6 +2831,7 @@ static int kdamond_fn(void *data)
 	unsigned int max_nr_accesses = 0;
 	unsigned long sz_limit = 0;
 	bool done = false;
+	u64 begin;
 
 	pr_debug("kdamond (%d) starts\n", current->pid);
 
@@ -1084,47 +2840,93 @@ static int kdamond_fn(void *data)
 	if (ctx->callback.before_start && ctx->callback.before_start(ctx))
 		done = true;
 
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+		kdamond_align_regions(ctx);
 	sz_limit = damon_region_sz_limit(ctx);
 
+	kdamond_init_cpu_budget(ctx);
 	while (!kdamond_need_stop(ctx) && !done) {
+		if (READ_ONCE(ctx->commit)) {
+			kdamond_commit(ctx);
+			sz_limit = damon_region_sz_limit(ctx);
+		}
 		if (kdamond_wait_activation(ctx))
 			continue;
 
+		begin = kdamond_cpu_ns();
 		if (ctx->primitive.prepare_access_checks)
 			ctx->primitive.prepare_access_checks(ctx);
+		kdamond_account_phase(ctx, DAMON_PHASE_PREPARE_ACCESS_CHECKS,
+				begin);
 		if (ctx->callback.after_sampling &&
 				ctx->callback.after_sampling(ctx))
 			done = true;
 
 		usleep_range(ctx->sample_interval, ctx->sample_interval + 1);
 
+		begin = kdamond_cpu_ns();
 		if (ctx->primitive.check_accesses)
 			max_nr_accesses = ctx->primitive.check_accesses(ctx);
+		if (ctx->target_type != DAMON_ARBITRARY_TARGET &&
+				ctx->hotness_weight_shift)
+			kdamond_update_hotness(ctx);
+		kdamond_account_phase(ctx, DAMON_PHASE_CHECK_ACCESSES, begin);
 
 		if (kdamond_aggregate_interval_passed(ctx)) {
-			if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+			if (ctx->target_type != DAMON_ARBITRARY_TARGET) {
+				begin = kdamond_cpu_ns();
 				kdamond_merge_regions(ctx,
 						max_nr_accesses / 10,
 						sz_limit);
+				if (ctx->zoom_nr_regions)
+					kdamond_zoom(ctx);
+				kdamond_account_phase(ctx, DAMON_PHASE_MERGE,
+						begin);
+			}
 			if (ctx->callback.after_aggregation &&
 					ctx->callback.after_aggregation(ctx))
 				done = true;
 			if (ctx->target_type != DAMON_ARBITRARY_TARGET) {
+				begin = kdamond_cpu_ns();
 				kdamond_apply_schemes(ctx);
+				kdamond_account_phase(ctx, DAMON_PHASE_SCHEMES,
+						begin);
+
+				begin = kdamond_cpu_ns();
+				if (ctx->index_regions)
+					kdamond_update_region_index(ctx);
+				if (ctx->summarize)
+					kdamond_summarize(ctx);
+				if (ctx->ring.hdr)
+					kdamond_write_ring(ctx);
 				kdamond_reset_aggregated(ctx);
-				kdamond_split_regions(ctx);
+				kdamond_account_phase(ctx, DAMON_PHASE_REPORT,
+						begin);
+
+				begin = kdamond_cpu_ns();
+				kdamond_split_regions(ctx,
+						max_nr_accesses / 10);
+				kdamond_account_phase(ctx, DAMON_PHASE_SPLIT,
+						begin);
 			}
 			if (ctx->primitive.reset_aggregated)
 				ctx->primitive.reset_aggregated(ctx);
+			kdamond_check_cpu_budget(ctx);
 		}
 
 		if (kdamond_need_update_primitive(ctx)) {
+			begin = kdamond_cpu_ns();
 			if (ctx->primitive.update)
 				ctx->primitive.update(ctx);
+			if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+				kdamond_align_regions(ctx);
 			sz_limit = damon_region_sz_limit(ctx);
+			kdamond_account_phase(ctx, DAMON_PHASE_UPDATE, begin);
 		}
 	}
+	kdamond_restore_cpu_budget(ctx);
 	if (ctx->target_type != DAMON_ARBITRARY_TARGET) {
+		kdamond_zoom_out(ctx);
 		damon_for_each_target(t, ctx) {
 			damon_for_each_region_safe(r, next, t)
 				damon_destroy_region(r, t);
@@ -1139,6 +2941,11 @@ static int kdamond_fn(void *data)
 	pr_debug("kdamond (%d) finishes\n", current->pid);
 	mutex_lock(&ctx->kdamond_lock);
 	ctx->kdamond = NULL;
+	if (ctx->commit) {
+		ctx->commit->err = -ESRCH;
+		complete(&ctx->commit->done);
+		ctx->commit = NULL;
+	}
 	mutex_unlock(&ctx->kdamond_lock);
 
 	mutex_lock(&damon_lock);
@@ -1149,3 +2956,4 @@ static int kdamond_fn(void *data)
 }
 
 #include "core-test.h"
+#include "core-bench.h"
@@ -7,13 +7,16 @@
 
 #define pr_fmt(fmt) "damon-dbgfs: " fmt
 
+#include <linux/ctype.h>
 #include <linux/damon.h>
 #include <linux/debugfs.h>
 #include <linux/file.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/page_idle.h>
+#include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/uaccess.h>
 
 static struct damon_ctx **dbgfs_ctxs;
 static int dbgfs_nr_ctxs;
@@ -105,7 +108,7 @@ static ssize_t sprint_schemes(struct damon_ctx *c, char *buf, ssize_t len)
 
 	damon_for_each_scheme(s, c) {
 		rc = scnprintf(&buf[written], len - written,
-				"%lu %lu %u %u %u %u %d %lu %lu %lu %u %u %u %d %lu %lu %lu %lu %lu %lu\n",
+				"%lu %lu %u %u %u %u %d %lu %lu %lu %u %u %u %d %lu %lu %lu %lu %lu %lu %lu %lu %lu %u %u\n",
 				s->min_sz_region, s->max_sz_region,
 				s->min_nr_accesses, s->max_nr_accesses,
 				s->min_age_region, s->max_age_region,
@@ -117,7 +120,10 @@ static ssize_t sprint_schemes(struct damon_ctx *c, char *buf, ssize_t len)
 				s->quota.weight_age,
 				s->wmarks.metric, s->wmarks.interval,
 				s->wmarks.high, s->wmarks.mid, s->wmarks.low,
-				s->stat_count, s->stat_sz);
+				s->stat_count, s->stat_sz,
+				s->stat_sz_applied, s->stat_nr_failed,
+				s->quota.refault_permil,
+				s->min_nr_writes, s->max_nr_writes);
 		if (!rc)
 			return -ENOMEM;
 
@@ -167,6 +173,8 @@ static bool damos_action_valid(int action)
 	case DAMOS_HUGEPAGE:
 	case DAMOS_NOHUGEPAGE:
 	case DAMOS_STAT:
+	case DAMOS_MERGEABLE:
+	case DAMOS_UNMERGEABLE:
 		return true;
 	default:
 		return false;
@@ -176,6 +184,10 @@ static bool damos_action_valid(int action)
 /*
  * Converts a string into an array of struct damos pointers
  *
+ * Each line describes one scheme.  The minimum and maximum write frequencies
+ * of the target regions can optionally follow the watermarks of each line.  If
+ * those are omitted, the write frequency of the regions is ignored.
+ *
  * Returns an array of struct damos pointers that converted if the conversion
  * success, or NULL otherwise.
  */
@@ -187,6 +199,7 @@ static struct damos **str_to_schemes(const char *str, ssize_t len,
 	int pos = 0, parsed, ret;
 	unsigned long min_sz, max_sz;
 	unsigned int min_nr_a, max_nr_a, min_age, max_age;
+	unsigned int min_nr_w, max_nr_w;
 	unsigned int action;
 
 	schemes = kmalloc_array(max_nr_schemes, sizeof(scheme),
@@ -197,7 +210,7 @@ static struct damos **str_to_schemes(const char *str, ssize_t len,
 	*nr_schemes = 0;
 	while (pos < len && *nr_schemes < max_nr_schemes) {
 		struct damos_quota quota = {};
-		struct damos_watermarks wmarks;
+		struct damos_watermarks wmarks = {};
 
 		ret = sscanf(&str[pos],
 				"%lu %lu %u %u %u %u %u %lu %lu %lu %u %u %u %u %lu %lu %lu %lu%n",
@@ -216,10 +229,24 @@ static struct damos **str_to_schemes(const char *str, ssize_t len,
 		}
 
 		pos += parsed;
+
+		min_nr_w = 0;
+		max_nr_w = UINT_MAX;
+		while (str[pos] == ' ' || str[pos] == '\t')
+			pos++;
+		if (isdigit(str[pos])) {
+			if (sscanf(&str[pos], "%u %u%n", &min_nr_w, &max_nr_w,
+						&parsed) != 2)
+				goto fail;
+			pos += parsed;
+		}
+
 		scheme = damon_new_scheme(min_sz, max_sz, min_nr_a, max_nr_a,
 				min_age, max_age, action, &quota, &wmarks);
 		if (!scheme)
 			goto fail;
+		scheme->min_nr_writes = min_nr_w;
+		scheme->max_nr_writes = max_nr_w;
 
 		schemes[*nr_schemes] = scheme;
 		*nr_schemes += 1;
@@ -351,6 +378,21 @@ static void dbgfs_put_pids(unsigned long *ids, int nr_ids)
 		put_pid((struct pid *)ids[i]);
 }
 
+/*
+ * Make the schemes to be applied to every target again
+ *
+ * Removing a target makes the schemes that applied to only it to be applied to
+ * no target.  When all targets are removed for replacing those, reset the
+ * targets of the schemes instead, as the old target ids mean nothing.
+ */
+static void dbgfs_reset_scheme_targets(struct damon_ctx *ctx)
+{
+	struct damos *s;
+
+	damon_for_each_scheme(s, ctx)
+		damon_set_scheme_targets(s, NULL, 0);
+}
+
 static ssize_t dbgfs_target_ids_write(struct file *file,
 		const char __user *buf, size_t count, loff_t *ppos)
 {
@@ -401,12 +443,16 @@ static ssize_t dbgfs_target_ids_write(struct file *file,
 
 	/* remove targets with previously-set primitive */
 	damon_set_targets(ctx, NULL, 0);
+	dbgfs_reset_scheme_targets(ctx);
 
-	/* Configure the context for the address space type */
-	if (id_is_pid)
-		damon_va_set_primitives(ctx);
-	else
+	/*
+	 * Configure the context for the address space type.  Keep the virtual
+	 * address access check primitives that selected via 'access_check'.
+	 */
+	if (!id_is_pid)
 		damon_pa_set_primitives(ctx);
+	else if (!targetid_is_pid(ctx))
+		damon_va_set_primitives(ctx);
 
 	ret = damon_set_targets(ctx, targets, nr_targets);
 	if (ret) {
@@ -571,6 +617,176 @@ static ssize_t dbgfs_init_regions_write(struct file *file,
 	return ret;
 }
 
+/* Returns the id of a target that shown to the users */
+static unsigned long dbgfs_target_id(struct damon_ctx *ctx,
+		struct damon_target *t)
+{
+	if (targetid_is_pid(ctx))
+		return (unsigned long)pid_vnr((struct pid *)t->id);
+	return t->id;
+}
+
+/*
+ * Print pairs of a scheme index and a target id
+ *
+ * Schemes that applied to every target have no pair.  Schemes that applied to
+ * no target because their targets are removed have a pair of the index and
+ * 'none'.
+ */
+static ssize_t sprint_scheme_targets(struct damon_ctx *c, char *buf,
+		ssize_t len)
+{
+	struct damon_target *t;
+	struct damos *s;
+	unsigned int i, idx = 0;
+	int written = 0;
+	int rc;
+
+	damon_for_each_scheme(s, c) {
+		/* Applied to no target, as its targets are removed */
+		if (s->target_ids && !s->nr_target_ids) {
+			rc = scnprintf(&buf[written], len - written,
+					"%u none\n", idx);
+			if (!rc)
+				return -ENOMEM;
+			written += rc;
+		}
+		for (i = 0; i < s->nr_target_ids; i++) {
+			/* Show only the targets in the context */
+			damon_for_each_target(t, c) {
+				if (t->id != s->target_ids[i])
+					continue;
+				rc = scnprintf(&buf[written], len - written,
+						"%u %lu\n", idx,
+						dbgfs_target_id(c, t));
+				if (!rc)
+					return -ENOMEM;
+				written += rc;
+			}
+		}
+		idx++;
+	}
+	return written;
+}
+
+static ssize_t dbgfs_scheme_targets_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char *kbuf;
+	ssize_t len;
+
+	kbuf = kmalloc(count, GFP_KERNEL | __GFP_NOWARN);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&ctx->kdamond_lock);
+	len = sprint_scheme_targets(ctx, kbuf, count);
+	mutex_unlock(&ctx->kdamond_lock);
+	if (len < 0)
+		goto out;
+	len = simple_read_from_buffer(buf, count, ppos, kbuf, len);
+
+out:
+	kfree(kbuf);
+	return len;
+}
+
+/* Max number of the targets that each scheme can be applied to */
+#define DBGFS_MAX_SCHEME_TARGETS	32
+
+/*
+ * Set the targets of the schemes from pairs of a scheme index and a target id
+ *
+ * Schemes having no pair are applied to every target.
+ */
+static int set_scheme_targets(struct damon_ctx *c, const char *str,
+		ssize_t len)
+{
+	struct damon_target *t;
+	struct damos *s;
+	unsigned long *ids;
+	unsigned long scheme_idx, target_id;
+	unsigned int nr_schemes = 0, nr_ids, idx = 0;
+	int pos, parsed, err = 0;
+
+	damon_for_each_scheme(s, c)
+		nr_schemes++;
+
+	ids = kmalloc_array(DBGFS_MAX_SCHEME_TARGETS, sizeof(*ids),
+			GFP_KERNEL);
+	if (!ids)
+		return -ENOMEM;
+
+	damon_for_each_scheme(s, c) {
+		nr_ids = 0;
+		for (pos = 0; pos < len; pos += parsed) {
+			if (sscanf(&str[pos], "%lu %lu%n", &scheme_idx,
+						&target_id, &parsed) != 2)
+				break;
+			if (scheme_idx >= nr_schemes) {
+				err = -EINVAL;
+				goto out;
+			}
+			if (scheme_idx != idx)
+				continue;
+
+			err = -EINVAL;
+			damon_for_each_target(t, c) {
+				if (dbgfs_target_id(c, t) == target_id) {
+					err = 0;
+					break;
+				}
+			}
+			if (err || nr_ids == DBGFS_MAX_SCHEME_TARGETS) {
+				err = -EINVAL;
+				goto out;
+			}
+			ids[nr_ids++] = t->id;
+		}
+		err = damon_set_scheme_targets(s, ids, nr_ids);
+		if (err)
+			goto out;
+		idx++;
+	}
+
+out:
+	if (err) {
+		damon_for_each_scheme(s, c)
+			damon_set_scheme_targets(s, NULL, 0);
+	}
+	kfree(ids);
+	return err;
+}
+
+static ssize_t dbgfs_scheme_targets_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char *kbuf;
+	ssize_t ret = count;
+	int err;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	err = set_scheme_targets(ctx, kbuf, ret);
+	if (err)
+		ret = err;
+
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+	kfree(kbuf);
+	return ret;
+}
+
 static ssize_t dbgfs_kdamond_pid_read(struct file *file,
 		char __user *buf, size_t count, loff_t *ppos)
 {
@@ -597,65 +813,982 @@ static ssize_t dbgfs_kdamond_pid_read(struct file *file,
 	return len;
 }
 
-static int damon_dbgfs_open(struct inode *inode, struct file *file)
+enum dbgfs_access_check {
+	DBGFS_CHECK_ACCESSED,
+	DBGFS_CHECK_WRITE,
+	DBGFS_CHECK_PAGE_FAULT,
+};
+
+static const char * const access_check_strs[] = {
+	[DBGFS_CHECK_ACCESSED] = "accessed",
+	[DBGFS_CHECK_WRITE] = "write",
+	[DBGFS_CHECK_PAGE_FAULT] = "page_fault",
+};
+
+static enum dbgfs_access_check dbgfs_access_check(struct damon_ctx *ctx)
 {
-	file->private_data = inode->i_private;
+	if (damon_va_checks_writes(ctx))
+		return DBGFS_CHECK_WRITE;
+	if (damon_va_checks_faults(ctx))
+		return DBGFS_CHECK_PAGE_FAULT;
+	return DBGFS_CHECK_ACCESSED;
+}
 
-	return nonseekable_open(inode, file);
+static ssize_t dbgfs_access_check_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[16];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%s\n",
+			access_check_strs[dbgfs_access_check(ctx)]);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
 }
 
-static const struct file_operations attrs_fops = {
-	.open = damon_dbgfs_open,
-	.read = dbgfs_attrs_read,
-	.write = dbgfs_attrs_write,
-};
+/*
+ * Select the primitives for checking the accesses to the virtual address
+ * spaces.  'write' makes the regions to count the writes in '->nr_writes',
+ * which can be used by the write frequency bounds of the schemes.
+ * 'page_fault' uses the page faults instead of the accessed bits, and is
+ * supported only if CONFIG_DAMON_VADDR_PF is set.  Only the contexts
+ * monitoring the virtual address spaces support this.
+ */
+static ssize_t dbgfs_access_check_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char *kbuf;
+	ssize_t ret;
+	int check;
 
-static const struct file_operations schemes_fops = {
-	.open = damon_dbgfs_open,
-	.read = dbgfs_schemes_read,
-	.write = dbgfs_schemes_write,
-};
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
 
-static const struct file_operations target_ids_fops = {
-	.open = damon_dbgfs_open,
-	.read = dbgfs_target_ids_read,
-	.write = dbgfs_target_ids_write,
-};
+	check = sysfs_match_string(access_check_strs, kbuf);
+	if (check < 0) {
+		ret = check;
+		goto out;
+	}
 
-static const struct file_operations init_regions_fops = {
-	.open = damon_dbgfs_open,
-	.read = dbgfs_init_regions_read,
-	.write = dbgfs_init_regions_write,
-};
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+	if (!targetid_is_pid(ctx)) {
+		ret = -EINVAL;
+		goto unlock_out;
+	}
 
-static const struct file_operations kdamond_pid_fops = {
-	.open = damon_dbgfs_open,
-	.read = dbgfs_kdamond_pid_read,
+	switch (check) {
+	case DBGFS_CHECK_ACCESSED:
+		damon_va_set_primitives(ctx);
+		break;
+	case DBGFS_CHECK_WRITE:
+		damon_va_set_wr_primitives(ctx);
+		break;
+	case DBGFS_CHECK_PAGE_FAULT:
+#ifdef CONFIG_DAMON_VADDR_PF
+		damon_va_set_pf_primitives(ctx);
+		break;
+#else
+		ret = -EOPNOTSUPP;
+		goto unlock_out;
+#endif
+	}
+	ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static const char * const split_policy_strs[] = {
+	[DAMON_SPLIT_RANDOM] = "random",
+	[DAMON_SPLIT_GRADIENT] = "gradient",
 };
 
-static void dbgfs_fill_ctx_dir(struct dentry *dir, struct damon_ctx *ctx)
+static ssize_t dbgfs_split_policy_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
 {
-	const char * const file_names[] = {"attrs", "schemes", "target_ids",
-		"init_regions", "kdamond_pid"};
-	const struct file_operations *fops[] = {&attrs_fops, &schemes_fops,
-		&target_ids_fops, &init_regions_fops, &kdamond_pid_fops};
-	int i;
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[16];
+	int ret;
 
-	for (i = 0; i < ARRAY_SIZE(file_names); i++)
-		debugfs_create_file(file_names[i], 0600, dir, ctx, fops[i]);
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%s\n",
+			split_policy_strs[ctx->split_policy]);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
 }
 
-static void dbgfs_before_terminate(struct damon_ctx *ctx)
+static ssize_t dbgfs_split_policy_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
 {
-	struct damon_target *t, *next;
+	struct damon_ctx *ctx = file->private_data;
+	char *kbuf;
+	ssize_t ret;
+	int policy;
 
-	if (!targetid_is_pid(ctx))
-		return;
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
 
-	damon_for_each_target_safe(t, next, ctx) {
-		put_pid((struct pid *)t->id);
-		damon_destroy_target(t);
+	policy = sysfs_match_string(split_policy_strs, kbuf);
+	if (policy < 0) {
+		ret = policy;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_split_policy(ctx, policy);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t sprint_summary(struct damon_ctx *ctx, char *buf, ssize_t len)
+{
+	struct damon_target_summary *summary;
+	struct damon_target *t;
+	unsigned long id;
+	int written = 0;
+	int i;
+
+	damon_for_each_target(t, ctx) {
+		summary = &t->summary;
+		id = t->id;
+		if (targetid_is_pid(ctx))
+			id = (unsigned long)pid_vnr((struct pid *)id);
+
+		written += scnprintf(&buf[written], len - written,
+				"target_id=%lu wss=%lu\nwss_percentiles:",
+				id, summary->wss);
+		for (i = 0; i < ctx->nr_wss_percentiles; i++)
+			written += scnprintf(&buf[written], len - written,
+					" %u:%lu", ctx->wss_percentiles[i],
+					summary->wss_percentiles[i]);
+		written += scnprintf(&buf[written], len - written,
+				"\nsz_by_freq:");
+		for (i = 0; i < DAMON_NR_FREQ_BUCKETS; i++)
+			written += scnprintf(&buf[written], len - written,
+					" %lu", summary->sz_by_freq[i]);
+		written += scnprintf(&buf[written], len - written,
+				"\nsz_by_age:");
+		for (i = 0; i < DAMON_NR_AGE_BUCKETS; i++)
+			written += scnprintf(&buf[written], len - written,
+					" %lu", summary->sz_by_age[i]);
+		written += scnprintf(&buf[written], len - written, "\n");
 	}
+	return written;
+}
+
+static ssize_t dbgfs_summary_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char *kbuf;
+	ssize_t len;
+
+	kbuf = kmalloc(count, GFP_KERNEL | __GFP_NOWARN);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&ctx->kdamond_lock);
+	len = sprint_summary(ctx, kbuf, count);
+	mutex_unlock(&ctx->kdamond_lock);
+	len = simple_read_from_buffer(buf, count, ppos, kbuf, len);
+
+	kfree(kbuf);
+	return len;
+}
+
+/*
+ * Set the working set size percentiles and turn the summary on, e.g.,
+ * "50 90 99".  "off" turns the summary off.
+ */
+static ssize_t dbgfs_summary_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	unsigned int percentiles[DAMON_MAX_WSS_PERCENTILES];
+	unsigned int nr_percentiles = 0;
+	char *kbuf, *pos;
+	bool off;
+	ssize_t ret;
+	int parsed;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	off = !strcmp(strim(kbuf), "off");
+	pos = kbuf;
+	while (!off && nr_percentiles < DAMON_MAX_WSS_PERCENTILES &&
+			sscanf(pos, "%u%n", &percentiles[nr_percentiles],
+				&parsed) == 1) {
+		pos += parsed;
+		nr_percentiles++;
+	}
+	if (!off && !nr_percentiles) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	if (off) {
+		ctx->summarize = false;
+		ret = count;
+		goto unlock_out;
+	}
+	ret = damon_set_wss_percentiles(ctx, percentiles, nr_percentiles);
+	if (!ret) {
+		ctx->summarize = true;
+		ret = count;
+	}
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_ring_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[32];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%llu\n", ctx->ring.data_sz);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+/*
+ * Set the size of the data area of the ring buffer, or zero for removing it
+ */
+static ssize_t dbgfs_ring_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	unsigned long data_sz;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (kstrtoul(kbuf, 0, &data_sz)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_ring(ctx, data_sz, dbgfs_target_id);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static int dbgfs_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return damon_ring_mmap(file->private_data, vma);
+}
+
+static __poll_t dbgfs_ring_poll(struct file *file, poll_table *wait)
+{
+	return damon_ring_poll(file->private_data, file, wait);
+}
+
+static const char * const phase_strs[] = {
+	[DAMON_PHASE_PREPARE_ACCESS_CHECKS] = "prepare_access_checks",
+	[DAMON_PHASE_CHECK_ACCESSES] = "check_accesses",
+	[DAMON_PHASE_MERGE] = "merge",
+	[DAMON_PHASE_SCHEMES] = "schemes",
+	[DAMON_PHASE_REPORT] = "report",
+	[DAMON_PHASE_SPLIT] = "split",
+	[DAMON_PHASE_UPDATE] = "update",
+};
+
+static ssize_t dbgfs_stats_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	struct damon_phase_stat *stat;
+	char kbuf[512];
+	int written;
+	int i;
+
+	mutex_lock(&ctx->kdamond_lock);
+	written = scnprintf(kbuf, ARRAY_SIZE(kbuf),
+			"cpu_util %u\nbudget_exceeds %lu\nsample_interval %lu\naggr_interval %lu\n",
+			READ_ONCE(ctx->cpu_util), ctx->nr_budget_exceeds,
+			ctx->sample_interval, ctx->aggr_interval);
+	if (ctx->target_type != DAMON_ARBITRARY_TARGET)
+		written += scnprintf(&kbuf[written],
+				ARRAY_SIZE(kbuf) - written,
+				"max_nr_regions %lu\n", ctx->max_nr_regions);
+	for (i = 0; i < NR_DAMON_PHASES; i++) {
+		stat = &ctx->phase_stats[i];
+		written += scnprintf(&kbuf[written],
+				ARRAY_SIZE(kbuf) - written, "%s %llu %llu\n",
+				phase_strs[i], READ_ONCE(stat->total_ns),
+				READ_ONCE(stat->last_ns));
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, written);
+}
+
+static ssize_t dbgfs_cpu_budget_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[16];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%u\n", ctx->cpu_budget);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+static ssize_t dbgfs_cpu_budget_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	unsigned int cpu_budget;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (kstrtouint(kbuf, 0, &cpu_budget)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_cpu_budget(ctx, cpu_budget);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_zoom_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[32];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%u %u\n",
+			ctx->zoom_nr_regions, ctx->zoom_nr_aggrs);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+/*
+ * Set the page granularity zooming of the hottest regions.  The input is the
+ * number of the regions to zoom in and the number of the aggregation intervals
+ * to zoom in each of those.  '0 0' disables the zooming.
+ */
+static ssize_t dbgfs_zoom_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	unsigned int nr_regions, nr_aggrs;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sscanf(kbuf, "%u %u", &nr_regions, &nr_aggrs) != 2) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_zoom(ctx, nr_regions, nr_aggrs);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_region_granularity_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[32];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%lu\n",
+			ctx->region_granularity);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+static ssize_t dbgfs_region_granularity_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	unsigned long granularity;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (kstrtoul(kbuf, 0, &granularity)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_region_granularity(ctx, granularity);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_hotness_weight_shift_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[16];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%u\n",
+			ctx->hotness_weight_shift);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+static ssize_t dbgfs_hotness_weight_shift_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	unsigned int shift;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (kstrtouint(kbuf, 0, &shift)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_hotness_weight_shift(ctx, shift);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_hotness_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char kbuf[8];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%s\n",
+			ctx->index_regions ? "on" : "off");
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+/*
+ * Turn the index of the regions for the hotness queries on or off, e.g., "on"
+ */
+static ssize_t dbgfs_hotness_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = file->private_data;
+	char *kbuf;
+	bool on;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (kstrtobool(kbuf, &on)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ctx->index_regions = on;
+	ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+/* Max number of the queries that handled at once */
+#define DBGFS_MAX_HOTNESS_QUERIES	1024
+
+static long dbgfs_hotness_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg)
+{
+	struct damon_ctx *ctx = file->private_data;
+	struct damon_hotness_queries req;
+	struct damon_hotness_query *queries;
+	struct damon_hotness_query __user *uqueries;
+	bool id_is_pid = targetid_is_pid(ctx);
+	unsigned long id;
+	unsigned int nr;
+	u64 done;
+	long ret = 0;
+
+	if (cmd != DAMON_IOC_QUERY_HOTNESS)
+		return -ENOTTY;
+	if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+		return -EFAULT;
+
+	id = req.target_id;
+	if (id_is_pid) {
+		id = (unsigned long)find_get_pid((int)req.target_id);
+		if (!id)
+			return -EINVAL;
+	}
+
+	queries = kmalloc_array(min_t(u64, req.nr_queries,
+				DBGFS_MAX_HOTNESS_QUERIES), sizeof(*queries),
+			GFP_KERNEL);
+	if (!queries) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	uqueries = u64_to_user_ptr(req.queries);
+	for (done = 0; done < req.nr_queries; done += nr) {
+		nr = min_t(u64, req.nr_queries - done,
+				DBGFS_MAX_HOTNESS_QUERIES);
+		if (copy_from_user(queries, &uqueries[done],
+					nr * sizeof(*queries))) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = damon_query_hotness(ctx, id, queries, nr);
+		if (ret)
+			break;
+		if (copy_to_user(&uqueries[done], queries,
+					nr * sizeof(*queries))) {
+			ret = -EFAULT;
+			break;
+		}
+		cond_resched();
+	}
+	kfree(queries);
+out:
+	if (id_is_pid)
+		put_pid((struct pid *)id);
+	return ret;
+}
+
+/* Max number of the changes that committed at once */
+#define DBGFS_MAX_CONFIG_OPS	1024
+
+static struct damos *dbgfs_desc_to_scheme(struct damon_scheme_desc *desc)
+{
+	struct damos *scheme;
+	struct damos_quota quota = {
+		.ms = desc->quota_ms,
+		.sz = desc->quota_sz,
+		.reset_interval = desc->quota_reset_interval,
+		.weight_sz = desc->quota_weight_sz,
+		.weight_nr_accesses = desc->quota_weight_nr_accesses,
+		.weight_age = desc->quota_weight_age,
+	};
+	struct damos_watermarks wmarks = {
+		.metric = desc->wmarks_metric,
+		.interval = desc->wmarks_interval,
+		.high = desc->wmarks_high,
+		.mid = desc->wmarks_mid,
+		.low = desc->wmarks_low,
+	};
+
+	scheme = damon_new_scheme(desc->min_sz_region, desc->max_sz_region,
+			desc->min_nr_accesses, desc->max_nr_accesses,
+			desc->min_age_region, desc->max_age_region,
+			desc->action, &quota, &wmarks);
+	if (scheme) {
+		scheme->min_nr_writes = desc->min_nr_writes;
+		scheme->max_nr_writes = desc->max_nr_writes;
+	}
+	return scheme;
+}
+
+static bool dbgfs_op_has_target(struct damon_op *op)
+{
+	return op->type != DAMON_OP_ADD_SCHEME &&
+		op->type != DAMON_OP_RM_SCHEME;
+}
+
+/*
+ * Convert a user-given change into a &struct damon_op
+ *
+ * If the targets are processes, a reference to the pid of the target is taken
+ * and stored in '->target_id' of the op.  The objects in the op should be
+ * freed even if this fails.
+ */
+static int dbgfs_to_op(struct damon_config_op *uop, struct damon_op *op,
+		bool id_is_pid)
+{
+	if (uop->type >= NR_DAMON_OP_TYPES || uop->reserved)
+		return -EINVAL;
+
+	op->type = uop->type;
+	op->target_id = uop->target_id;
+	if (id_is_pid && dbgfs_op_has_target(op)) {
+		op->target_id = (unsigned long)find_get_pid(
+				(int)uop->target_id);
+		if (!op->target_id)
+			return -EINVAL;
+	}
+
+	switch (op->type) {
+	case DAMON_OP_ADD_TARGET:
+		op->target = damon_new_target(op->target_id);
+		if (!op->target) {
+			if (id_is_pid)
+				put_pid((struct pid *)op->target_id);
+			op->target_id = 0;
+			return -ENOMEM;
+		}
+		break;
+	case DAMON_OP_ADD_REGION:
+		op->region = damon_new_region(uop->start, uop->end);
+		if (!op->region)
+			return -ENOMEM;
+		fallthrough;
+	case DAMON_OP_RM_REGION:
+		op->ar.start = uop->start;
+		op->ar.end = uop->end;
+		op->spare = damon_new_region(uop->start, uop->end);
+		if (!op->spare)
+			return -ENOMEM;
+		break;
+	case DAMON_OP_ADD_SCHEME:
+		if (!damos_action_valid(uop->scheme.action))
+			return -EINVAL;
+		op->scheme = dbgfs_desc_to_scheme(&uop->scheme);
+		if (!op->scheme)
+			return -ENOMEM;
+		break;
+	case DAMON_OP_RM_SCHEME:
+		op->scheme_idx = min_t(u64, uop->scheme_idx, UINT_MAX);
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Put the references to the pids that taken by dbgfs_to_op(), and those of the
+ * targets that removed or failed to be added
+ */
+static void dbgfs_put_op_pids(struct damon_op *ops, unsigned int nr_ops)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_ops; i++) {
+		struct damon_op *op = &ops[i];
+
+		if (!dbgfs_op_has_target(op) || !op->target_id)
+			continue;
+		/* The reference is moved to the added target */
+		if (op->type == DAMON_OP_ADD_TARGET) {
+			if (op->target)
+				put_pid((struct pid *)op->target_id);
+			continue;
+		}
+		put_pid((struct pid *)op->target_id);
+		if (op->target)
+			put_pid((struct pid *)op->target->id);
+	}
+}
+
+static long dbgfs_config_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg)
+{
+	struct damon_ctx *ctx = file->private_data;
+	struct damon_config_ops req;
+	struct damon_config_op *uops;
+	struct damon_op *ops;
+	bool id_is_pid = targetid_is_pid(ctx);
+	unsigned int nr_ops;
+	long ret = 0;
+
+	if (cmd != DAMON_IOC_COMMIT)
+		return -ENOTTY;
+	if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+		return -EFAULT;
+	if (!req.nr_ops)
+		return 0;
+	if (req.nr_ops > DBGFS_MAX_CONFIG_OPS)
+		return -E2BIG;
+
+	uops = vmemdup_user(u64_to_user_ptr(req.ops),
+			req.nr_ops * sizeof(*uops));
+	if (IS_ERR(uops))
+		return PTR_ERR(uops);
+	ops = kvcalloc(req.nr_ops, sizeof(*ops), GFP_KERNEL);
+	if (!ops) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (nr_ops = 0; nr_ops < req.nr_ops && !ret; nr_ops++)
+		ret = dbgfs_to_op(&uops[nr_ops], &ops[nr_ops], id_is_pid);
+	if (!ret)
+		ret = damon_commit_ops(ctx, ops, nr_ops);
+
+	if (id_is_pid)
+		dbgfs_put_op_pids(ops, nr_ops);
+	damon_free_ops(ops, nr_ops);
+	kvfree(ops);
+out:
+	kvfree(uops);
+	return ret;
+}
+
+static int damon_dbgfs_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+
+	return nonseekable_open(inode, file);
+}
+
+static const struct file_operations attrs_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_attrs_read,
+	.write = dbgfs_attrs_write,
+};
+
+static const struct file_operations schemes_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_schemes_read,
+	.write = dbgfs_schemes_write,
+};
+
+static const struct file_operations target_ids_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_target_ids_read,
+	.write = dbgfs_target_ids_write,
+};
+
+static const struct file_operations init_regions_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_init_regions_read,
+	.write = dbgfs_init_regions_write,
+};
+
+static const struct file_operations scheme_targets_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_scheme_targets_read,
+	.write = dbgfs_scheme_targets_write,
+};
+
+static const struct file_operations kdamond_pid_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_kdamond_pid_read,
+};
+
+static const struct file_operations config_fops = {
+	.open = damon_dbgfs_open,
+	.unlocked_ioctl = dbgfs_config_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+};
+
+static const struct file_operations hotness_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_hotness_read,
+	.write = dbgfs_hotness_write,
+	.unlocked_ioctl = dbgfs_hotness_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+};
+
+static const struct file_operations summary_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_summary_read,
+	.write = dbgfs_summary_write,
+};
+
+static const struct file_operations ring_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_ring_read,
+	.write = dbgfs_ring_write,
+	.mmap = dbgfs_ring_mmap,
+	.poll = dbgfs_ring_poll,
+};
+
+static const struct file_operations stats_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_stats_read,
+};
+
+static const struct file_operations cpu_budget_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_cpu_budget_read,
+	.write = dbgfs_cpu_budget_write,
+};
+
+static const struct file_operations zoom_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_zoom_read,
+	.write = dbgfs_zoom_write,
+};
+
+static const struct file_operations region_granularity_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_region_granularity_read,
+	.write = dbgfs_region_granularity_write,
+};
+
+static const struct file_operations hotness_weight_shift_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_hotness_weight_shift_read,
+	.write = dbgfs_hotness_weight_shift_write,
+};
+
+static const struct file_operations split_policy_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_split_policy_read,
+	.write = dbgfs_split_policy_write,
+};
+
+static const struct file_operations access_check_fops = {
+	.open = damon_dbgfs_open,
+	.read = dbgfs_access_check_read,
+	.write = dbgfs_access_check_write,
+};
+
+static void dbgfs_fill_ctx_dir(struct dentry *dir, struct damon_ctx *ctx)
+{
+	const char * const file_names[] = {"attrs", "schemes", "target_ids",
+		"init_regions", "kdamond_pid", "split_policy", "hotness",
+		"summary", "ring", "stats", "cpu_budget", "config",
+		"scheme_targets", "access_check", "zoom",
+		"region_granularity", "hotness_weight_shift"};
+	const struct file_operations *fops[] = {&attrs_fops, &schemes_fops,
+		&target_ids_fops, &init_regions_fops, &kdamond_pid_fops,
+		&split_policy_fops, &hotness_fops, &summary_fops, &ring_fops,
+		&stats_fops, &cpu_budget_fops, &config_fops,
+		&scheme_targets_fops, &access_check_fops, &zoom_fops,
+		&region_granularity_fops, &hotness_weight_shift_fops};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(file_names); i++)
+		debugfs_create_file(file_names[i], 0600, dir, ctx, fops[i]);
+}
+
+static void dbgfs_before_terminate(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	if (!targetid_is_pid(ctx))
+		return;
+
+	damon_for_each_target(t, ctx)
+		put_pid((struct pid *)t->id);
+	damon_set_targets(ctx, NULL, 0);
+	dbgfs_reset_scheme_targets(ctx);
 }
 
 static struct damon_ctx *dbgfs_new_ctx(void)
@@ -7,6 +7,8 @@
 
 #define pr_fmt(fmt) "damon-pa: " fmt
 
+#include <linux/bitmap.h>
+#include <linux/memcontrol.h>
 #include <linux/page_idle.h>
 #include <linux/swap.h>
 
@@ -70,14 +72,92 @@ static unsigned int damon_pa_check_accesses(struct damon_ctx *ctx)
 	return max_nr_accesses;
 }
 
+static void damon_pa_prepare_page_access_checks(struct damon_ctx *ctx,
+		struct damon_target *t, struct damon_addr_range *ar)
+{
+	unsigned long addr;
+
+	for (addr = ar->start; addr < ar->end; addr += PAGE_SIZE) {
+		damon_pa_mkold(addr);
+		cond_resched();
+	}
+}
+
+static void damon_pa_check_page_accesses(struct damon_ctx *ctx,
+		struct damon_target *t, struct damon_addr_range *ar,
+		unsigned long *bitmap)
+{
+	unsigned long addr, page_sz, nr_pages = (ar->end - ar->start) /
+		PAGE_SIZE;
+	unsigned long idx;
+
+	for (addr = ar->start; addr < ar->end; addr += page_sz) {
+		page_sz = PAGE_SIZE;
+		idx = (addr - ar->start) / PAGE_SIZE;
+		if (damon_pa_young(addr, &page_sz))
+			bitmap_set(bitmap, idx, min(page_sz / PAGE_SIZE,
+						nr_pages - idx));
+		cond_resched();
+	}
+}
+
 bool damon_pa_target_valid(void *t)
 {
 	return true;
 }
 
+#ifdef CONFIG_MEMCG
+/*
+ * Find the control of the scheme for the memory cgroup of the page, or of its
+ * nearest ancestor having the control.  The page should be isolated from the
+ * LRU lists, so that its memory cgroup is stable.
+ */
+static struct damos_memcg *damon_pa_find_memcg(struct damos *s,
+		struct page *page)
+{
+	struct mem_cgroup *memcg;
+	unsigned int i;
+	u64 id;
+
+	if (mem_cgroup_disabled())
+		return NULL;
+
+	for (memcg = page_memcg(page); memcg;
+			memcg = parent_mem_cgroup(memcg)) {
+		id = cgroup_id(memcg->css.cgroup);
+		for (i = 0; i < s->nr_memcgs; i++) {
+			if (s->memcgs[i].id == id)
+				return &s->memcgs[i];
+		}
+	}
+	return NULL;
+}
+#else
+static struct damos_memcg *damon_pa_find_memcg(struct damos *s,
+		struct page *page)
+{
+	return NULL;
+}
+#endif	/* CONFIG_MEMCG */
+
+static void damon_pa_reclaim(struct damos *s, struct list_head *page_list,
+		struct damos_memcg *memcg)
+{
+	unsigned long sz;
+
+	if (list_empty(page_list))
+		return;
+
+	sz = (unsigned long)reclaim_pages(page_list) * PAGE_SIZE;
+	s->stat_sz_applied += sz;
+	if (memcg)
+		memcg->stat_sz_applied += sz;
+}
+
 static int damon_pa_apply_scheme(struct damon_ctx *ctx, struct damon_target *t,
 		struct damon_region *r, struct damos *scheme)
 {
+	struct damos_memcg *memcg, *list_memcg = NULL;
 	unsigned long addr;
 	LIST_HEAD(page_list);
 
@@ -98,12 +178,30 @@ static int damon_pa_apply_scheme(struct damon_ctx *ctx, struct damon_target *t,
 		}
 		if (PageUnevictable(page)) {
 			putback_lru_page(page);
-		} else {
-			list_add(&page->lru, &page_list);
+			continue;
+		}
+
+		memcg = scheme->nr_memcgs ?
+			damon_pa_find_memcg(scheme, page) : NULL;
+		if (memcg && (memcg->protected || (memcg->quota_sz &&
+				memcg->charged_sz >= memcg->quota_sz))) {
+			putback_lru_page(page);
 			put_page(page);
+			continue;
+		}
+		/* Reclaim the pages of each cgroup together, for the stats */
+		if (memcg != list_memcg) {
+			damon_pa_reclaim(scheme, &page_list, list_memcg);
+			list_memcg = memcg;
+		}
+		if (memcg) {
+			memcg->charged_sz += PAGE_SIZE;
+			memcg->stat_sz_tried += PAGE_SIZE;
 		}
+		list_add(&page->lru, &page_list);
+		put_page(page);
 	}
-	reclaim_pages(&page_list);
+	damon_pa_reclaim(scheme, &page_list, list_memcg);
 	cond_resched();
 	return 0;
 }
@@ -129,8 +227,12 @@ void damon_pa_set_primitives(struct damon_ctx *ctx)
 	ctx->primitive.prepare_access_checks = damon_pa_prepare_access_checks;
 	ctx->primitive.check_accesses = damon_pa_check_accesses;
 	ctx->primitive.reset_aggregated = NULL;
+	ctx->primitive.prepare_page_access_checks =
+		damon_pa_prepare_page_access_checks;
+	ctx->primitive.check_page_accesses = damon_pa_check_page_accesses;
 	ctx->primitive.target_valid = damon_pa_target_valid;
 	ctx->primitive.cleanup = NULL;
 	ctx->primitive.apply_scheme = damon_pa_apply_scheme;
+	ctx->primitive.apply_scheme_ranges = NULL;
 	ctx->primitive.get_scheme_score = damon_pa_scheme_score;
 }
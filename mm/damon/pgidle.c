@@ -7,8 +7,16 @@
 
 #define pr_fmt(fmt) "damon-pgi: " fmt
 
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/mmzone.h>
+#include <linux/page-flags.h>
 #include <linux/rmap.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
+#include "../internal.h"
 #include "prmtv-common.h"
 
 #include <trace/events/damon.h>
@@ -19,32 +27,369 @@ bool damon_pgi_is_idle(unsigned long pfn, unsigned long *pg_size)
 }
 
 /*
- * This has no implementations for 'init()' and 'update()'.  Users should set
- * the initial regions and update regions by themselves in the 'before_start'
- * and 'after_aggregation' callbacks, respectively.  Or, they can implement and
- * use their own version of the primitives.
+ * This has no implementations for 'update()'.  Users should set the initial
+ * regions and update regions by themselves in the 'before_start' and
+ * 'after_aggregation' callbacks, respectively.  Or, they can implement and use
+ * their own version of the primitives.
  */
 
+static DEFINE_MUTEX(damon_pgi_buf_lock);
+
+static void damon_pgi_work_fn(struct work_struct *work);
+
+/*
+ * Find the runs of the page blocks of a node in the span of the node
+ *
+ * The spans of nodes can overlap with each other, so the node of each page
+ * block in the span is checked.  Up to @max_nr_runs runs are stored in
+ * @ranges.
+ *
+ * Returns the number of the runs, including those that are not stored.
+ */
+static unsigned int damon_pgi_node_runs(int nid,
+		struct damon_pfns_range *ranges, unsigned int max_nr_runs)
+{
+	unsigned long end = node_end_pfn(nid);
+	unsigned long pfn, next, run_start;
+	unsigned int nr = 0;
+
+	/* run_start is end while not in a run of page blocks of the node */
+	run_start = end;
+	for (pfn = node_start_pfn(nid); pfn < end; pfn = next) {
+		next = min(ALIGN(pfn + 1, pageblock_nr_pages), end);
+		if (pfn_valid(pfn) && pfn_to_nid(pfn) == nid) {
+			if (run_start == end)
+				run_start = pfn;
+			continue;
+		}
+		if (run_start == end)
+			continue;
+		if (nr < max_nr_runs) {
+			ranges[nr].start = run_start;
+			ranges[nr].end = pfn;
+		}
+		nr++;
+		run_start = end;
+		cond_resched();
+	}
+	if (run_start != end) {
+		if (nr < max_nr_runs) {
+			ranges[nr].start = run_start;
+			ranges[nr].end = end;
+		}
+		nr++;
+	}
+	return nr;
+}
+
+/**
+ * damon_pgi_node_ranges() - Get the pfn ranges of the online nodes.
+ * @nr_ranges:	pointer for storing the number of the ranges
+ *
+ * Each range is in one node, and the ranges do not overlap with each other
+ * even if the spans of the nodes do.  Usually, there is one range per node.
+ * The caller should free the returned array using kfree().
+ *
+ * Return: Array of &struct damon_pfns_range, or NULL if failed.
+ */
+struct damon_pfns_range *damon_pgi_node_ranges(unsigned int *nr_ranges)
+{
+	struct damon_pfns_range *ranges;
+	unsigned int nr = 0;
+	int nid;
+
+	for_each_online_node(nid)
+		nr += damon_pgi_node_runs(nid, NULL, 0);
+
+	ranges = kcalloc(max(nr, 1U), sizeof(*ranges), GFP_KERNEL);
+	if (!ranges)
+		return NULL;
+
+	/* Memory could be onlined in the meantime */
+	*nr_ranges = 0;
+	for_each_online_node(nid) {
+		*nr_ranges += damon_pgi_node_runs(nid, &ranges[*nr_ranges],
+				nr - *nr_ranges);
+		if (*nr_ranges >= nr) {
+			*nr_ranges = nr;
+			break;
+		}
+	}
+	return ranges;
+}
+
+/* Allocate the results buffer of the target and set up the ranges */
+void damon_pgi_init(struct damon_ctx *ctx)
+{
+	struct damon_pgi_target *target = ctx->arbitrary_target;
+	struct damon_pgi_buffer_hdr *hdr;
+	struct damon_pfns_range *r;
+	unsigned long nr_pfns = 0, accessed_off, idle_ages_off, sz;
+	unsigned int i;
+
+	for (i = 0; i < target->nr_ranges; i++) {
+		r = &target->ranges[i];
+		/* Keep each range of the bitmap from sharing a word */
+		r->idx = ALIGN(nr_pfns, BITS_PER_LONG);
+		nr_pfns = r->idx + r->end - r->start;
+		r->cursor = r->start;
+		r->slice_end = r->start;
+		r->nid = pfn_valid(r->start) ? pfn_to_nid(r->start) :
+			NUMA_NO_NODE;
+		r->target = target;
+		INIT_WORK(&r->work, damon_pgi_work_fn);
+	}
+
+	accessed_off = ALIGN(struct_size(hdr, ranges, target->nr_ranges),
+			SMP_CACHE_BYTES);
+	idle_ages_off = accessed_off + BITS_TO_LONGS(nr_pfns) * sizeof(long);
+	sz = PAGE_ALIGN(idle_ages_off + nr_pfns);
+
+	hdr = vmalloc_user(sz);
+	if (!hdr) {
+		pr_err("failed to allocate results buffer of %lu bytes\n", sz);
+		return;
+	}
+	hdr->generation = 0;
+	hdr->nr_ranges = target->nr_ranges;
+	hdr->nr_pfns = nr_pfns;
+	hdr->accessed_off = accessed_off;
+	hdr->idle_ages_off = idle_ages_off;
+	hdr->scan_pfns_per_ms = 0;
+	for (i = 0; i < target->nr_ranges; i++) {
+		r = &target->ranges[i];
+		hdr->ranges[i].start_pfn = r->start;
+		hdr->ranges[i].nr_pfns = r->end - r->start;
+		hdr->ranges[i].idx = r->idx;
+	}
+
+	mutex_lock(&damon_pgi_buf_lock);
+	target->buf = hdr;
+	target->buf_sz = sz;
+	mutex_unlock(&damon_pgi_buf_lock);
+}
+
+/*
+ * Get the pfns that can be handled together with the given pfn
+ *
+ * pfn		the first pfn of the pages
+ * end		the end pfn of the scan
+ * check_pfn	for storing the pfn to do the access check for the pages
+ *
+ * Free, reserved, offline and non-LRU pages cannot be tracked, so this
+ * function finds those without the costly reference counting and tells the
+ * caller to skip those by storing zero in @check_pfn.  For compound pages, the
+ * rest of the compound page is handled with the head page, so that the rmap
+ * walk is done once per compound page.  The checks are racy, but it is fine
+ * since it is only an optimization.
+ *
+ * Returns the number of the pages to be handled together.
+ */
+static unsigned long damon_pgi_scan_unit(unsigned long pfn, unsigned long end,
+		unsigned long *check_pfn)
+{
+	struct page *page = pfn_to_online_page(pfn);
+	struct page *head;
+	unsigned long nr = 1;
+	unsigned int order;
+
+	*check_pfn = 0;
+	if (!page) {
+#ifdef CONFIG_SPARSEMEM
+		/* Whole memory section is offline */
+		nr = ALIGN(pfn + 1, PAGES_PER_SECTION) - pfn;
+#endif
+		goto out;
+	}
+
+	if (PageBuddy(page)) {
+		order = buddy_order_unsafe(page);
+		if (order < MAX_ORDER)
+			nr = 1UL << order;
+		goto out;
+	}
+
+	head = compound_head(page);
+	if (PageCompound(page))
+		nr = page_to_pfn(head) + compound_nr(head) - pfn;
+	if (PageReserved(head) || !PageLRU(head))
+		goto out;
+	*check_pfn = page_to_pfn(head);
+out:
+	return min(nr, end - pfn);
+}
+
+/* Clear the accessed bits of pages in [@start, @end) of @r */
+static void damon_pgi_mkold_range(struct damon_pfns_range *r,
+		unsigned long start, unsigned long end)
+{
+	unsigned long pfn, check_pfn, nr_pfns;
+
+	for (pfn = start; pfn < end; pfn += nr_pfns) {
+		nr_pfns = damon_pgi_scan_unit(pfn, end, &check_pfn);
+		if (check_pfn)
+			damon_pa_mkold(PFN_PHYS(check_pfn));
+		cond_resched();
+	}
+	r->nr_scanned = end - start;
+}
+
+/* Update the results of @nr_pfns pages starting from @pfn of @r */
+static void damon_pgi_set_result(struct damon_pgi_target *target,
+		struct damon_pfns_range *r, unsigned long pfn,
+		unsigned long nr_pfns, bool young)
+{
+	struct damon_pgi_buffer_hdr *hdr = target->buf;
+	unsigned long *accessed;
+	u8 *idle_ages;
+	unsigned long idx;
+
+	if (!hdr)
+		return;
+
+	accessed = (void *)hdr + hdr->accessed_off;
+	idle_ages = (void *)hdr + hdr->idle_ages_off;
+	for (idx = r->idx + pfn - r->start; nr_pfns--; idx++) {
+		if (young) {
+			__set_bit(idx, accessed);
+			idle_ages[idx] = 0;
+		} else {
+			__clear_bit(idx, accessed);
+			if (idle_ages[idx] < U8_MAX)
+				idle_ages[idx]++;
+		}
+	}
+}
+
+/* Check accesses to pages in [@start, @end) of @r */
+static void damon_pgi_check_range(struct damon_pfns_range *r,
+		unsigned long start, unsigned long end)
+{
+	unsigned long pfn, check_pfn, nr_pfns;
+	unsigned long pg_size;
+	bool young;
+
+	for (pfn = start; pfn < end; pfn += nr_pfns) {
+		nr_pfns = damon_pgi_scan_unit(pfn, end, &check_pfn);
+		young = false;
+		if (check_pfn)
+			young = damon_pa_young(PFN_PHYS(check_pfn), &pg_size);
+		if (r->target->trace)
+			trace_damon_pgi(pfn, young);
+		damon_pgi_set_result(r->target, r, pfn, nr_pfns, young);
+		cond_resched();
+	}
+	r->nr_scanned = end - start;
+}
+
+/*
+ * Clear the accessed bits of the next slice of @r, which is checked by
+ * damon_pgi_check_slice() after the sampling interval
+ */
+static void damon_pgi_mkold_slice(struct damon_pfns_range *r)
+{
+	r->slice_end = min(r->cursor + r->target->nr_pfns_per_slice, r->end);
+	damon_pgi_mkold_range(r, r->cursor, r->slice_end);
+}
+
+/* Check the slice of @r that damon_pgi_mkold_slice() prepared */
+static void damon_pgi_check_slice(struct damon_pfns_range *r)
+{
+	damon_pgi_check_range(r, r->cursor, r->slice_end);
+	r->cursor = r->slice_end < r->end ? r->slice_end : r->start;
+}
+
+static void damon_pgi_do_op(struct damon_pfns_range *r)
+{
+	switch (r->op) {
+	case DAMON_PGI_OP_MKOLD:
+		damon_pgi_mkold_range(r, r->start, r->end);
+		break;
+	case DAMON_PGI_OP_CHECK:
+		damon_pgi_check_range(r, r->start, r->end);
+		break;
+	case DAMON_PGI_OP_MKOLD_SLICE:
+		damon_pgi_mkold_slice(r);
+		break;
+	case DAMON_PGI_OP_CHECK_SLICE:
+		damon_pgi_check_slice(r);
+		break;
+	}
+}
+
+static void damon_pgi_work_fn(struct work_struct *work)
+{
+	damon_pgi_do_op(container_of(work, struct damon_pfns_range, work));
+}
+
+/*
+ * Do @op for every range of @target, in parallel on the node of each range if
+ * @target->per_node_workers is set.
+ *
+ * Returns the number of the scanned pfns.
+ */
+static unsigned long damon_pgi_for_each_range(struct damon_pgi_target *target,
+		enum damon_pgi_op op)
+{
+	struct damon_pfns_range *r;
+	unsigned long nr_scanned = 0;
+	unsigned int i;
+
+	for (i = 0; i < target->nr_ranges; i++) {
+		r = &target->ranges[i];
+		r->op = op;
+		if (!target->per_node_workers)
+			damon_pgi_do_op(r);
+		else if (r->nid == NUMA_NO_NODE)
+			queue_work(system_unbound_wq, &r->work);
+		else
+			queue_work_node(r->nid, system_unbound_wq, &r->work);
+	}
+
+	for (i = 0; i < target->nr_ranges; i++) {
+		r = &target->ranges[i];
+		if (target->per_node_workers)
+			flush_work(&r->work);
+		nr_scanned += r->nr_scanned;
+	}
+	return nr_scanned;
+}
+
 void damon_pgi_prepare_access_checks(struct damon_ctx *ctx)
 {
-	struct damon_pfns_range *target = ctx->arbitrary_target;
-	unsigned long pfn;
+	struct damon_pgi_target *target = ctx->arbitrary_target;
+	u64 begin = ktime_get_ns();
 
-	for (pfn = target->start; pfn < target->end; pfn++)
-		damon_pa_mkold(PFN_PHYS(pfn));
+	damon_pgi_for_each_range(target, target->nr_pfns_per_slice ?
+			DAMON_PGI_OP_MKOLD_SLICE : DAMON_PGI_OP_MKOLD);
+	target->prepare_ns = ktime_get_ns() - begin;
 }
 
 unsigned int damon_pgi_check_accesses(struct damon_ctx *ctx)
 {
-	struct damon_pfns_range *target = ctx->arbitrary_target;
-	unsigned long pfn;
-	unsigned long pg_size = 0;
+	struct damon_pgi_target *target = ctx->arbitrary_target;
+	struct damon_pgi_buffer_hdr *hdr = target->buf;
+	unsigned long nr_scanned;
+	u64 begin = ktime_get_ns(), elapsed_ns;
+
+	if (hdr) {
+		/* Let readers know the update is ongoing */
+		WRITE_ONCE(hdr->generation, hdr->generation + 1);
+		smp_wmb();
+	}
+
+	nr_scanned = damon_pgi_for_each_range(target,
+			target->nr_pfns_per_slice ? DAMON_PGI_OP_CHECK_SLICE :
+			DAMON_PGI_OP_CHECK);
 
-	for (pfn = target->start; pfn < target->end; pfn++) {
-		pg_size = 0;
-		trace_damon_pgi(pfn, damon_pa_young(PFN_PHYS(pfn), &pg_size));
-		if (pg_size > PAGE_SIZE)
-			pfn += pg_size / PAGE_SIZE - 1;
+	elapsed_ns = ktime_get_ns() - begin + target->prepare_ns;
+	target->scan_pfns_per_ms = div64_u64((u64)nr_scanned * NSEC_PER_MSEC,
+			max_t(u64, elapsed_ns, 1));
+
+	if (hdr) {
+		hdr->scan_pfns_per_ms = target->scan_pfns_per_ms;
+		smp_wmb();
+		WRITE_ONCE(hdr->generation, hdr->generation + 1);
 	}
 
 	return 0;
@@ -55,14 +400,71 @@ bool damon_pgi_target_valid(void *target)
 	return true;
 }
 
+void damon_pgi_cleanup(struct damon_ctx *ctx)
+{
+	struct damon_pgi_target *target = ctx->arbitrary_target;
+
+	if (!target)
+		return;
+
+	/* Pages that already mapped to the user space are kept until unmap */
+	mutex_lock(&damon_pgi_buf_lock);
+	vfree(target->buf);
+	target->buf = NULL;
+	target->buf_sz = 0;
+	mutex_unlock(&damon_pgi_buf_lock);
+}
+
+static int damon_pgi_buffer_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+
+	return nonseekable_open(inode, file);
+}
+
+static int damon_pgi_buffer_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct damon_ctx *ctx = file->private_data;
+	struct damon_pgi_target *target = ctx->arbitrary_target;
+	int err = -ENODEV;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	mutex_lock(&damon_pgi_buf_lock);
+	if (target && target->buf)
+		err = remap_vmalloc_range(vma, target->buf, vma->vm_pgoff);
+	mutex_unlock(&damon_pgi_buf_lock);
+	return err;
+}
+
+/*
+ * File operations for mapping the results buffer of a page granularity
+ * idleness monitoring context to the user space.  The private data of the
+ * inode should be the pointer to the context, e.g.,
+ *
+ *	debugfs_create_file("pgi_buffer", 0400, dir, ctx,
+ *			&damon_pgi_buffer_fops);
+ *
+ * The buffer is available while the monitoring of the context is running.
+ */
+const struct file_operations damon_pgi_buffer_fops = {
+	.open = damon_pgi_buffer_open,
+	.mmap = damon_pgi_buffer_mmap,
+};
+
 void damon_pgi_set_primitives(struct damon_ctx *ctx)
 {
-	ctx->primitive.init = NULL;
+	ctx->primitive.init = damon_pgi_init;
 	ctx->primitive.update = NULL;
 	ctx->primitive.prepare_access_checks = damon_pgi_prepare_access_checks;
 	ctx->primitive.check_accesses = damon_pgi_check_accesses;
 	ctx->primitive.reset_aggregated = NULL;
+	ctx->primitive.prepare_page_access_checks = NULL;
+	ctx->primitive.check_page_accesses = NULL;
 	ctx->primitive.target_valid = damon_pgi_target_valid;
-	ctx->primitive.cleanup = NULL;
+	ctx->primitive.cleanup = damon_pgi_cleanup;
 	ctx->primitive.apply_scheme = NULL;
+	ctx->primitive.apply_scheme_ranges = NULL;
 }
@@ -5,6 +5,7 @@
  * Author: SeongJae Park <sj@kernel.org>
  */
 
+#include <linux/math64.h>
 #include <linux/mmu_notifier.h>
 #include <linux/page_idle.h>
 #include <linux/pagemap.h>
@@ -236,7 +237,12 @@ int damon_pageout_score(struct damon_ctx *c, struct damon_region *r,
 	int hotness;
 
 	max_nr_accesses = c->aggr_interval / c->sample_interval;
-	freq_subscore = r->nr_accesses * DAMON_MAX_SUBSCORE / max_nr_accesses;
+	if (c->hotness_weight_shift)
+		freq_subscore = div_u64((u64)r->hotness * DAMON_MAX_SUBSCORE,
+				max_nr_accesses << DAMON_HOTNESS_FRAC_BITS);
+	else
+		freq_subscore = r->nr_accesses * DAMON_MAX_SUBSCORE /
+			max_nr_accesses;
 
 	age_in_sec = (unsigned long)r->age * c->aggr_interval / 1000000;
 	for (age_in_log = 0; age_in_log < DAMON_MAX_AGE_IN_LOG && age_in_sec;
@@ -266,3 +272,10 @@ int damon_pageout_score(struct damon_ctx *c, struct damon_region *r,
 	/* Return coldness of the region */
 	return DAMOS_MAX_SCORE - hotness;
 }
+
+/* Returns the hotness of a region, the reverse of damon_pageout_score() */
+int damon_hot_score(struct damon_ctx *c, struct damon_region *r,
+			struct damos *s)
+{
+	return DAMOS_MAX_SCORE - damon_pageout_score(c, r, s);
+}
@@ -7,10 +7,14 @@
 
 #define pr_fmt(fmt) "damon-reclaim: " fmt
 
+#include <linux/cgroup.h>
 #include <linux/damon.h>
 #include <linux/ioport.h>
+#include <linux/memcontrol.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
 #include <linux/workqueue.h>
 
 #ifdef MODULE_PARAM_PREFIX
@@ -78,6 +82,19 @@ module_param(quota_sz, ulong, 0600);
 static unsigned long quota_reset_interval_ms __read_mostly = 1000;
 module_param(quota_reset_interval_ms, ulong, 0600);
 
+/*
+ * Maximum refaults per thousand reclaimed pages.
+ *
+ * For every quota_reset_interval_ms, DAMON_RECLAIM compares the number of the
+ * workingset refaults to the number of the pages that it reclaimed.  If the
+ * refaults per thousand reclaimed pages is higher than this, the reclaimed
+ * pages are likely coming back soon, so DAMON_RECLAIM halves its quota for the
+ * next interval.  The quota is doubled back while the refaults are lower than
+ * this.  If this is zero, the back off is disabled.  Zero by default.
+ */
+static unsigned long max_refault_permil __read_mostly;
+module_param(max_refault_permil, ulong, 0600);
+
 /*
  * The watermarks check time interval in microseconds.
  *
@@ -162,7 +179,8 @@ module_param(max_nr_regions, ulong, 0600);
  * Start of the target memory region in physical address.
  *
  * The start physical address of memory region that DAMON_RECLAIM will do work
- * against.  By default, biggest System RAM is used as the region.
+ * against.  Only System RAM in the region is monitored.  By default, every
+ * System RAM is monitored.
  */
 static unsigned long monitor_region_start __read_mostly;
 module_param(monitor_region_start, ulong, 0600);
@@ -171,57 +189,281 @@ module_param(monitor_region_start, ulong, 0600);
  * End of the target memory region in physical address.
  *
  * The end physical address of memory region that DAMON_RECLAIM will do work
- * against.  By default, biggest System RAM is used as the region.
+ * against.  Only System RAM in the region is monitored.  By default, every
+ * System RAM is monitored.
  */
 static unsigned long monitor_region_end __read_mostly;
 module_param(monitor_region_end, ulong, 0600);
 
+/*
+ * Run one DAMON thread for each NUMA node.
+ *
+ * If this is ``Y``, DAMON_RECLAIM runs one DAMON thread for each NUMA node
+ * having memory, and binds it to the CPUs of the node.  Each thread monitors
+ * and reclaims the memory of its node only, using its own quota and
+ * watermarks.  The watermarks are checked against the free memory rate of the
+ * node instead of the system, so that the node under memory pressure is
+ * reclaimed even if the system has enough free memory in total.  Changes to
+ * this are applied when DAMON_RECLAIM is enabled next time.  ``N`` by default.
+ */
+static bool per_node __read_mostly;
+module_param(per_node, bool, 0600);
+
 /*
  * PID of the DAMON thread
  *
  * If DAMON_RECLAIM is enabled, this becomes the PID of the worker thread.
- * Else, -1.
+ * If it runs multiple threads, the PID of the first one.  Else, -1.
  */
 static int kdamond_pid __read_mostly = -1;
 module_param(kdamond_pid, int, 0400);
 
-static struct damon_ctx *ctx;
-static struct damon_target *target;
+/*
+ * Number of the DAMON threads of DAMON_RECLAIM
+ *
+ * If DAMON_RECLAIM is enabled, the number of the worker threads, which is also
+ * the number of the entries of the per-thread parameters below.  Else, zero.
+ */
+static unsigned int nr_kdamonds __read_mostly;
+module_param(nr_kdamonds, uint, 0400);
+
+/*
+ * PIDs of the DAMON threads
+ *
+ * If DAMON_RECLAIM is enabled, the PIDs of the worker threads.  If it runs
+ * one thread for each NUMA node, those are in the order of the node ids.
+ */
+static int kdamond_pids[MAX_NUMNODES] __read_mostly;
+module_param_array(kdamond_pids, int, &nr_kdamonds, 0400);
+
+/*
+ * Number of memory regions that tried to be reclaimed by each DAMON thread.
+ */
+static unsigned long nr_reclaim_tried_regions[MAX_NUMNODES] __read_mostly;
+module_param_array(nr_reclaim_tried_regions, ulong, &nr_kdamonds, 0400);
+
+/*
+ * Total bytes of memory regions that tried to be reclaimed by each DAMON
+ * thread.
+ */
+static unsigned long bytes_reclaim_tried_regions[MAX_NUMNODES] __read_mostly;
+module_param_array(bytes_reclaim_tried_regions, ulong, &nr_kdamonds, 0400);
+
+/*
+ * Total bytes of memory that successfully reclaimed by each DAMON thread.
+ */
+static unsigned long bytes_reclaimed_regions[MAX_NUMNODES] __read_mostly;
+module_param_array(bytes_reclaimed_regions, ulong, &nr_kdamonds, 0400);
+
+/*
+ * Refaults per thousand pages reclaimed by each DAMON thread in the last
+ * quota_reset_interval_ms.
+ */
+static unsigned long refault_permils[MAX_NUMNODES] __read_mostly;
+module_param_array(refault_permils, ulong, &nr_kdamonds, 0400);
+
+#define DAMON_RECLAIM_MAX_MEMCGS	16
+
+/*
+ * Cgroup ids of the memory cgroups to control the reclamation of separately.
+ *
+ * The cgroup id of a cgroup is the inode number of its directory in the cgroup
+ * file system.  The memory of the descendants of each cgroup is controlled
+ * together with that of the cgroup, unless the descendant is also given.  Up
+ * to 16 cgroups can be given.  Changes to this and the other memcg_* control
+ * parameters are applied when DAMON_RECLAIM is enabled next time.  Empty by
+ * default.
+ */
+static unsigned long long memcg_ids[DAMON_RECLAIM_MAX_MEMCGS] __read_mostly;
+static unsigned int nr_memcg_ids __read_mostly;
+module_param_array(memcg_ids, ullong, &nr_memcg_ids, 0600);
+
+/*
+ * Never reclaim the memory of the cgroups.
+ *
+ * If the entry for a cgroup in memcg_ids is ``Y``, DAMON_RECLAIM never
+ * reclaims the memory of the cgroup.  ``N`` by default.
+ */
+static bool memcg_protected[DAMON_RECLAIM_MAX_MEMCGS] __read_mostly;
+module_param_array(memcg_protected, bool, NULL, 0600);
+
+/*
+ * Limit of size of memory of the cgroups for the reclamation in bytes.
+ *
+ * DAMON_RECLAIM tries reclamation of no more than this size of the memory of
+ * the cgroup of the entry in memcg_ids within quota_reset_interval_ms.  If a
+ * value is zero, the limit is disabled.  Zero by default.
+ */
+static unsigned long memcg_quota_szs[DAMON_RECLAIM_MAX_MEMCGS] __read_mostly;
+module_param_array(memcg_quota_szs, ulong, NULL, 0600);
+
+/*
+ * Maximum refaults per thousand reclaimed pages of the cgroups.
+ *
+ * For every quota_reset_interval_ms, DAMON_RECLAIM compares the number of the
+ * refaults of each cgroup in memcg_ids to the number of the pages of the cgroup
+ * that it reclaimed.  If the refaults per thousand reclaimed pages is higher
+ * than this, the pages are likely coming back soon after the reclamation.
+ * Then, DAMON_RECLAIM halves the size of the memory of the cgroup that it
+ * reclaims in the next interval, and doubles it back to memcg_quota_szs while
+ * the refaults are lower than this.  If this is zero, the back off is
+ * disabled.  Zero by default.
+ */
+static unsigned long memcg_max_refault_permil __read_mostly;
+module_param(memcg_max_refault_permil, ulong, 0600);
+
+/*
+ * Number of the cgroups that DAMON_RECLAIM controls the reclamation of.
+ *
+ * The number of the entries of memcg_ids when DAMON_RECLAIM is enabled, which
+ * is also the number of the entries of the memcg_* stat parameters below.
+ * Changes to memcg_ids while DAMON_RECLAIM is enabled do not change this.
+ */
+static unsigned int nr_memcgs __read_mostly;
+module_param(nr_memcgs, uint, 0400);
+
+/*
+ * Total bytes of memory of the cgroups that successfully reclaimed.
+ */
+static unsigned long memcg_bytes_reclaimed[DAMON_RECLAIM_MAX_MEMCGS]
+	__read_mostly;
+module_param_array(memcg_bytes_reclaimed, ulong, &nr_memcgs, 0400);
+
+/*
+ * Number of the refaults of the cgroups while DAMON_RECLAIM is enabled.
+ */
+static unsigned long memcg_nr_refaults[DAMON_RECLAIM_MAX_MEMCGS] __read_mostly;
+module_param_array(memcg_nr_refaults, ulong, &nr_memcgs, 0400);
+
+/*
+ * Refaults of the cgroups per thousand pages reclaimed by DAMON_RECLAIM.
+ */
+static unsigned long memcg_refault_permil[DAMON_RECLAIM_MAX_MEMCGS]
+	__read_mostly;
+module_param_array(memcg_refault_permil, ulong, &nr_memcgs, 0400);
+
+static struct damon_ctx *ctxs[MAX_NUMNODES];
+
+/* Memory cgroup specific reclamation status of a DAMON thread */
+struct damon_reclaim_memcg {
+	unsigned long quota_sz;
+	unsigned long nr_refaults;
+	unsigned long last_refaults;
+	unsigned long last_sz_tried;
+	unsigned long last_sz_applied;
+};
+
+struct damon_reclaim_memcgs {
+	int nid;
+	unsigned int nr;
+	unsigned long window_from;
+	struct damon_reclaim_memcg memcgs[DAMON_RECLAIM_MAX_MEMCGS];
+};
+
+/* Protects the memcg_* stats, which are updated by multiple DAMON threads */
+static DEFINE_MUTEX(damon_reclaim_memcg_lock);
 
 struct damon_reclaim_ram_walk_arg {
+	struct damon_target *target;
 	unsigned long start;
 	unsigned long end;
+	int nid;
 };
 
+static int damon_reclaim_add_region(struct damon_target *t,
+		unsigned long start, unsigned long end)
+{
+	struct damon_region *r;
+
+	r = damon_new_region(start, end);
+	if (!r)
+		return -ENOMEM;
+	damon_add_region(r, t);
+	return 0;
+}
+
+/* Returns whether the page block containing a physical address is in a node */
+static bool damon_reclaim_in_node(unsigned long addr, int nid)
+{
+	unsigned long pfn = PHYS_PFN(addr);
+
+	return pfn_valid(pfn) && pfn_to_nid(pfn) == nid;
+}
+
+/*
+ * Add the part of a System RAM resource in the range, and in the node if given,
+ * to the target
+ *
+ * The spans of nodes can overlap with each other, so the node of each page
+ * block of the resource is checked.
+ */
 static int walk_system_ram(struct resource *res, void *arg)
 {
 	struct damon_reclaim_ram_walk_arg *a = arg;
+	unsigned long start = max_t(unsigned long, res->start, a->start);
+	unsigned long end = min_t(unsigned long, res->end + 1, a->end);
+	unsigned long chunk_sz = PAGE_SIZE * pageblock_nr_pages;
+	unsigned long addr, next, run_start;
+	int err;
 
-	if (a->end - a->start < res->end - res->start) {
-		a->start = res->start;
-		a->end = res->end;
+	if (start >= end)
+		return 0;
+	if (a->nid == NUMA_NO_NODE)
+		return damon_reclaim_add_region(a->target, start, end);
+
+	/* run_start is end while not in a run of chunks of the node */
+	run_start = end;
+	for (addr = start; addr < end; addr = next) {
+		next = min_t(unsigned long, ALIGN(addr + 1, chunk_sz), end);
+		if (damon_reclaim_in_node(addr, a->nid)) {
+			if (run_start == end)
+				run_start = addr;
+			continue;
+		}
+		if (run_start == end)
+			continue;
+		err = damon_reclaim_add_region(a->target, run_start, addr);
+		if (err)
+			return err;
+		run_start = end;
 	}
-	return 0;
+	if (run_start == end)
+		return 0;
+	return damon_reclaim_add_region(a->target, run_start, end);
 }
 
 /*
- * Find biggest 'System RAM' resource and store its start and end address in
- * @start and @end, respectively.  If no System RAM is found, returns false.
+ * Add every 'System RAM' resource in the monitoring region and, if @nid is
+ * not NUMA_NO_NODE, in the node @nid to @t as a region.  If no System RAM is
+ * found, returns -EINVAL.
  */
-static bool get_monitoring_region(unsigned long *start, unsigned long *end)
+static int set_monitoring_regions(struct damon_target *t, int nid)
 {
-	struct damon_reclaim_ram_walk_arg arg = {};
+	struct damon_reclaim_ram_walk_arg arg = {
+		.target = t,
+		.start = monitor_region_start,
+		.end = monitor_region_end ? monitor_region_end : ULONG_MAX,
+		.nid = nid,
+	};
+	int err;
 
-	walk_system_ram_res(0, ULONG_MAX, &arg, walk_system_ram);
-	if (arg.end <= arg.start)
-		return false;
+	if (nid != NUMA_NO_NODE) {
+		arg.start = max_t(unsigned long, arg.start,
+				PFN_PHYS(node_start_pfn(nid)));
+		arg.end = min_t(unsigned long, arg.end,
+				PFN_PHYS(node_end_pfn(nid)));
+	}
+	if (arg.start >= arg.end)
+		return -EINVAL;
 
-	*start = arg.start;
-	*end = arg.end;
-	return true;
+	err = walk_system_ram_res(arg.start, arg.end - 1, &arg,
+			walk_system_ram);
+	if (err < 0)
+		return err;
+	return damon_nr_regions(t) ? 0 : -EINVAL;
 }
 
-static struct damos *damon_reclaim_new_scheme(void)
+static struct damos *damon_reclaim_new_scheme(int nid)
 {
 	struct damos_watermarks wmarks = {
 		.metric = DAMOS_WMARK_FREE_MEM_RATE,
@@ -241,9 +483,22 @@ static struct damos *damon_reclaim_new_scheme(void)
 		/* Within the quota, page out older regions first. */
 		.weight_sz = 0,
 		.weight_nr_accesses = 0,
-		.weight_age = 1
+		.weight_age = 1,
+		/* Back off if the reclaimed pages come back soon. */
+		.max_refault_permil = max_refault_permil,
 	};
-	struct damos *scheme = damon_new_scheme(
+	struct damos *scheme;
+	struct damos_memcg *memcgs;
+	unsigned int i;
+	int err;
+
+	/* Check the free memory of the node, for per-node threads */
+	if (nid != NUMA_NO_NODE) {
+		wmarks.metric = DAMOS_WMARK_NODE_FREE_MEM_RATE;
+		wmarks.nid = nid;
+	}
+
+	scheme = damon_new_scheme(
 			/* Find regions having PAGE_SIZE or larger size */
 			PAGE_SIZE, ULONG_MAX,
 			/* and not accessed at all */
@@ -256,60 +511,345 @@ static struct damos *damon_reclaim_new_scheme(void)
 			&quota,
 			/* (De)activate this according to the watermarks. */
 			&wmarks);
-
+	if (!scheme || !nr_memcgs)
+		return scheme;
+
+	memcgs = kmalloc_array(nr_memcgs, sizeof(*memcgs), GFP_KERNEL);
+	if (!memcgs)
+		goto destroy_scheme_out;
+	for (i = 0; i < nr_memcgs; i++) {
+		memcgs[i] = (struct damos_memcg){
+			.id = memcg_ids[i],
+			.protected = memcg_protected[i],
+			.quota_sz = memcg_quota_szs[i],
+		};
+	}
+	err = damon_set_scheme_memcgs(scheme, memcgs, nr_memcgs);
+	kfree(memcgs);
+	if (err)
+		goto destroy_scheme_out;
 	return scheme;
+
+destroy_scheme_out:
+	damon_destroy_scheme(scheme);
+	return NULL;
 }
 
-static int damon_reclaim_turn(bool on)
+#ifdef CONFIG_MEMCG
+/*
+ * Read the number of the refaults of a memory cgroup on a node, or on the
+ * system if @nid is NUMA_NO_NODE.  Returns zero if the cgroup is not found.
+ */
+static unsigned long damon_reclaim_memcg_refaults(u64 id, int nid)
+{
+	struct cgroup_subsys_state *css;
+	struct mem_cgroup *memcg;
+	struct lruvec *lruvec;
+	struct cgroup *cgrp;
+	unsigned long refaults;
+
+	if (mem_cgroup_disabled())
+		return 0;
+
+	cgrp = cgroup_get_from_id(id);
+	if (IS_ERR_OR_NULL(cgrp))
+		return 0;
+	css = cgroup_get_e_css(cgrp, &memory_cgrp_subsys);
+	cgroup_put(cgrp);
+	if (!css)
+		return 0;
+	memcg = mem_cgroup_from_css(css);
+
+	if (nid == NUMA_NO_NODE) {
+		refaults = memcg_page_state(memcg, WORKINGSET_REFAULT_ANON) +
+			memcg_page_state(memcg, WORKINGSET_REFAULT_FILE);
+	} else {
+		lruvec = mem_cgroup_lruvec(memcg, NODE_DATA(nid));
+		refaults = lruvec_page_state(lruvec, WORKINGSET_REFAULT_ANON) +
+			lruvec_page_state(lruvec, WORKINGSET_REFAULT_FILE);
+	}
+	css_put(css);
+	return refaults;
+}
+#else
+static unsigned long damon_reclaim_memcg_refaults(u64 id, int nid)
+{
+	return 0;
+}
+#endif	/* CONFIG_MEMCG */
+
+/* Back off reclamation of the cgroup if its reclaimed pages are refaulted */
+static void damon_reclaim_adjust_memcg_quota(struct damos_memcg *dm,
+		struct damon_reclaim_memcg *m, unsigned long nr_refaults,
+		unsigned long sz_tried, unsigned long sz_applied)
+{
+	unsigned long nr_reclaimed = sz_applied / PAGE_SIZE;
+
+	if (!memcg_max_refault_permil || dm->protected)
+		return;
+
+	if (nr_reclaimed && nr_refaults * 1000 / nr_reclaimed >
+			memcg_max_refault_permil) {
+		dm->quota_sz = max(sz_applied / 2, PAGE_SIZE);
+		return;
+	}
+
+	if (dm->quota_sz == m->quota_sz)
+		return;
+	if (!m->quota_sz) {
+		/* Unlimited, once the backed off quota is not limiting */
+		dm->quota_sz = sz_tried < dm->quota_sz ? 0 : dm->quota_sz * 2;
+		return;
+	}
+	dm->quota_sz = min(dm->quota_sz * 2, m->quota_sz);
+}
+
+/*
+ * Update the memory cgroup specific stats and quotas of a DAMON thread for
+ * each quota_reset_interval_ms
+ */
+static void damon_reclaim_update_memcgs(struct damon_ctx *c, struct damos *s)
+{
+	struct damon_reclaim_memcgs *memcgs = c->callback.private;
+	unsigned long refaults, nr_refaults, sz_tried, sz_applied;
+	unsigned long total_refaults, total_applied, nr_reclaimed;
+	struct damon_reclaim_memcg *m;
+	struct damos_memcg *dm;
+	unsigned int i, j;
+
+	if (!memcgs || time_before(jiffies, memcgs->window_from +
+				msecs_to_jiffies(quota_reset_interval_ms)))
+		return;
+	memcgs->window_from = jiffies;
+
+	mem_cgroup_flush_stats();
+	mutex_lock(&damon_reclaim_memcg_lock);
+	for (i = 0; i < memcgs->nr && i < s->nr_memcgs; i++) {
+		m = &memcgs->memcgs[i];
+		dm = &s->memcgs[i];
+
+		refaults = damon_reclaim_memcg_refaults(dm->id, memcgs->nid);
+		/* The cgroup could be removed and recreated */
+		nr_refaults = refaults >= m->last_refaults ?
+			refaults - m->last_refaults : 0;
+		sz_tried = dm->stat_sz_tried - m->last_sz_tried;
+		sz_applied = dm->stat_sz_applied - m->last_sz_applied;
+		m->nr_refaults += nr_refaults;
+		m->last_refaults = refaults;
+		m->last_sz_tried = dm->stat_sz_tried;
+		m->last_sz_applied = dm->stat_sz_applied;
+
+		damon_reclaim_adjust_memcg_quota(dm, m, nr_refaults, sz_tried,
+				sz_applied);
+
+		/* Sum up the stats of all the DAMON threads */
+		total_refaults = 0;
+		total_applied = 0;
+		for (j = 0; j < nr_kdamonds; j++) {
+			struct damon_reclaim_memcgs *other;
+
+			other = ctxs[j]->callback.private;
+			if (!other || i >= other->nr)
+				continue;
+			total_refaults += other->memcgs[i].nr_refaults;
+			total_applied += other->memcgs[i].last_sz_applied;
+		}
+		nr_reclaimed = total_applied / PAGE_SIZE;
+		memcg_nr_refaults[i] = total_refaults;
+		memcg_bytes_reclaimed[i] = total_applied;
+		memcg_refault_permil[i] = nr_reclaimed ?
+			total_refaults * 1000 / nr_reclaimed : 0;
+	}
+	mutex_unlock(&damon_reclaim_memcg_lock);
+}
+
+static struct damon_reclaim_memcgs *damon_reclaim_new_memcgs(int nid)
+{
+	struct damon_reclaim_memcgs *memcgs;
+	unsigned int i;
+
+	memcgs = kzalloc(sizeof(*memcgs), GFP_KERNEL);
+	if (!memcgs)
+		return NULL;
+
+	memcgs->nid = nid;
+	memcgs->nr = nr_memcgs;
+	memcgs->window_from = jiffies;
+	mem_cgroup_flush_stats();
+	for (i = 0; i < memcgs->nr; i++) {
+		memcgs->memcgs[i].quota_sz = memcg_quota_szs[i];
+		memcgs->memcgs[i].last_refaults =
+			damon_reclaim_memcg_refaults(memcg_ids[i], nid);
+	}
+	return memcgs;
+}
+
+/* Copy the stats of the scheme of a DAMON thread to the parameters */
+static int damon_reclaim_after_aggregation(struct damon_ctx *c)
 {
-	struct damon_region *region;
+	struct damos *s;
+	unsigned int i;
+
+	for (i = 0; i < nr_kdamonds; i++) {
+		if (ctxs[i] != c)
+			continue;
+		damon_for_each_scheme(s, c) {
+			nr_reclaim_tried_regions[i] = s->stat_count;
+			bytes_reclaim_tried_regions[i] = s->stat_sz;
+			bytes_reclaimed_regions[i] = s->stat_sz_applied;
+			refault_permils[i] = s->quota.refault_permil;
+			damon_reclaim_update_memcgs(c, s);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Construct a monitoring context for the memory of a node, or of the system if
+ * @nid is NUMA_NO_NODE
+ */
+static struct damon_ctx *damon_reclaim_new_ctx(int nid)
+{
+	struct damon_ctx *ctx;
+	struct damon_target *target;
 	struct damos *scheme;
 	int err;
 
-	if (!on) {
-		err = damon_stop(&ctx, 1);
-		if (!err)
-			kdamond_pid = -1;
-		return err;
-	}
+	ctx = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	damon_pa_set_primitives(ctx);
+	ctx->callback.after_aggregation = damon_reclaim_after_aggregation;
 
 	err = damon_set_attrs(ctx, sample_interval, aggr_interval, 0,
 			min_nr_regions, max_nr_regions);
 	if (err)
-		return err;
+		goto free_ctx_out;
 
-	if (monitor_region_start > monitor_region_end)
-		return -EINVAL;
-	if (!monitor_region_start && !monitor_region_end &&
-			!get_monitoring_region(&monitor_region_start,
-				&monitor_region_end))
+	err = -ENOMEM;
+	/* 4242 means nothing but fun */
+	target = damon_new_target(4242);
+	if (!target)
+		goto free_ctx_out;
+	damon_add_target(ctx, target);
+
+	err = set_monitoring_regions(target, nid);
+	if (err)
+		goto free_ctx_out;
+
+	err = -ENOMEM;
+	scheme = damon_reclaim_new_scheme(nid);
+	if (!scheme)
+		goto free_ctx_out;
+	damon_add_scheme(ctx, scheme);
+
+	if (nr_memcgs) {
+		ctx->callback.private = damon_reclaim_new_memcgs(nid);
+		if (!ctx->callback.private)
+			goto free_ctx_out;
+	}
+
+	return ctx;
+
+free_ctx_out:
+	damon_destroy_ctx(ctx);
+	return ERR_PTR(err);
+}
+
+static void damon_reclaim_destroy_ctxs(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_kdamonds; i++) {
+		kfree(ctxs[i]->callback.private);
+		damon_destroy_ctx(ctxs[i]);
+	}
+	nr_kdamonds = 0;
+	kdamond_pid = -1;
+}
+
+/* Bind the DAMON threads to the CPUs of their nodes, and show the PIDs */
+static void damon_reclaim_set_kdamonds(int *nids)
+{
+	struct damon_ctx *ctx;
+	unsigned int i;
+
+	for (i = 0; i < nr_kdamonds; i++) {
+		ctx = ctxs[i];
+		mutex_lock(&ctx->kdamond_lock);
+		if (ctx->kdamond) {
+			if (nids[i] != NUMA_NO_NODE &&
+					!cpumask_empty(cpumask_of_node(nids[i])))
+				set_cpus_allowed_ptr(ctx->kdamond,
+						cpumask_of_node(nids[i]));
+			kdamond_pids[i] = ctx->kdamond->pid;
+		} else {
+			kdamond_pids[i] = -1;
+		}
+		mutex_unlock(&ctx->kdamond_lock);
+	}
+	kdamond_pid = kdamond_pids[0];
+}
+
+static int damon_reclaim_turn(bool on)
+{
+	static int nids[MAX_NUMNODES];
+	struct damon_ctx *ctx;
+	unsigned int i;
+	int nid, err;
+
+	if (!on) {
+		/* A thread that already finished is not an error */
+		for (i = 0; i < nr_kdamonds; i++)
+			damon_stop(&ctxs[i], 1);
+		damon_reclaim_destroy_ctxs();
+		return 0;
+	}
+
+	if (monitor_region_end && monitor_region_start > monitor_region_end)
 		return -EINVAL;
-	/* DAMON will free this on its own when finish monitoring */
-	region = damon_new_region(monitor_region_start, monitor_region_end);
-	if (!region)
-		return -ENOMEM;
-	damon_add_region(region, target);
 
-	/* Will be freed by 'damon_set_schemes()' below */
-	scheme = damon_reclaim_new_scheme();
-	if (!scheme) {
-		err = -ENOMEM;
-		goto free_region_out;
+	nr_memcgs = nr_memcg_ids;
+	memset(memcg_bytes_reclaimed, 0, sizeof(memcg_bytes_reclaimed));
+	memset(memcg_nr_refaults, 0, sizeof(memcg_nr_refaults));
+	memset(memcg_refault_permil, 0, sizeof(memcg_refault_permil));
+
+	if (!per_node) {
+		ctx = damon_reclaim_new_ctx(NUMA_NO_NODE);
+		if (IS_ERR(ctx))
+			return PTR_ERR(ctx);
+		nids[0] = NUMA_NO_NODE;
+		ctxs[nr_kdamonds++] = ctx;
+	} else {
+		for_each_node_state(nid, N_MEMORY) {
+			ctx = damon_reclaim_new_ctx(nid);
+			if (IS_ERR(ctx)) {
+				err = PTR_ERR(ctx);
+				/* Skip nodes having no System RAM to monitor */
+				if (err == -EINVAL)
+					continue;
+				goto destroy_ctxs_out;
+			}
+			nids[nr_kdamonds] = nid;
+			ctxs[nr_kdamonds++] = ctx;
+		}
+		if (!nr_kdamonds)
+			return -EINVAL;
 	}
-	err = damon_set_schemes(ctx, &scheme, 1);
-	if (err)
-		goto free_scheme_out;
 
-	err = damon_start(&ctx, 1);
+	err = damon_start(ctxs, nr_kdamonds);
 	if (!err) {
-		kdamond_pid = ctx->kdamond->pid;
+		damon_reclaim_set_kdamonds(nids);
 		return 0;
 	}
 
-free_scheme_out:
-	damon_destroy_scheme(scheme);
-free_region_out:
-	damon_destroy_region(region, target);
+	/* Stop the threads that started before the failure */
+	for (i = 0; i < nr_kdamonds; i++)
+		damon_stop(&ctxs[i], 1);
+
+destroy_ctxs_out:
+	damon_reclaim_destroy_ctxs();
 	return err;
 }
 
@@ -335,20 +875,6 @@ static DECLARE_DELAYED_WORK(damon_reclaim_timer, damon_reclaim_timer_fn);
 
 static int __init damon_reclaim_init(void)
 {
-	ctx = damon_new_ctx(DAMON_ADAPTIVE_TARGET);
-	if (!ctx)
-		return -ENOMEM;
-
-	damon_pa_set_primitives(ctx);
-
-	/* 4242 means nothing but fun */
-	target = damon_new_target(4242);
-	if (!target) {
-		damon_destroy_ctx(ctx);
-		return -ENOMEM;
-	}
-	damon_add_target(ctx, target);
-
 	schedule_delayed_work(&damon_reclaim_timer, 0);
 	return 0;
 }
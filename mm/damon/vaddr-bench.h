@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Data Access Monitor Microbenchmarks for the virtual address space primitives
+ *
+ * Measure the time that damon_va_apply_three_regions() spends for synthetic
+ * targets of 1,000 to 1,000,000 regions, and print it in nanoseconds per
+ * region.
+ */
+
+#ifdef CONFIG_DAMON_KUNIT_BENCH
+
+#ifndef _DAMON_VADDR_BENCH_H
+#define _DAMON_VADDR_BENCH_H
+
+#include <kunit/test.h>
+
+#define DAMON_VA_BENCH_REGION_SZ	(DAMON_MIN_REGION * 16)
+
+static const unsigned int damon_va_bench_nr_regions[] = {
+	1000, 10000, 100000, 1000000,
+};
+
+static void damon_va_bench_nr_regions_desc(const unsigned int *nr_regions,
+		char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%u regions", *nr_regions);
+}
+
+KUNIT_ARRAY_PARAM(damon_va_bench, damon_va_bench_nr_regions,
+		damon_va_bench_nr_regions_desc);
+
+/*
+ * Construct a target having the given number of regions in three big regions
+ * that are separated by gaps of the size of the big regions, and set the three
+ * big regions in @bregions.
+ */
+static struct damon_target *damon_va_bench_new_target(unsigned int nr_regions,
+		struct damon_addr_range bregions[3])
+{
+	unsigned int nr_per_bregion = DIV_ROUND_UP(nr_regions, 3);
+	unsigned long sz_bregion = nr_per_bregion * DAMON_VA_BENCH_REGION_SZ;
+	struct damon_target *t;
+	struct damon_region *r;
+	unsigned long start;
+	unsigned int i;
+
+	t = damon_new_target(42);
+	if (!t)
+		return NULL;
+
+	for (i = 0; i < 3; i++) {
+		bregions[i].start = i * 2 * sz_bregion;
+		bregions[i].end = bregions[i].start + sz_bregion;
+	}
+
+	for (i = 0; i < nr_regions; i++) {
+		start = bregions[i / nr_per_bregion].start +
+			i % nr_per_bregion * DAMON_VA_BENCH_REGION_SZ;
+		r = damon_new_region(start, start + DAMON_VA_BENCH_REGION_SZ);
+		if (!r) {
+			damon_free_target(t);
+			return NULL;
+		}
+		damon_add_region(r, t);
+	}
+	return t;
+}
+
+/*
+ * Apply three big regions that slightly changed, as the mappings of a process
+ * usually do between two updates
+ */
+static void damon_va_bench_apply_three_regions(struct kunit *test)
+{
+	unsigned int nr_regions = *(unsigned int *)test->param_value;
+	unsigned int nr_iters = clamp(1000000 / nr_regions, 1u, 100u);
+	struct damon_addr_range bregions[3];
+	struct damon_target *t;
+	u64 begin, ns = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < nr_iters; i++) {
+		t = damon_va_bench_new_target(nr_regions, bregions);
+		if (!t)
+			kunit_skip(test, "failed to construct the target");
+		for (j = 0; j < 3; j++) {
+			bregions[j].start += DAMON_VA_BENCH_REGION_SZ;
+			bregions[j].end += DAMON_VA_BENCH_REGION_SZ / 2;
+		}
+		begin = ktime_get_ns();
+		damon_va_apply_three_regions(t, bregions);
+		ns += ktime_get_ns() - begin;
+		damon_free_target(t);
+	}
+	kunit_info(test, "apply_three_regions: %u regions: %llu ns/region\n",
+			nr_regions, div_u64(ns, (u64)nr_regions * nr_iters));
+}
+
+static struct kunit_case damon_va_bench_cases[] = {
+	KUNIT_CASE_PARAM(damon_va_bench_apply_three_regions,
+			damon_va_bench_gen_params),
+	{},
+};
+
+static struct kunit_suite damon_va_bench_suite = {
+	.name = "damon-vaddr-bench",
+	.test_cases = damon_va_bench_cases,
+};
+kunit_test_suite(damon_va_bench_suite);
+
+#endif /* _DAMON_VADDR_BENCH_H */
+
+#endif	/* CONFIG_DAMON_KUNIT_BENCH */
@@ -8,11 +8,17 @@
 #define pr_fmt(fmt) "damon-va: " fmt
 
 #include <asm-generic/mman-common.h>
+#include <asm/tlbflush.h>
+#include <linux/bitmap.h>
+#include <linux/hashtable.h>
 #include <linux/highmem.h>
 #include <linux/hugetlb.h>
+#include <linux/mempolicy.h>
 #include <linux/mmu_notifier.h>
+#include <linux/moduleparam.h>
 #include <linux/page_idle.h>
 #include <linux/pagewalk.h>
+#include <linux/sched/mm.h>
 
 #include "prmtv-common.h"
 
@@ -358,9 +364,80 @@ static void damon_va_update(struct damon_ctx *ctx)
 	}
 }
 
+#ifdef CONFIG_MEM_SOFT_DIRTY
+/*
+ * Clear the soft-dirty bit of the pte and write-protect it, so that the next
+ * write to the page sets the bit again via the write fault.  Pages that could
+ * be DMA-pinned are skipped, as 'clear_soft_dirty()' of fs/proc/task_mmu.c
+ * does.
+ */
+static bool damon_ptep_clear_soft_dirty(pte_t *pte, struct vm_area_struct *vma,
+		unsigned long addr)
+{
+	pte_t old_pte, ptent = *pte;
+	struct page *page;
+
+	if (!pte_present(ptent) || !pte_soft_dirty(ptent))
+		return false;
+
+	if (pte_write(ptent) && is_cow_mapping(vma->vm_flags) &&
+			test_bit(MMF_HAS_PINNED, &vma->vm_mm->flags)) {
+		page = vm_normal_page(vma, addr, ptent);
+		if (page && page_maybe_dma_pinned(page))
+			return false;
+	}
+
+	old_pte = ptep_modify_prot_start(vma, addr, pte);
+	ptent = pte_wrprotect(old_pte);
+	ptent = pte_clear_soft_dirty(ptent);
+	ptep_modify_prot_commit(vma, addr, pte, old_pte, ptent);
+	return true;
+}
+
+static void damon_pmdp_clear_soft_dirty(pmd_t *pmdp,
+		struct vm_area_struct *vma, unsigned long addr)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	pmd_t old, pmd = *pmdp;
+
+	if (!pmd_present(pmd) || !pmd_soft_dirty(pmd))
+		return;
+
+	/* See comment in change_huge_pmd() */
+	old = pmdp_invalidate(vma, addr, pmdp);
+	if (pmd_dirty(old))
+		pmd = pmd_mkdirty(pmd);
+	if (pmd_young(old))
+		pmd = pmd_mkyoung(pmd);
+
+	pmd = pmd_wrprotect(pmd);
+	pmd = pmd_clear_soft_dirty(pmd);
+
+	set_pmd_at(vma->vm_mm, addr, pmdp, pmd);
+#endif	/* CONFIG_TRANSPARENT_HUGEPAGE */
+}
+#else
+static inline bool damon_ptep_clear_soft_dirty(pte_t *pte,
+		struct vm_area_struct *vma, unsigned long addr)
+{
+	return false;
+}
+
+static inline void damon_pmdp_clear_soft_dirty(pmd_t *pmdp,
+		struct vm_area_struct *vma, unsigned long addr)
+{
+}
+#endif	/* CONFIG_MEM_SOFT_DIRTY */
+
+struct damon_mkold_walk_private {
+	bool clear_soft_dirty;
+	bool need_flush;
+};
+
 static int damon_mkold_pmd_entry(pmd_t *pmd, unsigned long addr,
 		unsigned long next, struct mm_walk *walk)
 {
+	struct damon_mkold_walk_private *priv = walk->private;
 	pte_t *pte;
 	spinlock_t *ptl;
 
@@ -368,6 +445,9 @@ static int damon_mkold_pmd_entry(pmd_t *pmd, unsigned long addr,
 		ptl = pmd_lock(walk->mm, pmd);
 		if (pmd_huge(*pmd)) {
 			damon_pmdp_mkold(pmd, walk->mm, addr);
+			if (priv->clear_soft_dirty)
+				damon_pmdp_clear_soft_dirty(pmd, walk->vma,
+						addr);
 			spin_unlock(ptl);
 			return 0;
 		}
@@ -380,6 +460,9 @@ static int damon_mkold_pmd_entry(pmd_t *pmd, unsigned long addr,
 	if (!pte_present(*pte))
 		goto out;
 	damon_ptep_mkold(pte, walk->mm, addr);
+	if (priv->clear_soft_dirty &&
+			damon_ptep_clear_soft_dirty(pte, walk->vma, addr))
+		priv->need_flush = true;
 out:
 	pte_unmap_unlock(pte, ptl);
 	return 0;
@@ -391,8 +474,73 @@ static const struct mm_walk_ops damon_mkold_ops = {
 
 static void damon_va_mkold(struct mm_struct *mm, unsigned long addr)
 {
+	struct damon_mkold_walk_private arg = {
+		.clear_soft_dirty = false,
+		.need_flush = false,
+	};
+
 	mmap_read_lock(mm);
-	walk_page_range(mm, addr, addr + 1, &damon_mkold_ops, NULL);
+	walk_page_range(mm, addr, addr + 1, &damon_mkold_ops, &arg);
+	mmap_read_unlock(mm);
+}
+
+static int damon_huge_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	bool *huge = walk->private;
+
+	*huge = pmd_huge(*pmd);
+	return 0;
+}
+
+static const struct mm_walk_ops damon_huge_ops = {
+	.pmd_entry = damon_huge_pmd_entry,
+};
+
+/*
+ * Same to 'damon_va_mkold()', but also clears the soft-dirty bit of the page
+ * so that writes to the page after this call can be identified.
+ */
+static void damon_va_mkold_wr(struct mm_struct *mm, unsigned long addr)
+{
+	struct damon_mkold_walk_private arg = {
+		.clear_soft_dirty = true,
+		.need_flush = false,
+	};
+	struct mmu_notifier_range range;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	bool huge = false;
+
+	mmap_read_lock(mm);
+	vma = find_vma(mm, addr);
+	if (!vma || vma->vm_start > addr)
+		goto out;
+	addr = ALIGN_DOWN(addr, PAGE_SIZE);
+	start = addr;
+	end = addr + PAGE_SIZE;
+	/*
+	 * A huge pmd is write-protected as a whole, so invalidate the whole huge
+	 * page for the secondary MMUs.  Page tables cannot be collapsed into a
+	 * huge pmd under the read lock of mmap_lock, but a huge pmd can be split
+	 * after the check, which only makes the range wider than needed.
+	 */
+	walk_page_range(mm, addr, addr + 1, &damon_huge_ops, &huge);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (huge) {
+		start = ALIGN_DOWN(addr, HPAGE_PMD_SIZE);
+		end = start + HPAGE_PMD_SIZE;
+	}
+#endif
+	mmu_notifier_range_init(&range, MMU_NOTIFY_SOFT_DIRTY, 0, vma, mm,
+			start, end);
+	mmu_notifier_invalidate_range_start(&range);
+	walk_page_range(mm, addr, addr + 1, &damon_mkold_ops, &arg);
+	/* Huge pmds are flushed by 'pmdp_invalidate()' */
+	if (arg.need_flush)
+		flush_tlb_range(vma, addr, addr + PAGE_SIZE);
+	mmu_notifier_invalidate_range_end(&range);
+out:
 	mmap_read_unlock(mm);
 }
 
@@ -401,10 +549,14 @@ static void damon_va_mkold(struct mm_struct *mm, unsigned long addr)
  */
 
 static void __damon_va_prepare_access_check(struct damon_ctx *ctx,
-			struct mm_struct *mm, struct damon_region *r)
+			struct mm_struct *mm, struct damon_target *t,
+			struct damon_region *r)
 {
 	r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
 
+	/* Keep the accessed bit for the page granularity checks */
+	if (damon_in_zoom(ctx, t, r->sampling_addr))
+		return;
 	damon_va_mkold(mm, r->sampling_addr);
 }
 
@@ -419,7 +571,27 @@ static void damon_va_prepare_access_checks(struct damon_ctx *ctx)
 		if (!mm)
 			continue;
 		damon_for_each_region(r, t)
-			__damon_va_prepare_access_check(ctx, mm, r);
+			__damon_va_prepare_access_check(ctx, mm, t, r);
+		mmput(mm);
+	}
+}
+
+static void damon_va_wr_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct mm_struct *mm;
+	struct damon_region *r;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
+			if (damon_in_zoom(ctx, t, r->sampling_addr))
+				continue;
+			damon_va_mkold_wr(mm, r->sampling_addr);
+		}
 		mmput(mm);
 	}
 }
@@ -427,6 +599,7 @@ static void damon_va_prepare_access_checks(struct damon_ctx *ctx)
 struct damon_young_walk_private {
 	unsigned long *page_sz;
 	bool young;
+	bool written;
 };
 
 static int damon_young_pmd_entry(pmd_t *pmd, unsigned long addr,
@@ -453,6 +626,10 @@ static int damon_young_pmd_entry(pmd_t *pmd, unsigned long addr,
 			*priv->page_sz = ((1UL) << HPAGE_PMD_SHIFT);
 			priv->young = true;
 		}
+		if (pmd_soft_dirty(*pmd)) {
+			*priv->page_sz = ((1UL) << HPAGE_PMD_SHIFT);
+			priv->written = true;
+		}
 		put_page(page);
 huge_out:
 		spin_unlock(ptl);
@@ -475,6 +652,10 @@ static int damon_young_pmd_entry(pmd_t *pmd, unsigned long addr,
 		*priv->page_sz = PAGE_SIZE;
 		priv->young = true;
 	}
+	if (pte_soft_dirty(*pte)) {
+		*priv->page_sz = PAGE_SIZE;
+		priv->written = true;
+	}
 	put_page(page);
 out:
 	pte_unmap_unlock(pte, ptl);
@@ -485,34 +666,62 @@ static const struct mm_walk_ops damon_young_ops = {
 	.pmd_entry = damon_young_pmd_entry,
 };
 
+/*
+ * Check whether the page of the given address is accessed
+ *
+ * If @written is not NULL, whether the page is written after the last
+ * 'damon_va_mkold_wr()' call for the page is also stored in it.
+ */
 static bool damon_va_young(struct mm_struct *mm, unsigned long addr,
-		unsigned long *page_sz)
+		unsigned long *page_sz, bool *written)
 {
 	struct damon_young_walk_private arg = {
 		.page_sz = page_sz,
 		.young = false,
+		.written = false,
 	};
 
 	mmap_read_lock(mm);
 	walk_page_range(mm, addr, addr + 1, &damon_young_ops, &arg);
 	mmap_read_unlock(mm);
+	if (written)
+		*written = arg.written;
 	return arg.young;
 }
 
+/*
+ * Check whether the sampling address of the region is in a zoomed in range,
+ * and keep the access frequency of the last aggregation interval if so.  The
+ * accessed bit of the address is not cleared by the preparation in the case.
+ */
+static bool damon_va_zoomed(struct damon_ctx *ctx, struct damon_target *t,
+		struct damon_region *r)
+{
+	if (!damon_in_zoom(ctx, t, r->sampling_addr))
+		return false;
+	r->nr_accesses = r->last_nr_accesses;
+	return true;
+}
+
 /*
  * Check whether the region was accessed after the last preparation
  *
  * mm	'mm_struct' for the given virtual address space
+ * t	the target of the region
  * r	the region to be checked
  */
 static void __damon_va_check_access(struct damon_ctx *ctx,
-			       struct mm_struct *mm, struct damon_region *r)
+			       struct mm_struct *mm, struct damon_target *t,
+			       struct damon_region *r)
 {
 	static struct mm_struct *last_mm;
 	static unsigned long last_addr;
 	static unsigned long last_page_sz = PAGE_SIZE;
 	static bool last_accessed;
 
+	if (damon_va_zoomed(ctx, t, r))
+		return;
+
 	/* If the region is in the last checked page, reuse the result */
 	if (mm == last_mm && (ALIGN_DOWN(last_addr, last_page_sz) ==
 				ALIGN_DOWN(r->sampling_addr, last_page_sz))) {
@@ -521,7 +730,8 @@ static void __damon_va_check_access(struct damon_ctx *ctx,
 		return;
 	}
 
-	last_accessed = damon_va_young(mm, r->sampling_addr, &last_page_sz);
+	last_accessed = damon_va_young(mm, r->sampling_addr, &last_page_sz,
+			NULL);
 	if (last_accessed)
 		r->nr_accesses++;
 
@@ -541,7 +751,67 @@ static unsigned int damon_va_check_accesses(struct damon_ctx *ctx)
 		if (!mm)
 			continue;
 		damon_for_each_region(r, t) {
-			__damon_va_check_access(ctx, mm, r);
+			__damon_va_check_access(ctx, mm, t, r);
+			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
+		}
+		mmput(mm);
+	}
+
+	return max_nr_accesses;
+}
+
+/*
+ * Check whether the region was accessed and written after the last
+ * preparation
+ */
+static void __damon_va_wr_check_access(struct damon_ctx *ctx,
+			       struct mm_struct *mm, struct damon_target *t,
+			       struct damon_region *r)
+{
+	static struct mm_struct *last_mm;
+	static unsigned long last_addr;
+	static unsigned long last_page_sz = PAGE_SIZE;
+	static bool last_accessed;
+	static bool last_written;
+
+	if (damon_va_zoomed(ctx, t, r))
+		return;
+
+	/* If the region is in the last checked page, reuse the result */
+	if (mm == last_mm && (ALIGN_DOWN(last_addr, last_page_sz) ==
+				ALIGN_DOWN(r->sampling_addr, last_page_sz))) {
+		if (last_accessed)
+			r->nr_accesses++;
+		if (last_written)
+			r->nr_writes++;
+		return;
+	}
+
+	last_accessed = damon_va_young(mm, r->sampling_addr, &last_page_sz,
+			&last_written);
+	/* A write is also an access */
+	if (last_accessed || last_written)
+		r->nr_accesses++;
+	if (last_written)
+		r->nr_writes++;
+
+	last_mm = mm;
+	last_addr = r->sampling_addr;
+}
+
+static unsigned int damon_va_wr_check_accesses(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct mm_struct *mm;
+	struct damon_region *r;
+	unsigned int max_nr_accesses = 0;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			__damon_va_wr_check_access(ctx, mm, t, r);
 			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
 		}
 		mmput(mm);
@@ -550,6 +820,136 @@ static unsigned int damon_va_check_accesses(struct damon_ctx *ctx)
 	return max_nr_accesses;
 }
 
+/*
+ * Functions for the page granularity access checks of zoomed in ranges
+ */
+
+static int damon_mkold_range_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+
+	if (pmd_huge(*pmd)) {
+		ptl = pmd_lock(walk->mm, pmd);
+		if (pmd_huge(*pmd)) {
+			damon_pmdp_mkold(pmd, walk->mm, addr);
+			spin_unlock(ptl);
+			return 0;
+		}
+		spin_unlock(ptl);
+	}
+
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)))
+		return 0;
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr < next; pte++, addr += PAGE_SIZE) {
+		if (pte_present(*pte))
+			damon_ptep_mkold(pte, walk->mm, addr);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static const struct mm_walk_ops damon_mkold_range_ops = {
+	.pmd_entry = damon_mkold_range_pmd_entry,
+};
+
+static void damon_va_prepare_page_access_checks(struct damon_ctx *ctx,
+		struct damon_target *t, struct damon_addr_range *ar)
+{
+	struct mm_struct *mm;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return;
+	mmap_read_lock(mm);
+	walk_page_range(mm, ar->start, ar->end, &damon_mkold_range_ops, NULL);
+	mmap_read_unlock(mm);
+	mmput(mm);
+}
+
+struct damon_young_range_walk_private {
+	unsigned long start;
+	unsigned long *bitmap;
+};
+
+static int damon_young_range_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	struct damon_young_range_walk_private *priv = walk->private;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+	struct page *page;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_huge(*pmd)) {
+		ptl = pmd_lock(walk->mm, pmd);
+		if (!pmd_huge(*pmd)) {
+			spin_unlock(ptl);
+			goto regular_page;
+		}
+		page = damon_get_page(pmd_pfn(*pmd));
+		if (!page)
+			goto huge_out;
+		if (pmd_young(*pmd) || !page_is_idle(page) ||
+				mmu_notifier_test_young(walk->mm, addr))
+			bitmap_set(priv->bitmap,
+					(addr - priv->start) / PAGE_SIZE,
+					(next - addr) / PAGE_SIZE);
+		put_page(page);
+huge_out:
+		spin_unlock(ptl);
+		return 0;
+	}
+
+regular_page:
+#endif	/* CONFIG_TRANSPARENT_HUGEPAGE */
+
+	if (pmd_none(*pmd) || unlikely(pmd_bad(*pmd)))
+		return 0;
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr < next; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte))
+			continue;
+		page = damon_get_page(pte_pfn(*pte));
+		if (!page)
+			continue;
+		if (pte_young(*pte) || !page_is_idle(page) ||
+				mmu_notifier_test_young(walk->mm, addr))
+			__set_bit((addr - priv->start) / PAGE_SIZE,
+					priv->bitmap);
+		put_page(page);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static const struct mm_walk_ops damon_young_range_ops = {
+	.pmd_entry = damon_young_range_pmd_entry,
+};
+
+static void damon_va_check_page_accesses(struct damon_ctx *ctx,
+		struct damon_target *t, struct damon_addr_range *ar,
+		unsigned long *bitmap)
+{
+	struct damon_young_range_walk_private arg = {
+		.start = ar->start,
+		.bitmap = bitmap,
+	};
+	struct mm_struct *mm;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return;
+	mmap_read_lock(mm);
+	walk_page_range(mm, ar->start, ar->end, &damon_young_range_ops, &arg);
+	mmap_read_unlock(mm);
+	mmput(mm);
+}
+
 /*
  * Functions for the target validity check and cleanup
  */
@@ -569,59 +969,91 @@ bool damon_va_target_valid(void *target)
 }
 
 #ifndef CONFIG_ADVISE_SYSCALLS
-static int damos_madvise(struct damon_target *target, struct damon_region *r,
-			int behavior)
+static int damos_madvise(struct damon_target *target, struct damos *scheme,
+		struct damon_addr_range *ranges, unsigned int nr_ranges,
+		int behavior)
 {
 	return -EINVAL;
 }
 #else
-static int damos_madvise(struct damon_target *target, struct damon_region *r,
-			int behavior)
+/* Apply madvise() to address ranges of a target, getting its mm once */
+static int damos_madvise(struct damon_target *target, struct damos *scheme,
+		struct damon_addr_range *ranges, unsigned int nr_ranges,
+		int behavior)
 {
 	struct mm_struct *mm;
-	int ret = -ENOMEM;
+	unsigned int i;
+	int err, ret = -ENOMEM;
 
 	mm = damon_get_mm(target);
 	if (!mm)
 		goto out;
 
-	ret = do_madvise(mm, PAGE_ALIGN(r->ar.start),
-			PAGE_ALIGN(r->ar.end - r->ar.start), behavior);
+	ret = 0;
+	for (i = 0; i < nr_ranges; i++) {
+		err = do_madvise(mm, PAGE_ALIGN(ranges[i].start),
+				PAGE_ALIGN(ranges[i].end - ranges[i].start),
+				behavior);
+		if (err) {
+			scheme->stat_nr_failed++;
+			ret = err;
+		} else {
+			scheme->stat_sz_applied +=
+				ranges[i].end - ranges[i].start;
+		}
+		cond_resched();
+	}
 	mmput(mm);
 out:
 	return ret;
 }
 #endif	/* CONFIG_ADVISE_SYSCALLS */
 
-static int damon_va_apply_scheme(struct damon_ctx *ctx, struct damon_target *t,
-		struct damon_region *r, struct damos *scheme)
+/* Returns the madvise() behavior for a DAMOS action, or -EINVAL if none */
+static int damos_madv_behavior(enum damos_action action)
 {
-	int madv_action;
-
-	switch (scheme->action) {
+	switch (action) {
 	case DAMOS_WILLNEED:
-		madv_action = MADV_WILLNEED;
-		break;
+		return MADV_WILLNEED;
 	case DAMOS_COLD:
-		madv_action = MADV_COLD;
-		break;
+		return MADV_COLD;
 	case DAMOS_PAGEOUT:
-		madv_action = MADV_PAGEOUT;
-		break;
+		return MADV_PAGEOUT;
 	case DAMOS_HUGEPAGE:
-		madv_action = MADV_HUGEPAGE;
-		break;
+		return MADV_HUGEPAGE;
 	case DAMOS_NOHUGEPAGE:
-		madv_action = MADV_NOHUGEPAGE;
-		break;
-	case DAMOS_STAT:
-		return 0;
+		return MADV_NOHUGEPAGE;
+	case DAMOS_MERGEABLE:
+		return MADV_MERGEABLE;
+	case DAMOS_UNMERGEABLE:
+		return MADV_UNMERGEABLE;
 	default:
+		return -EINVAL;
+	}
+}
+
+static int damon_va_apply_scheme_ranges(struct damon_ctx *ctx,
+		struct damon_target *t, struct damos *scheme,
+		struct damon_addr_range *ranges, unsigned int nr_ranges)
+{
+	int madv_action;
+
+	if (scheme->action == DAMOS_STAT)
+		return 0;
+
+	madv_action = damos_madv_behavior(scheme->action);
+	if (madv_action < 0) {
 		pr_warn("Wrong action %d\n", scheme->action);
 		return -EINVAL;
 	}
 
-	return damos_madvise(t, r, madv_action);
+	return damos_madvise(t, scheme, ranges, nr_ranges, madv_action);
+}
+
+static int damon_va_apply_scheme(struct damon_ctx *ctx, struct damon_target *t,
+		struct damon_region *r, struct damos *scheme)
+{
+	return damon_va_apply_scheme_ranges(ctx, t, scheme, &r->ar, 1);
 }
 
 static int damon_va_scheme_score(struct damon_ctx *context,
@@ -631,7 +1063,10 @@ static int damon_va_scheme_score(struct damon_ctx *context,
 
 	switch (scheme->action) {
 	case DAMOS_PAGEOUT:
+	case DAMOS_MERGEABLE:
 		return damon_pageout_score(context, r, scheme);
+	case DAMOS_UNMERGEABLE:
+		return damon_hot_score(context, r, scheme);
 	default:
 		break;
 	}
@@ -646,10 +1081,425 @@ void damon_va_set_primitives(struct damon_ctx *ctx)
 	ctx->primitive.prepare_access_checks = damon_va_prepare_access_checks;
 	ctx->primitive.check_accesses = damon_va_check_accesses;
 	ctx->primitive.reset_aggregated = NULL;
+	ctx->primitive.prepare_page_access_checks =
+		damon_va_prepare_page_access_checks;
+	ctx->primitive.check_page_accesses = damon_va_check_page_accesses;
 	ctx->primitive.target_valid = damon_va_target_valid;
 	ctx->primitive.cleanup = NULL;
 	ctx->primitive.apply_scheme = damon_va_apply_scheme;
+	ctx->primitive.apply_scheme_ranges = damon_va_apply_scheme_ranges;
 	ctx->primitive.get_scheme_score = damon_va_scheme_score;
 }
 
+/*
+ * Set the virtual address spaces monitoring primitives that check not only
+ * accesses but also writes to each region, using the soft-dirty bits of the
+ * page table entries.  The results of the write checks are stored in
+ * &damon_region->nr_writes.  Because the soft-dirty tracking write-protects
+ * the sampled pages, this incurs one write fault per written sample page.
+ * Without CONFIG_MEM_SOFT_DIRTY, &damon_region->nr_writes is always zero.
+ */
+void damon_va_set_wr_primitives(struct damon_ctx *ctx)
+{
+	damon_va_set_primitives(ctx);
+	ctx->primitive.prepare_access_checks =
+		damon_va_wr_prepare_access_checks;
+	ctx->primitive.check_accesses = damon_va_wr_check_accesses;
+}
+
+/* Returns whether @ctx is set by damon_va_set_wr_primitives() */
+bool damon_va_checks_writes(struct damon_ctx *ctx)
+{
+	return ctx->primitive.check_accesses == damon_va_wr_check_accesses;
+}
+
+#ifdef CONFIG_DAMON_VADDR_PF
+
+/*
+ * Page fault based access sampling
+ *
+ * The accessed bit is not set by some access paths, including some device
+ * and virtualization setups.  For such cases, below primitives make the
+ * sampled page inaccessible using the NUMA hinting protection
+ * ('change_prot_numa()') and record the hinting page fault that the next
+ * access to the page triggers.  The page fault handler restores the page table
+ * entry by itself.
+ *
+ * Note that the page faults are handled as the usual NUMA hinting page faults.
+ * Hence, those are accounted to the monitored tasks via 'task_numa_fault()',
+ * and could make the NUMA balancing migrate the sampled pages.
+ */
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "damon_va_pf."
+
+/*
+ * Maximum number of sample page faults per second.
+ *
+ * Each sample makes at most one page fault.  DAMON arms no more than this
+ * number of samples within each one second, so that the page fault overhead
+ * of the monitored processes is bounded.  Regions that could not be sampled
+ * due to this limit are not counted as accessed.  If the value is zero, the
+ * limit is disabled.  10,000 by default.
+ */
+static unsigned long max_faults_per_sec __read_mostly = 10000;
+module_param(max_faults_per_sec, ulong, 0600);
+
+/* Total number of the sample page faults that recorded. */
+static unsigned long nr_faults __read_mostly;
+module_param(nr_faults, ulong, 0400);
+
+/* Total number of the samples that skipped due to 'max_faults_per_sec'. */
+static unsigned long nr_throttled __read_mostly;
+module_param(nr_throttled, ulong, 0400);
+
+/* Average time for arming a sample in the last sampling, in nanoseconds. */
+static unsigned long sample_overhead_ns __read_mostly;
+module_param(sample_overhead_ns, ulong, 0400);
+
+/*
+ * struct damon_va_pf_sample - A sample page that armed for the page fault.
+ * @hnode:	Node of 'damon_va_pf_samples' hash table.
+ * @list:	List head for freeing the sample.
+ * @rcu:	RCU head for freeing the sample.
+ * @ctx:	The context that armed this sample.
+ * @mm:		The address space of the sample, pinned by 'mmgrab()'.
+ * @start:	Start address of the armed page.
+ * @end:	End address of the armed page.
+ * @fallback:	Whether the accessed bit is used instead of the page fault.
+ * @nr_faults:	Number of the recorded page faults.
+ */
+struct damon_va_pf_sample {
+	struct hlist_node hnode;
+	struct list_head list;
+	struct rcu_head rcu;
+	struct damon_ctx *ctx;
+	struct mm_struct *mm;
+	unsigned long start;
+	unsigned long end;
+	bool fallback;
+	atomic_t nr_faults;
+};
+
+/*
+ * The page fault handlers look up the samples under 'rcu_read_lock()' only.
+ * 'damon_va_pf_lock' serializes the updates of the hash table, which are made
+ * by the kdamonds only.  'damon_va_pf_enabled' is enabled while any context
+ * using the page fault based primitives is running.
+ */
+DEFINE_STATIC_KEY_FALSE(damon_va_pf_enabled);
+static DEFINE_HASHTABLE(damon_va_pf_samples, 10);
+static DEFINE_SPINLOCK(damon_va_pf_lock);
+static atomic_t damon_va_pf_nr_armed = ATOMIC_INIT(0);
+
+/*
+ * Number of samples armed in current one second window.  The window is shared
+ * by all kdamonds, and protected by 'damon_va_pf_stat_lock' together with the
+ * statistics parameters.
+ */
+static unsigned long damon_va_pf_window_armed;
+static unsigned long damon_va_pf_window_start;
+static DEFINE_SPINLOCK(damon_va_pf_stat_lock);
+
+/* Samples are hashed by the PMD-aligned address to cover huge pages */
+#define damon_va_pf_key(mm, addr) \
+	((unsigned long)(mm) ^ ((addr) >> PMD_SHIFT))
+
+/*
+ * Record a page fault to a sample page, if any.  Called from the page fault
+ * handlers via 'damon_va_page_fault()'.
+ */
+void __damon_va_page_fault(struct mm_struct *mm, unsigned long addr)
+{
+	struct damon_va_pf_sample *s;
+
+	if (!atomic_read(&damon_va_pf_nr_armed))
+		return;
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(damon_va_pf_samples, s, hnode,
+			damon_va_pf_key(mm, addr)) {
+		if (s->mm == mm && s->start <= addr && addr < s->end) {
+			atomic_inc(&s->nr_faults);
+			break;
+		}
+	}
+	rcu_read_unlock();
+}
+
+/* Release a sample that unlinked from the hash table */
+static void damon_va_pf_free(struct damon_va_pf_sample *s)
+{
+	mmdrop(s->mm);
+	kfree_rcu(s, rcu);
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int damon_va_pf_huge_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	bool *huge = walk->private;
+
+	*huge = pmd_trans_huge(*pmd);
+	return 0;
+}
+
+static const struct mm_walk_ops damon_va_pf_huge_ops = {
+	.pmd_entry = damon_va_pf_huge_pmd_entry,
+};
+
+/* Returns whether the given address is mapped by a huge page */
+static bool damon_va_pf_huge(struct mm_struct *mm, unsigned long addr)
+{
+	bool huge = false;
+
+	walk_page_range(mm, addr, addr + 1, &damon_va_pf_huge_ops, &huge);
+	return huge;
+}
+#endif
+
+/* Returns whether a sample can be armed in the current one second window */
+static bool damon_va_pf_budget_left(void)
+{
+	unsigned long max_faults = READ_ONCE(max_faults_per_sec);
+	bool ret = true;
+
+	spin_lock(&damon_va_pf_stat_lock);
+	if (time_after_eq(jiffies, damon_va_pf_window_start + HZ)) {
+		damon_va_pf_window_start = jiffies;
+		damon_va_pf_window_armed = 0;
+	}
+	if (max_faults && damon_va_pf_window_armed >= max_faults)
+		ret = false;
+	else
+		damon_va_pf_window_armed++;
+	spin_unlock(&damon_va_pf_stat_lock);
+	return ret;
+}
+
+/*
+ * Make the page of the given address inaccessible so that the next access to
+ * the page makes a page fault.  If the page cannot be made so, the accessed
+ * bit of the page is cleared instead, and later checked.
+ */
+static void damon_va_pf_arm(struct damon_ctx *ctx, struct mm_struct *mm,
+		unsigned long addr)
+{
+	struct damon_mkold_walk_private mkold_arg = {
+		.clear_soft_dirty = false,
+		.need_flush = false,
+	};
+	struct damon_va_pf_sample *s;
+	struct vm_area_struct *vma;
+
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return;
+	s->ctx = ctx;
+	mmgrab(mm);
+	s->mm = mm;
+	s->start = ALIGN_DOWN(addr, PAGE_SIZE);
+	s->end = s->start + PAGE_SIZE;
+	s->fallback = true;
+	atomic_set(&s->nr_faults, 0);
+
+	mmap_read_lock(mm);
+	vma = find_vma(mm, addr);
+	if (!vma || vma->vm_start > addr || !vma_is_accessible(vma) ||
+			!vma_migratable(vma) || is_vm_hugetlb_page(vma) ||
+			(vma->vm_flags & VM_MIXEDMAP))
+		goto fallback;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* Arm the entire huge page, as 'change_prot_numa()' splits it */
+	if (damon_va_pf_huge(mm, addr)) {
+		s->start = ALIGN_DOWN(addr, HPAGE_PMD_SIZE);
+		s->end = s->start + HPAGE_PMD_SIZE;
+		if (s->start < vma->vm_start || vma->vm_end < s->end)
+			goto fallback;
+	}
+#endif
+
+	/* The page fault could happen before the change is done */
+	spin_lock(&damon_va_pf_lock);
+	s->fallback = false;
+	hash_add_rcu(damon_va_pf_samples, &s->hnode, damon_va_pf_key(mm, addr));
+	atomic_inc(&damon_va_pf_nr_armed);
+	spin_unlock(&damon_va_pf_lock);
+
+	change_prot_numa(vma, s->start, s->end);
+	mmap_read_unlock(mm);
+	return;
+
+fallback:
+	walk_page_range(mm, addr, addr + 1, &damon_mkold_ops, &mkold_arg);
+	mmap_read_unlock(mm);
+	spin_lock(&damon_va_pf_lock);
+	hash_add_rcu(damon_va_pf_samples, &s->hnode, damon_va_pf_key(mm, addr));
+	atomic_inc(&damon_va_pf_nr_armed);
+	spin_unlock(&damon_va_pf_lock);
+}
+
+/* Find, unlink and return the sample of the given address */
+static struct damon_va_pf_sample *damon_va_pf_take(struct damon_ctx *ctx,
+		struct mm_struct *mm, unsigned long addr)
+{
+	struct damon_va_pf_sample *s, *found = NULL;
+
+	spin_lock(&damon_va_pf_lock);
+	hash_for_each_possible(damon_va_pf_samples, s, hnode,
+			damon_va_pf_key(mm, addr)) {
+		if (s->ctx == ctx && s->mm == mm && s->start <= addr &&
+				addr < s->end) {
+			hash_del_rcu(&s->hnode);
+			atomic_dec(&damon_va_pf_nr_armed);
+			found = s;
+			break;
+		}
+	}
+	spin_unlock(&damon_va_pf_lock);
+	return found;
+}
+
+/* Free samples of the context that could not be taken, e.g., for dead mm */
+static void damon_va_pf_flush(struct damon_ctx *ctx)
+{
+	struct damon_va_pf_sample *s, *next;
+	struct hlist_node *tmp;
+	int bkt;
+	LIST_HEAD(freelist);
+
+	spin_lock(&damon_va_pf_lock);
+	hash_for_each_safe(damon_va_pf_samples, bkt, tmp, s, hnode) {
+		if (s->ctx != ctx)
+			continue;
+		hash_del_rcu(&s->hnode);
+		atomic_dec(&damon_va_pf_nr_armed);
+		list_add(&s->list, &freelist);
+	}
+	spin_unlock(&damon_va_pf_lock);
+
+	list_for_each_entry_safe(s, next, &freelist, list)
+		damon_va_pf_free(s);
+}
+
+static void damon_va_pf_init(struct damon_ctx *ctx)
+{
+	static_branch_inc(&damon_va_pf_enabled);
+	damon_va_init(ctx);
+}
+
+static void damon_va_pf_cleanup(struct damon_ctx *ctx)
+{
+	damon_va_pf_flush(ctx);
+	static_branch_dec(&damon_va_pf_enabled);
+}
+
+static void damon_va_pf_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+	struct mm_struct *mm;
+	struct damon_region *r;
+	unsigned long nr_armed = 0, nr_skipped = 0;
+	u64 begin = ktime_get_ns();
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			r->sampling_addr = damon_rand(r->ar.start, r->ar.end);
+			if (damon_in_zoom(ctx, t, r->sampling_addr))
+				continue;
+			if (!damon_va_pf_budget_left()) {
+				nr_skipped++;
+				continue;
+			}
+			damon_va_pf_arm(ctx, mm, r->sampling_addr);
+			nr_armed++;
+		}
+		mmput(mm);
+	}
+
+	spin_lock(&damon_va_pf_stat_lock);
+	WRITE_ONCE(nr_throttled, nr_throttled + nr_skipped);
+	if (nr_armed)
+		WRITE_ONCE(sample_overhead_ns,
+				(ktime_get_ns() - begin) / nr_armed);
+	spin_unlock(&damon_va_pf_stat_lock);
+}
+
+static unsigned int damon_va_pf_check_accesses(struct damon_ctx *ctx)
+{
+	struct damon_va_pf_sample *s;
+	struct damon_target *t;
+	struct mm_struct *mm;
+	struct damon_region *r;
+	unsigned long page_sz, nr_recorded = 0;
+	unsigned int max_nr_accesses = 0;
+	bool accessed;
+
+	damon_for_each_target(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			if (damon_va_zoomed(ctx, t, r)) {
+				max_nr_accesses = max(r->nr_accesses,
+						max_nr_accesses);
+				continue;
+			}
+			s = damon_va_pf_take(ctx, mm, r->sampling_addr);
+			if (!s)
+				continue;
+			accessed = atomic_read(&s->nr_faults);
+			nr_recorded += atomic_read(&s->nr_faults);
+			if (!accessed && s->fallback)
+				accessed = damon_va_young(mm, r->sampling_addr,
+						&page_sz, NULL);
+			if (accessed)
+				r->nr_accesses++;
+			damon_va_pf_free(s);
+			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
+		}
+		mmput(mm);
+	}
+	damon_va_pf_flush(ctx);
+
+	spin_lock(&damon_va_pf_stat_lock);
+	WRITE_ONCE(nr_faults, nr_faults + nr_recorded);
+	spin_unlock(&damon_va_pf_stat_lock);
+
+	return max_nr_accesses;
+}
+
+/*
+ * Set the virtual address spaces monitoring primitives that use the page
+ * faults instead of the accessed bits for the access checks.  Each sampling
+ * incurs one page fault per accessed sample page.  The number of the page
+ * faults per second can be limited via 'damon_va_pf.max_faults_per_sec'
+ * parameter, and the average time for arming each sample is shown via
+ * 'damon_va_pf.sample_overhead_ns' parameter.
+ */
+void damon_va_set_pf_primitives(struct damon_ctx *ctx)
+{
+	damon_va_set_primitives(ctx);
+	ctx->primitive.init = damon_va_pf_init;
+	ctx->primitive.prepare_access_checks =
+		damon_va_pf_prepare_access_checks;
+	ctx->primitive.check_accesses = damon_va_pf_check_accesses;
+	ctx->primitive.cleanup = damon_va_pf_cleanup;
+}
+
+/* Returns whether @ctx is set by damon_va_set_pf_primitives() */
+bool damon_va_checks_faults(struct damon_ctx *ctx)
+{
+	return ctx->primitive.check_accesses == damon_va_pf_check_accesses;
+}
+
+#endif	/* CONFIG_DAMON_VADDR_PF */
+
 #include "vaddr-test.h"
+#include "vaddr-bench.h"
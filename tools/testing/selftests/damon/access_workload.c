@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Synthetic workload having known hot and cold memory for the DAMON
+ * monitoring accuracy evaluation.
+ *
+ * The workload maps an anonymous buffer, populates it, and then runs a number
+ * of phases of a fixed duration.  In each phase, it repeatedly writes every
+ * cache line of a hot set that consists of a few chunks of the buffer, and
+ * never touches the remaining cold memory.  The hot chunks of each phase are
+ * picked by a pseudo-random generator, so that the hot set moves between the
+ * phases.
+ *
+ * The output is line based so that the evaluation script can parse it:
+ *
+ *	buffer <start address in hex> <size in bytes>
+ *	phase <index> <start ns> <end ns> <start>-<end> [<start>-<end>...]
+ *	result <number of accessed cache lines> <elapsed ns>
+ *
+ * The hot chunks are printed as offsets from the start of the buffer, and the
+ * timestamps are in CLOCK_MONOTONIC.  The phases start only after a line is
+ * read from stdin, so that the caller can attach the monitor after the buffer
+ * is populated.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHELINE_SZ	64
+
+struct workload {
+	unsigned long sz;
+	unsigned long hot_sz;
+	unsigned int nr_chunks;
+	unsigned int nr_phases;
+	unsigned long phase_ms;
+	unsigned int seed;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int next_rand(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed / 65536) % 32768;
+}
+
+/* Pick @nr distinct chunk indices out of @nr_slots and sort them */
+static void pick_chunks(unsigned long *chunks, unsigned int nr,
+		unsigned long nr_slots, unsigned int *seed)
+{
+	unsigned int i, j;
+	unsigned long tmp;
+	bool dup;
+
+	for (i = 0; i < nr; i++) {
+		do {
+			chunks[i] = ((unsigned long)next_rand(seed) << 15 |
+					next_rand(seed)) % nr_slots;
+			dup = false;
+			for (j = 0; j < i; j++)
+				if (chunks[j] == chunks[i])
+					dup = true;
+		} while (dup);
+	}
+	for (i = 0; i < nr; i++) {
+		for (j = i + 1; j < nr; j++) {
+			if (chunks[j] < chunks[i]) {
+				tmp = chunks[i];
+				chunks[i] = chunks[j];
+				chunks[j] = tmp;
+			}
+		}
+	}
+}
+
+static unsigned long long run_phase(char *buf, unsigned long *chunks,
+		unsigned long chunk_sz, unsigned int nr_chunks,
+		unsigned long long deadline)
+{
+	unsigned long long nr_accesses = 0;
+	unsigned long off;
+	unsigned int i;
+
+	while (now_ns() < deadline) {
+		for (i = 0; i < nr_chunks; i++) {
+			char *chunk = buf + chunks[i] * chunk_sz;
+
+			for (off = 0; off < chunk_sz; off += CACHELINE_SZ)
+				(*(volatile unsigned long *)(chunk + off))++;
+			nr_accesses += chunk_sz / CACHELINE_SZ;
+		}
+	}
+	return nr_accesses;
+}
+
+static int run(struct workload *w)
+{
+	unsigned long chunk_sz = w->hot_sz / w->nr_chunks;
+	unsigned long long start, phase_start, nr_accesses = 0;
+	unsigned long *chunks;
+	unsigned int i, j;
+	char line[16];
+	char *buf;
+
+	buf = mmap(NULL, w->sz, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	/* The page idle tracking works in the granularity of base pages */
+	if (madvise(buf, w->sz, MADV_NOHUGEPAGE) && errno != EINVAL)
+		perror("madvise");
+	memset(buf, 1, w->sz);
+
+	chunks = calloc(w->nr_chunks, sizeof(*chunks));
+	if (!chunks) {
+		perror("calloc");
+		return 1;
+	}
+
+	printf("buffer %lx %lu\n", (unsigned long)buf, w->sz);
+	fflush(stdout);
+	if (!fgets(line, sizeof(line), stdin))
+		return 1;
+
+	start = now_ns();
+	for (i = 0; i < w->nr_phases; i++) {
+		pick_chunks(chunks, w->nr_chunks, w->sz / chunk_sz, &w->seed);
+		phase_start = now_ns();
+		nr_accesses += run_phase(buf, chunks, chunk_sz, w->nr_chunks,
+				phase_start + w->phase_ms * 1000000);
+		printf("phase %u %llu %llu", i, phase_start, now_ns());
+		for (j = 0; j < w->nr_chunks; j++)
+			printf(" %lu-%lu", chunks[j] * chunk_sz,
+					(chunks[j] + 1) * chunk_sz);
+		printf("\n");
+		fflush(stdout);
+	}
+	printf("result %llu %llu\n", nr_accesses, now_ns() - start);
+
+	free(chunks);
+	munmap(buf, w->sz);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s size_mib] [-H hot_mib] [-c nr_hot_chunks]\n"
+		"\t\t[-p nr_phases] [-t phase_ms] [-r seed]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct workload w = {
+		.sz = 256 << 20,
+		.hot_sz = 32 << 20,
+		.nr_chunks = 4,
+		.nr_phases = 3,
+		.phase_ms = 2000,
+		.seed = 42,
+	};
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:H:c:p:t:r:")) != -1) {
+		switch (opt) {
+		case 's':
+			w.sz = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'H':
+			w.hot_sz = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'c':
+			w.nr_chunks = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			w.nr_phases = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			w.phase_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			w.seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!w.nr_chunks || w.hot_sz / w.nr_chunks < CACHELINE_SZ ||
+			w.hot_sz % w.nr_chunks || w.hot_sz > w.sz ||
+			(w.hot_sz / w.nr_chunks) % sysconf(_SC_PAGESIZE)) {
+		fprintf(stderr, "hot chunks should be page aligned and fit\n");
+		usage(argv[0]);
+	}
+
+	return run(&w);
+}
@@ -0,0 +1,496 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+
+"""
+Evaluate the accuracy and the overhead of DAMON's monitoring of the virtual
+address space of a process.
+
+The synthetic workload ('access_workload') is run three times.
+
+1. Alone, to get its baseline performance.
+2. With the page idle tracking based ground truth collector
+   ('page_idle_truth').  This cannot share the run with DAMON, as both clear
+   the accessed bits of the page table entries.
+3. With DAMON, configured via the debugfs interface.  The monitoring results
+   are read from the 'damon:damon_aggregated' tracepoint, and the CPU time of
+   the kdamond is read from procfs.
+
+For each phase of the workload, regions that DAMON reports as hot are compared
+against the pages that the ground truth shows as hot, and the precision and
+the recall of the hot memory are reported, together with the slowdown of the
+workload and the CPU usage of the kdamond.  The first part of each phase is
+excluded from the scoring, to give DAMON time to adapt to the phase change.
+
+Exit code is 4 (skip) if the environment doesn't support the evaluation, 1 if
+a given '--min_*' or '--max_*' limit is violated, and 0 otherwise.  Hence,
+sampling or region splitting changes can be judged on accuracy versus overhead
+by running this before and after the change, with the same arguments.
+"""
+
+import argparse
+import json
+import os
+import re
+import select
+import signal
+import subprocess
+import sys
+
+KSFT_SKIP = 4
+
+DBGFS = '/sys/kernel/debug/damon'
+PAGE_IDLE_BITMAP = '/sys/kernel/mm/page_idle/bitmap'
+TRACEFS_CANDIDATES = ['/sys/kernel/tracing', '/sys/kernel/debug/tracing']
+
+BIN_DIR = os.path.dirname(os.path.abspath(__file__))
+WORKLOAD = os.path.join(BIN_DIR, 'access_workload')
+TRUTH = os.path.join(BIN_DIR, 'page_idle_truth')
+
+TRACE_RE = re.compile(r'\s(\d+\.\d+): damon_aggregated: target_id=\d+ '
+        r'nr_regions=\d+ (\d+)-(\d+): (\d+) ')
+
+def skip(reason):
+    print('SKIP: %s' % reason)
+    sys.exit(KSFT_SKIP)
+
+def write_file(path, content):
+    with open(path, 'w') as f:
+        f.write(content)
+
+def read_file(path):
+    with open(path, 'r') as f:
+        return f.read().strip()
+
+# Intervals are sorted lists of non-overlapping [start, end) tuples.
+
+def intervals_sz(intervals):
+    return sum(end - start for start, end in intervals)
+
+def intervals_intersect(a, b):
+    result = []
+    i = j = 0
+    while i < len(a) and j < len(b):
+        start = max(a[i][0], b[j][0])
+        end = min(a[i][1], b[j][1])
+        if start < end:
+            result.append((start, end))
+        if a[i][1] < b[j][1]:
+            i += 1
+        else:
+            j += 1
+    return result
+
+def parse_ranges(fields):
+    ranges = []
+    for field in fields:
+        start, end = field.split('-')
+        ranges.append((int(start), int(end)))
+    return ranges
+
+class Workload:
+    def __init__(self, args):
+        self.cmd = [WORKLOAD, '-s', str(args.size_mib),
+                '-H', str(args.hot_mib), '-c', str(args.nr_hot_chunks),
+                '-p', str(args.nr_phases), '-t', str(args.phase_ms),
+                '-r', str(args.seed)]
+        self.proc = None
+        self.base = None
+        self.size = None
+        self.phases = []        # (start ns, end ns, hot intervals)
+        self.nr_accesses = None
+        self.elapsed_ns = None
+
+    def start(self):
+        """Start the workload and wait until its buffer is populated"""
+        self.proc = subprocess.Popen(self.cmd, stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE, universal_newlines=True)
+        fields = self.proc.stdout.readline().split()
+        if len(fields) != 3 or fields[0] != 'buffer':
+            self.proc.kill()
+            raise Exception('unexpected output of the workload')
+        self.base = int(fields[1], 16)
+        self.size = int(fields[2])
+
+    def go(self):
+        """Start the phases"""
+        self.proc.stdin.write('go\n')
+        self.proc.stdin.flush()
+
+    def wait(self):
+        """Wait until the workload finishes and parse its results"""
+        for line in self.proc.stdout:
+            fields = line.split()
+            if fields[0] == 'phase':
+                self.phases.append((int(fields[2]), int(fields[3]),
+                    parse_ranges(fields[4:])))
+            elif fields[0] == 'result':
+                self.nr_accesses = int(fields[1])
+                self.elapsed_ns = int(fields[2])
+        if self.proc.wait() != 0 or self.elapsed_ns is None:
+            raise Exception('the workload failed')
+
+    def rate(self):
+        return self.nr_accesses * 1e9 / self.elapsed_ns
+
+def run_baseline(args):
+    workload = Workload(args)
+    workload.start()
+    workload.go()
+    workload.wait()
+    return workload
+
+def run_truth(args):
+    """Return the workload and the (start ns, end ns, accessed intervals) of
+    each ground truth interval"""
+    workload = Workload(args)
+    workload.start()
+    collector = subprocess.Popen([TRUTH, str(workload.proc.pid),
+        '%x' % workload.base, str(workload.size), str(args.truth_ms)],
+        stdout=subprocess.PIPE, universal_newlines=True)
+    workload.go()
+    workload.wait()
+    collector.send_signal(signal.SIGTERM)
+    out, _ = collector.communicate()
+    if collector.returncode != 0:
+        raise Exception('the ground truth collector failed')
+
+    snapshots = []
+    for line in out.splitlines():
+        fields = line.split()
+        snapshots.append((int(fields[0]), int(fields[1]),
+            parse_ranges(fields[2:])))
+    return workload, snapshots
+
+class Tracer:
+    """Read the damon_aggregated tracepoint events in CLOCK_MONOTONIC"""
+    def __init__(self):
+        self.dir = None
+        for candidate in TRACEFS_CANDIDATES:
+            if os.path.isdir(os.path.join(candidate, 'events', 'damon')):
+                self.dir = candidate
+                break
+        self.enable_file = None
+        if self.dir:
+            self.enable_file = os.path.join(self.dir, 'events', 'damon',
+                    'damon_aggregated', 'enable')
+        self.fd = None
+        self.buf = ''
+        self.records = []
+
+    def file(self, name):
+        return os.path.join(self.dir, name)
+
+    def start(self):
+        self.orig_clock = re.search(r'\[(\S+)\]',
+                read_file(self.file('trace_clock'))).group(1)
+        write_file(self.file('trace_clock'), 'mono')
+        write_file(self.file('trace'), '')
+        write_file(self.enable_file, '1')
+        self.fd = os.open(self.file('trace_pipe'), os.O_RDONLY | os.O_NONBLOCK)
+
+    def poll(self, timeout):
+        """Consume the pending events, waiting for @timeout seconds"""
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return
+        try:
+            data = os.read(self.fd, 1 << 20)
+        except BlockingIOError:
+            return
+        lines = (self.buf + data.decode(errors='replace')).split('\n')
+        self.buf = lines[-1]
+        for line in lines[:-1]:
+            match = TRACE_RE.search(line)
+            if not match:
+                continue
+            self.records.append((int(float(match.group(1)) * 1e9),
+                int(match.group(2)), int(match.group(3)),
+                int(match.group(4))))
+
+    def stop(self):
+        write_file(self.enable_file, '0')
+        self.poll(0.1)
+        while True:
+            nr_records = len(self.records)
+            self.poll(0)
+            if len(self.records) == nr_records:
+                break
+        os.close(self.fd)
+        write_file(self.file('trace_clock'), self.orig_clock)
+
+    def snapshots(self):
+        """Return (ns, [(start, end, nr_accesses)...]) of each aggregation.
+
+        The regions of an aggregation are traced in the address order, so an
+        address lower than the previous one starts a new aggregation.
+        """
+        snapshots = []
+        last_start = None
+        for ns, start, end, nr_accesses in self.records:
+            if last_start is None or start <= last_start:
+                snapshots.append((ns, []))
+            snapshots[-1][1].append((start, end, nr_accesses))
+            last_start = start
+        return snapshots
+
+def kdamond_cpu_ticks(pid):
+    fields = read_file('/proc/%d/stat' % pid).rsplit(')', 1)[1].split()
+    # utime and stime, the 14th and the 15th fields
+    return int(fields[11]) + int(fields[12])
+
+def run_damon(args):
+    """Return the workload, the DAMON snapshots, the kdamond CPU seconds, and
+    the region split policy that used"""
+    tracer = Tracer()
+    attrs_file = os.path.join(DBGFS, 'attrs')
+    target_ids_file = os.path.join(DBGFS, 'target_ids')
+    split_policy_file = os.path.join(DBGFS, 'split_policy')
+    monitor_on_file = os.path.join(DBGFS, 'monitor_on')
+    orig_attrs = read_file(attrs_file)
+    orig_target_ids = read_file(target_ids_file)
+    orig_split_policy = None
+    if os.path.isfile(split_policy_file):
+        orig_split_policy = read_file(split_policy_file)
+
+    workload = Workload(args)
+    workload.start()
+    write_file(attrs_file, '%d %d %d %d %d' % (args.sample_us, args.aggr_us,
+        args.update_us, args.min_nr_regions, args.max_nr_regions))
+    write_file(target_ids_file, '%d' % workload.proc.pid)
+    if args.split_policy:
+        write_file(split_policy_file, args.split_policy)
+    split_policy = args.split_policy or orig_split_policy
+    tracer.start()
+    write_file(monitor_on_file, 'on')
+    try:
+        kdamond = int(read_file(os.path.join(DBGFS, 'kdamond_pid')))
+        ticks = kdamond_cpu_ticks(kdamond)
+        workload.go()
+        while workload.proc.poll() is None:
+            tracer.poll(0.1)
+        ticks = kdamond_cpu_ticks(kdamond) - ticks
+    finally:
+        write_file(monitor_on_file, 'off')
+        tracer.stop()
+        write_file(attrs_file, orig_attrs)
+        write_file(target_ids_file, orig_target_ids)
+        if args.split_policy:
+            write_file(split_policy_file, orig_split_policy)
+
+    workload.wait()
+    return (workload, tracer.snapshots(),
+            ticks / os.sysconf('SC_CLK_TCK'), split_policy)
+
+def truth_hot(truth, start_ns, end_ns, thres_percent):
+    """Pages that are accessed in more than @thres_percent of the ground truth
+    intervals in the given time window"""
+    counts = {}
+    nr_snapshots = 0
+    for snap_start, snap_end, accessed in truth:
+        if snap_start < start_ns or snap_end > end_ns:
+            continue
+        nr_snapshots += 1
+        for start, end in accessed:
+            counts[(start, end)] = counts.get((start, end), 0) + 1
+    if not nr_snapshots:
+        return None
+
+    # Split the accessed ranges into the boundaries and count accesses
+    events = {}
+    for (start, end), count in counts.items():
+        events[start] = events.get(start, 0) + count
+        events[end] = events.get(end, 0) - count
+    hot = []
+    nr_accessed = 0
+    hot_start = None
+    for addr in sorted(events):
+        nr_accessed += events[addr]
+        is_hot = nr_accessed * 100 > nr_snapshots * thres_percent
+        if is_hot and hot_start is None:
+            hot_start = addr
+        elif not is_hot and hot_start is not None:
+            hot.append((hot_start, addr))
+            hot_start = None
+    return hot
+
+def damon_hot(snapshot, base, size, min_nr_accesses):
+    hot = []
+    for start, end, nr_accesses in snapshot:
+        if nr_accesses < min_nr_accesses:
+            continue
+        start = max(start, base) - base
+        end = min(end, base + size) - base
+        if start >= end:
+            continue
+        if hot and hot[-1][1] == start:
+            hot[-1] = (hot[-1][0], end)
+        else:
+            hot.append((start, end))
+    return hot
+
+def precision_recall(answer, truth):
+    common = intervals_sz(intervals_intersect(answer, truth))
+    precision = common / intervals_sz(answer) if answer else 0.0
+    recall = common / intervals_sz(truth) if truth else 1.0
+    return precision, recall
+
+def score(args, truth_workload, truth, damon_workload, snapshots):
+    max_nr_accesses = args.aggr_us // args.sample_us
+    min_nr_accesses = max(1, -(-max_nr_accesses * args.hot_thres // 100))
+    warmup_ns = args.warmup_ms * 1000000
+    aggr_ns = args.aggr_us * 1000
+    results = []
+    for i, (start, end, declared) in enumerate(damon_workload.phases):
+        t_start, t_end, _ = truth_workload.phases[i]
+        hot = truth_hot(truth, t_start + warmup_ns, t_end, args.truth_thres)
+        if hot is None:
+            print('phase %d: no ground truth in the window' % i)
+            continue
+        precisions = []
+        recalls = []
+        for ns, snapshot in snapshots:
+            # Each snapshot is for the aggregation interval that ended at ns
+            if ns - aggr_ns < start + warmup_ns or ns > end:
+                continue
+            precision, recall = precision_recall(damon_hot(snapshot,
+                damon_workload.base, damon_workload.size, min_nr_accesses),
+                hot)
+            precisions.append(precision)
+            recalls.append(recall)
+        if not precisions:
+            print('phase %d: no DAMON snapshot in the window' % i)
+            continue
+        truth_precision, truth_recall = precision_recall(hot, declared)
+        results.append({
+            'phase': i,
+            'truth_hot_bytes': intervals_sz(hot),
+            'declared_hot_bytes': intervals_sz(declared),
+            'truth_precision': truth_precision,
+            'truth_recall': truth_recall,
+            'nr_snapshots': len(precisions),
+            'precision': sum(precisions) / len(precisions),
+            'recall': sum(recalls) / len(recalls),
+            })
+    return results
+
+def check_env(args):
+    if os.geteuid() != 0:
+        skip('run as root')
+    for f in ['attrs', 'target_ids', 'monitor_on', 'kdamond_pid']:
+        if not os.path.isfile(os.path.join(DBGFS, f)):
+            skip('%s not found' % os.path.join(DBGFS, f))
+    if args.split_policy and \
+            not os.path.isfile(os.path.join(DBGFS, 'split_policy')):
+        skip('%s not found' % os.path.join(DBGFS, 'split_policy'))
+    if read_file(os.path.join(DBGFS, 'monitor_on')) != 'off':
+        skip('DAMON is already running')
+    if not os.path.isfile(PAGE_IDLE_BITMAP):
+        skip('%s not found (CONFIG_IDLE_PAGE_TRACKING)' % PAGE_IDLE_BITMAP)
+    if not Tracer().dir:
+        skip('tracefs or the damon events not found')
+    for binary in [WORKLOAD, TRUTH]:
+        if not os.access(binary, os.X_OK):
+            skip('%s not found; build it first' % binary)
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+            formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--size_mib', type=int, default=256,
+            help='size of the workload buffer')
+    parser.add_argument('--hot_mib', type=int, default=32,
+            help='size of the hot memory of each phase')
+    parser.add_argument('--nr_hot_chunks', type=int, default=4,
+            help='number of the chunks that the hot memory is split into')
+    parser.add_argument('--nr_phases', type=int, default=3,
+            help='number of the workload phases')
+    parser.add_argument('--phase_ms', type=int, default=3000,
+            help='duration of each phase')
+    parser.add_argument('--seed', type=int, default=42,
+            help='seed for the hot chunks placement')
+    parser.add_argument('--sample_us', type=int, default=5000,
+            help='DAMON sampling interval')
+    parser.add_argument('--aggr_us', type=int, default=100000,
+            help='DAMON aggregation interval')
+    parser.add_argument('--update_us', type=int, default=1000000,
+            help='DAMON primitive update interval')
+    parser.add_argument('--min_nr_regions', type=int, default=10,
+            help='DAMON minimum number of regions')
+    parser.add_argument('--max_nr_regions', type=int, default=1000,
+            help='DAMON maximum number of regions')
+    parser.add_argument('--split_policy', choices=['random', 'gradient'],
+            help='DAMON region split policy (default: keep the current one)')
+    parser.add_argument('--truth_ms', type=int, default=100,
+            help='interval of the ground truth collection')
+    parser.add_argument('--warmup_ms', type=int, default=1000,
+            help='time from the start of each phase to exclude')
+    parser.add_argument('--hot_thres', type=int, default=10,
+            help='min nr_accesses of DAMON hot regions, in percent of max')
+    parser.add_argument('--truth_thres', type=int, default=50,
+            help='min percent of the truth intervals a hot page is accessed')
+    parser.add_argument('--min_precision', type=float,
+            help='fail if the average precision is lower than this')
+    parser.add_argument('--min_recall', type=float,
+            help='fail if the average recall is lower than this')
+    parser.add_argument('--max_slowdown', type=float,
+            help='fail if the workload slowdown percent is higher than this')
+    parser.add_argument('--json', metavar='FILE',
+            help='write the results to the file in json')
+    args = parser.parse_args()
+
+    check_env(args)
+
+    baseline = run_baseline(args)
+    truth_workload, truth = run_truth(args)
+    damon_workload, snapshots, kdamond_secs, split_policy = run_damon(args)
+    phases = score(args, truth_workload, truth, damon_workload, snapshots)
+    if not phases:
+        print('FAIL: no phase was scored')
+        return 1
+
+    result = {
+        'split_policy': split_policy,
+        'phases': phases,
+        'precision': sum(p['precision'] for p in phases) / len(phases),
+        'recall': sum(p['recall'] for p in phases) / len(phases),
+        'slowdown_percent': (baseline.rate() / damon_workload.rate() - 1) *
+            100,
+        'kdamond_cpu_secs': kdamond_secs,
+        'kdamond_cpu_percent': kdamond_secs * 1e9 /
+            damon_workload.elapsed_ns * 100,
+        }
+
+    # truth_prec and truth_rec compare the ground truth against the hot
+    # memory that the workload declared, as a sanity check of the collection
+    print('%-6s %12s %10s %10s %10s %10s %10s' % ('phase', 'truth_hot',
+        'truth_prec', 'truth_rec', 'snapshots', 'precision', 'recall'))
+    for p in phases:
+        print('%-6d %12d %10.3f %10.3f %10d %10.3f %10.3f' % (p['phase'],
+            p['truth_hot_bytes'], p['truth_precision'], p['truth_recall'],
+            p['nr_snapshots'], p['precision'], p['recall']))
+    print('split policy: %s' % result['split_policy'])
+    print('precision: %.3f' % result['precision'])
+    print('recall: %.3f' % result['recall'])
+    print('workload slowdown: %.2f %%' % result['slowdown_percent'])
+    print('kdamond cpu: %.3f s (%.2f %%)' % (result['kdamond_cpu_secs'],
+        result['kdamond_cpu_percent']))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=4)
+
+    failed = False
+    if args.min_precision is not None and \
+            result['precision'] < args.min_precision:
+        print('FAIL: precision is lower than %f' % args.min_precision)
+        failed = True
+    if args.min_recall is not None and result['recall'] < args.min_recall:
+        print('FAIL: recall is lower than %f' % args.min_recall)
+        failed = True
+    if args.max_slowdown is not None and \
+            result['slowdown_percent'] > args.max_slowdown:
+        print('FAIL: slowdown is higher than %f %%' % args.max_slowdown)
+        failed = True
+    return 1 if failed else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
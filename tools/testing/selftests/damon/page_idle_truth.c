@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Ground truth of the accesses to a memory area of a process, for the DAMON
+ * monitoring accuracy evaluation.
+ *
+ * For every interval, mark the pages of the area idle using the page idle
+ * tracking, wait for the interval, and read which of the pages have been
+ * accessed since then.  The physical frame numbers of the pages are read from
+ * /proc/<pid>/pagemap, so this needs CONFIG_IDLE_PAGE_TRACKING and the root
+ * permission.
+ *
+ * The output has one line per interval:
+ *
+ *	<start ns> <end ns> [<start>-<end>...]
+ *
+ * where the ranges are the accessed parts of the area, as offsets from the
+ * start of the area, and the timestamps are in CLOCK_MONOTONIC.  The
+ * collection continues until the process exits or SIGTERM is received.
+ *
+ * Note that this should not run together with DAMON, as both clear the
+ * accessed bits of the page table entries and would hide accesses from each
+ * other.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PAGE_IDLE_BITMAP	"/sys/kernel/mm/page_idle/bitmap"
+
+#define PM_PFN_MASK		((1ULL << 55) - 1)
+#define PM_PRESENT		(1ULL << 63)
+
+/*
+ * Words of the idle bitmap that are closer than this are read and written in
+ * one system call
+ */
+#define MAX_WORDS_GAP		64
+
+static volatile sig_atomic_t stop;
+
+static void sigterm_handler(int signo)
+{
+	stop = 1;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct pfn_ent {
+	uint64_t pfn;
+	unsigned long idx;	/* index of the page in the area */
+};
+
+static int cmp_pfn_ent(const void *a, const void *b)
+{
+	uint64_t x = ((const struct pfn_ent *)a)->pfn;
+	uint64_t y = ((const struct pfn_ent *)b)->pfn;
+
+	return x < y ? -1 : x > y;
+}
+
+struct area {
+	int pagemap_fd;
+	int bitmap_fd;
+	unsigned long start;
+	unsigned long nr_pages;
+	unsigned long page_sz;
+	uint64_t *entries;	/* pagemap entries of the pages */
+	struct pfn_ent *pfns;	/* present pages, sorted by the pfn */
+	unsigned long nr_pfns;
+	char *accessed;		/* whether each page has been accessed */
+	uint64_t *words;	/* buffer for the idle bitmap */
+	unsigned long nr_words;
+};
+
+static int read_pagemap(struct area *a)
+{
+	size_t sz = a->nr_pages * sizeof(*a->entries);
+	unsigned long i;
+
+	if (pread(a->pagemap_fd, a->entries, sz,
+			a->start / a->page_sz * sizeof(*a->entries)) !=
+			(ssize_t)sz)
+		return -1;
+
+	a->nr_pfns = 0;
+	for (i = 0; i < a->nr_pages; i++) {
+		if (!(a->entries[i] & PM_PRESENT))
+			continue;
+		a->pfns[a->nr_pfns].pfn = a->entries[i] & PM_PFN_MASK;
+		a->pfns[a->nr_pfns++].idx = i;
+	}
+	qsort(a->pfns, a->nr_pfns, sizeof(*a->pfns), cmp_pfn_ent);
+	return 0;
+}
+
+/*
+ * Call @fn for each run of the idle bitmap words that cover the pfns of the
+ * area, after setting the bits of the @nr pfns in the run in @a->words
+ */
+static int for_each_words_run(struct area *a,
+		int (*fn)(struct area *a, uint64_t first, uint64_t nr_words,
+			struct pfn_ent *pfns, unsigned long nr))
+{
+	unsigned long i = 0, j;
+	uint64_t first, last, w;
+
+	while (i < a->nr_pfns) {
+		first = last = a->pfns[i].pfn / 64;
+		for (j = i + 1; j < a->nr_pfns; j++) {
+			w = a->pfns[j].pfn / 64;
+			if (w - last > MAX_WORDS_GAP ||
+					w - first >= a->nr_words)
+				break;
+			last = w;
+		}
+		memset(a->words, 0, (last - first + 1) * sizeof(*a->words));
+		for (w = i; w < j; w++)
+			a->words[a->pfns[w].pfn / 64 - first] |=
+				1ULL << (a->pfns[w].pfn % 64);
+		if (fn(a, first, last - first + 1, &a->pfns[i], j - i))
+			return -1;
+		i = j;
+	}
+	return 0;
+}
+
+static int set_idle(struct area *a, uint64_t first, uint64_t nr_words,
+		struct pfn_ent *pfns, unsigned long nr)
+{
+	size_t sz = nr_words * sizeof(*a->words);
+
+	if (pwrite(a->bitmap_fd, a->words, sz, first * sizeof(*a->words)) !=
+			(ssize_t)sz) {
+		perror("write " PAGE_IDLE_BITMAP);
+		return -1;
+	}
+	return 0;
+}
+
+static int get_idle(struct area *a, uint64_t first, uint64_t nr_words,
+		struct pfn_ent *pfns, unsigned long nr)
+{
+	size_t sz = nr_words * sizeof(*a->words);
+	unsigned long i;
+	uint64_t pfn;
+
+	if (pread(a->bitmap_fd, a->words, sz, first * sizeof(*a->words)) !=
+			(ssize_t)sz) {
+		perror("read " PAGE_IDLE_BITMAP);
+		return -1;
+	}
+	for (i = 0; i < nr; i++) {
+		pfn = pfns[i].pfn;
+		a->accessed[pfns[i].idx] =
+			!(a->words[pfn / 64 - first] & (1ULL << (pfn % 64)));
+	}
+	return 0;
+}
+
+static void print_accessed(struct area *a)
+{
+	unsigned long i, range_start = 0;
+	int in_range = 0;
+
+	for (i = 0; i <= a->nr_pages; i++) {
+		if (i < a->nr_pages && a->accessed[i]) {
+			if (!in_range)
+				range_start = i;
+			in_range = 1;
+		} else if (in_range) {
+			printf(" %lu-%lu", range_start * a->page_sz,
+					i * a->page_sz);
+			in_range = 0;
+		}
+	}
+}
+
+static int collect(struct area *a, unsigned long interval_ms)
+{
+	unsigned long long start, end;
+	struct timespec interval = {
+		.tv_sec = interval_ms / 1000,
+		.tv_nsec = interval_ms % 1000 * 1000000,
+	};
+
+	if (read_pagemap(a) || for_each_words_run(a, set_idle))
+		return -1;
+	while (!stop) {
+		start = now_ns();
+		nanosleep(&interval, NULL);
+		memset(a->accessed, 0, a->nr_pages);
+		if (for_each_words_run(a, get_idle))
+			return -1;
+		end = now_ns();
+		printf("%llu %llu", start, end);
+		print_accessed(a);
+		printf("\n");
+		fflush(stdout);
+
+		/* The target exited */
+		if (read_pagemap(a))
+			break;
+		if (for_each_words_run(a, set_idle))
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct area a = {};
+	char path[64];
+	int ret;
+
+	if (argc != 5) {
+		fprintf(stderr,
+			"Usage: %s <pid> <start address in hex> <size> <interval_ms>\n",
+			argv[0]);
+		return 1;
+	}
+
+	a.start = strtoul(argv[2], NULL, 16);
+	a.page_sz = sysconf(_SC_PAGESIZE);
+	a.nr_pages = strtoul(argv[3], NULL, 0) / a.page_sz;
+	a.nr_words = a.nr_pages + MAX_WORDS_GAP;
+	a.entries = calloc(a.nr_pages, sizeof(*a.entries));
+	a.pfns = calloc(a.nr_pages, sizeof(*a.pfns));
+	a.accessed = calloc(a.nr_pages, 1);
+	a.words = calloc(a.nr_words, sizeof(*a.words));
+	if (!a.entries || !a.pfns || !a.accessed || !a.words) {
+		perror("calloc");
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%s/pagemap", argv[1]);
+	a.pagemap_fd = open(path, O_RDONLY);
+	if (a.pagemap_fd < 0) {
+		perror(path);
+		return 1;
+	}
+	a.bitmap_fd = open(PAGE_IDLE_BITMAP, O_RDWR);
+	if (a.bitmap_fd < 0) {
+		perror(PAGE_IDLE_BITMAP);
+		return 1;
+	}
+
+	signal(SIGTERM, sigterm_handler);
+	ret = collect(&a, strtoul(argv[4], NULL, 0));
+
+	close(a.bitmap_fd);
+	close(a.pagemap_fd);
+	return ret ? 1 : 0;
+}
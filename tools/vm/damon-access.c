@@ -0,0 +1,989 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * damon-access: Tool for recording, replaying, and reporting the data access
+ * patterns that DAMON monitored
+ *
+ * Example use:
+ * ./damon-access record -o damon.rec -d 60 $(pidof workload)
+ * ./damon-access report -r heatmap damon.rec
+ * ./damon-access report -r wss damon.rec
+ * ./damon-access replay -m 512 -r wss damon.rec
+ *
+ * 'record' configures the DAMON debugfs interface to monitor the given
+ * processes, or the physical address space if 'paddr' is given, and writes
+ * the aggregation snapshots that read from the mmap()-ed ring buffer of DAMON
+ * to the record file.  If no target is given, it reads the snapshots of the
+ * already running monitoring, which should have the ring buffer set.
+ *
+ * 'replay' maps anonymous memory for the monitored address ranges of the
+ * record, with the gaps between those removed, and accesses the memory with
+ * the recorded frequencies of the regions over the recorded time.  The memory
+ * is scaled down by a power of two to fit in the size given by '-m'.
+ *
+ * 'report' shows the access heatmap or the working set size distribution of
+ * a record.  'record' and 'replay' can show the report of what they recorded
+ * or replayed with '-r'.
+ *
+ * See Documentation/admin-guide/mm/damon/ for DAMON.
+ *
+ * Record file format
+ * ==================
+ *
+ * The file starts with a header of little endian fields:
+ *
+ *	char magic[8]		"DAMONREC"
+ *	u32 version		DAMON_REC_VERSION
+ *	u32 hdr_sz		size of the header including the target ids
+ *	u64 sample_us		sampling interval of the monitoring
+ *	u64 aggr_us		aggregation interval of the monitoring
+ *	u32 nr_targets		number of the monitoring targets
+ *	u32 reserved
+ *	u64 target_ids[nr_targets]
+ *
+ * Fields could be appended to the header before the target ids in future, so
+ * readers should skip to @hdr_sz from the target ids.  The version is
+ * increased only for incompatible changes.
+ *
+ * The header is followed by the snapshots, each of which is a sequence of
+ * unsigned LEB128 numbers:
+ *
+ *	time_ns delta from the previous snapshot (from the first snapshot for
+ *		the first one)
+ *	for each target:
+ *		nr_regions
+ *		for each region, in the address order:
+ *			start - end of the previous region (zero for the
+ *				first region)
+ *			end - start
+ *			nr_accesses
+ *			age
+ */
+
+#define _GNU_SOURCE
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../../include/uapi/linux/damon.h"
+#include <api/fs/fs.h>
+
+#define MAX_PATH		256
+
+#define DAMON_REC_MAGIC		"DAMONREC"
+#define DAMON_REC_VERSION	1
+#define DAMON_REC_MAX_TARGETS	32	/* same to the debugfs interface */
+
+struct rec_region {
+	uint64_t start;
+	uint64_t end;
+	uint32_t nr_accesses;
+	uint32_t age;
+	unsigned int target;
+};
+
+struct rec_snapshot {
+	uint64_t time_ns;
+	unsigned long nr_regions;
+	struct rec_region *regions;
+};
+
+/* An address range of a target that mapped to the packed address space */
+struct rec_area {
+	unsigned int target;
+	uint64_t start;
+	uint64_t end;
+	uint64_t off;
+};
+
+struct rec {
+	uint64_t sample_us;
+	uint64_t aggr_us;
+	unsigned int nr_targets;
+	uint64_t target_ids[DAMON_REC_MAX_TARGETS];
+	unsigned long nr_snapshots;
+	struct rec_snapshot *snapshots;
+
+	/* The monitored ranges of all snapshots without the gaps */
+	unsigned long nr_areas;
+	struct rec_area *areas;
+	uint64_t packed_sz;
+};
+
+enum report_type {
+	REPORT_NONE,
+	REPORT_HEATMAP,
+	REPORT_WSS,
+};
+
+static const char * const report_types[] = {
+	[REPORT_NONE] = "none",
+	[REPORT_HEATMAP] = "heatmap",
+	[REPORT_WSS] = "wss",
+};
+
+static const char *opt_output = "damon.rec";
+static unsigned long opt_duration;
+static unsigned long opt_ring_sz = 4 << 20;
+static unsigned long opt_max_sz = 1UL << 30;
+static enum report_type opt_report;
+static unsigned int opt_rows = 24;
+static unsigned int opt_cols = 72;
+
+static long page_size;
+static char damon_dir[MAX_PATH / 2];
+static volatile sig_atomic_t stop;
+
+static void fatal(const char *x, ...)
+{
+	va_list ap;
+
+	va_start(ap, x);
+	vfprintf(stderr, x, ap);
+	va_end(ap);
+	exit(EXIT_FAILURE);
+}
+
+static void *xcalloc(size_t nmemb, size_t size)
+{
+	void *p = calloc(nmemb, size);
+
+	if (!p)
+		fatal("out of memory\n");
+	return p;
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	void *p = realloc(ptr, size);
+
+	if (!p)
+		fatal("out of memory\n");
+	return p;
+}
+
+static void sig_handler(int signo __attribute__((unused)))
+{
+	stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Record file encoding
+ */
+
+static void put_le32(FILE *f, uint32_t v)
+{
+	v = htole32(v);
+	fwrite(&v, sizeof(v), 1, f);
+}
+
+static void put_le64(FILE *f, uint64_t v)
+{
+	v = htole64(v);
+	fwrite(&v, sizeof(v), 1, f);
+}
+
+static void put_uleb(FILE *f, uint64_t v)
+{
+	do {
+		uint8_t byte = v & 0x7f;
+
+		v >>= 7;
+		if (v)
+			byte |= 0x80;
+		fputc(byte, f);
+	} while (v);
+}
+
+static uint32_t get_le32(FILE *f)
+{
+	uint32_t v;
+
+	if (fread(&v, sizeof(v), 1, f) != 1)
+		fatal("truncated record header\n");
+	return le32toh(v);
+}
+
+static uint64_t get_le64(FILE *f)
+{
+	uint64_t v;
+
+	if (fread(&v, sizeof(v), 1, f) != 1)
+		fatal("truncated record header\n");
+	return le64toh(v);
+}
+
+/* Returns 0 on success, 1 on EOF before the number, or -1 on error */
+static int get_uleb(FILE *f, uint64_t *v)
+{
+	unsigned int shift = 0;
+	int c;
+
+	*v = 0;
+	while ((c = fgetc(f)) != EOF) {
+		if (shift > 63)
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+		shift += 7;
+	}
+	return shift ? -1 : 1;
+}
+
+static void rec_write_hdr(FILE *f, struct rec *rec)
+{
+	unsigned int i;
+
+	fwrite(DAMON_REC_MAGIC, 8, 1, f);
+	put_le32(f, DAMON_REC_VERSION);
+	put_le32(f, 40 + rec->nr_targets * 8);
+	put_le64(f, rec->sample_us);
+	put_le64(f, rec->aggr_us);
+	put_le32(f, rec->nr_targets);
+	put_le32(f, 0);
+	for (i = 0; i < rec->nr_targets; i++)
+		put_le64(f, rec->target_ids[i]);
+}
+
+/* Write a snapshot of the ring buffer, which is fully in the buffer */
+static void rec_write_snapshot(FILE *f, struct rec *rec,
+		struct damon_ring_snapshot *snapshot, uint64_t *last_ns)
+{
+	struct damon_ring_target *rt = (void *)(snapshot + 1);
+	struct damon_ring_region *rr;
+	uint64_t prev_end;
+	unsigned int i, j;
+
+	if (snapshot->nr_targets != rec->nr_targets)
+		fatal("the number of targets changed to %u\n",
+				snapshot->nr_targets);
+
+	put_uleb(f, *last_ns ? snapshot->time_ns - *last_ns : 0);
+	*last_ns = snapshot->time_ns;
+	for (i = 0; i < snapshot->nr_targets; i++) {
+		rr = (void *)(rt + 1);
+		prev_end = 0;
+		put_uleb(f, rt->nr_regions);
+		for (j = 0; j < rt->nr_regions; j++, rr++) {
+			if (rr->start < prev_end || rr->end < rr->start)
+				fatal("unsorted regions in a snapshot\n");
+			put_uleb(f, rr->start - prev_end);
+			put_uleb(f, rr->end - rr->start);
+			put_uleb(f, rr->nr_accesses);
+			put_uleb(f, rr->age);
+			prev_end = rr->end;
+		}
+		rt = (void *)rr;
+	}
+}
+
+/* Returns false if the file ended before the snapshot */
+static bool rec_read_snapshot(FILE *f, struct rec *rec,
+		struct rec_snapshot *snapshot, uint64_t last_ns)
+{
+	unsigned long nr_allocated = 0;
+	uint64_t v, nr_regions, prev_end, j;
+	struct rec_region *r;
+	unsigned int i;
+	int err;
+
+	err = get_uleb(f, &v);
+	if (err > 0)
+		return false;
+	if (err)
+		goto truncated;
+	snapshot->time_ns = last_ns + v;
+	snapshot->nr_regions = 0;
+	snapshot->regions = NULL;
+
+	for (i = 0; i < rec->nr_targets; i++) {
+		if (get_uleb(f, &nr_regions))
+			goto truncated;
+		prev_end = 0;
+		for (j = 0; j < nr_regions; j++) {
+			if (snapshot->nr_regions == nr_allocated) {
+				nr_allocated = nr_allocated * 2 ?: 64;
+				snapshot->regions = xrealloc(snapshot->regions,
+						nr_allocated * sizeof(*r));
+			}
+			r = &snapshot->regions[snapshot->nr_regions++];
+			r->target = i;
+			if (get_uleb(f, &v))
+				goto truncated;
+			r->start = prev_end + v;
+			if (get_uleb(f, &v))
+				goto truncated;
+			r->end = r->start + v;
+			if (get_uleb(f, &v))
+				goto truncated;
+			r->nr_accesses = v;
+			if (get_uleb(f, &v))
+				goto truncated;
+			r->age = v;
+			prev_end = r->end;
+		}
+	}
+	return true;
+
+truncated:
+	fatal("truncated or corrupted snapshot %lu\n", rec->nr_snapshots);
+	return false;
+}
+
+static int cmp_area(const void *p1, const void *p2)
+{
+	const struct rec_area *a1 = p1, *a2 = p2;
+
+	if (a1->target != a2->target)
+		return a1->target < a2->target ? -1 : 1;
+	if (a1->start != a2->start)
+		return a1->start < a2->start ? -1 : 1;
+	return 0;
+}
+
+/* Find the areas of the monitored ranges, and pack those without the gaps */
+static void rec_pack(struct rec *rec)
+{
+	unsigned long i, j, nr = 0, nr_merged = 0;
+	struct rec_snapshot *s;
+	struct rec_area *a;
+
+	for (i = 0; i < rec->nr_snapshots; i++)
+		nr += rec->snapshots[i].nr_regions;
+	a = xcalloc(nr ?: 1, sizeof(*a));
+	nr = 0;
+	for (i = 0; i < rec->nr_snapshots; i++) {
+		s = &rec->snapshots[i];
+		for (j = 0; j < s->nr_regions; j++, nr++) {
+			a[nr].target = s->regions[j].target;
+			a[nr].start = s->regions[j].start;
+			a[nr].end = s->regions[j].end;
+		}
+	}
+	qsort(a, nr, sizeof(*a), cmp_area);
+
+	rec->packed_sz = 0;
+	for (i = 0; i < nr; i++) {
+		if (nr_merged && a[nr_merged - 1].target == a[i].target &&
+				a[nr_merged - 1].end >= a[i].start) {
+			if (a[i].end > a[nr_merged - 1].end) {
+				rec->packed_sz += a[i].end -
+					a[nr_merged - 1].end;
+				a[nr_merged - 1].end = a[i].end;
+			}
+			continue;
+		}
+		a[nr_merged] = a[i];
+		a[nr_merged].off = rec->packed_sz;
+		rec->packed_sz += a[i].end - a[i].start;
+		nr_merged++;
+	}
+	rec->areas = a;
+	rec->nr_areas = nr_merged;
+}
+
+/* Returns the offset of the start of a region in the packed address space */
+static uint64_t rec_packed_off(struct rec *rec, struct rec_region *r)
+{
+	unsigned long lo = 0, hi = rec->nr_areas, mid;
+	struct rec_area key = { .target = r->target, .start = r->start };
+	struct rec_area *a;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		a = &rec->areas[mid];
+		if (cmp_area(a, &key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	/* lo is the first area that starts after the region */
+	a = &rec->areas[lo - 1];
+	return a->off + r->start - a->start;
+}
+
+static void rec_load(const char *path, struct rec *rec)
+{
+	unsigned long nr_allocated = 0;
+	char magic[8];
+	uint32_t version, hdr_sz;
+	uint64_t last_ns = 0;
+	unsigned int i;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		fatal("open %s: %s\n", path, strerror(errno));
+	if (fread(magic, sizeof(magic), 1, f) != 1 ||
+			memcmp(magic, DAMON_REC_MAGIC, sizeof(magic)))
+		fatal("%s is not a DAMON record file\n", path);
+	version = get_le32(f);
+	if (version > DAMON_REC_VERSION)
+		fatal("unsupported record file version %u\n", version);
+	hdr_sz = get_le32(f);
+	rec->sample_us = get_le64(f);
+	rec->aggr_us = get_le64(f);
+	rec->nr_targets = get_le32(f);
+	get_le32(f);
+	if (rec->nr_targets > DAMON_REC_MAX_TARGETS ||
+			hdr_sz < 40 + rec->nr_targets * 8)
+		fatal("corrupted record header\n");
+	fseek(f, hdr_sz - rec->nr_targets * 8, SEEK_SET);
+	for (i = 0; i < rec->nr_targets; i++)
+		rec->target_ids[i] = get_le64(f);
+
+	rec->nr_snapshots = 0;
+	rec->snapshots = NULL;
+	for (;;) {
+		if (rec->nr_snapshots == nr_allocated) {
+			nr_allocated = nr_allocated * 2 ?: 1024;
+			rec->snapshots = xrealloc(rec->snapshots,
+					nr_allocated * sizeof(*rec->snapshots));
+		}
+		if (!rec_read_snapshot(f, rec,
+					&rec->snapshots[rec->nr_snapshots],
+					last_ns))
+			break;
+		last_ns = rec->snapshots[rec->nr_snapshots++].time_ns;
+	}
+	fclose(f);
+
+	if (!rec->nr_snapshots)
+		fatal("%s has no snapshot\n", path);
+	rec_pack(rec);
+}
+
+/*
+ * Reports
+ */
+
+/* Maximum nr_accesses of a region, for getting the access frequency */
+static unsigned int rec_max_nr_accesses(struct rec *rec)
+{
+	if (!rec->sample_us || rec->aggr_us < rec->sample_us)
+		return 1;
+	return rec->aggr_us / rec->sample_us;
+}
+
+static void report_heatmap(struct rec *rec)
+{
+	static const char heat_chars[] = " .:-=+*#%@";
+	unsigned int max_nr_accesses = rec_max_nr_accesses(rec);
+	uint64_t duration = rec->snapshots[rec->nr_snapshots - 1].time_ns + 1;
+	uint64_t col_sz = (rec->packed_sz + opt_cols - 1) / opt_cols;
+	unsigned int *nr_snapshots = xcalloc(opt_rows, sizeof(*nr_snapshots));
+	double *heats = xcalloc(opt_rows * opt_cols, sizeof(*heats));
+	unsigned long i, j;
+	unsigned int row, col;
+
+	if (!col_sz)
+		col_sz = 1;
+	for (i = 0; i < rec->nr_snapshots; i++) {
+		struct rec_snapshot *s = &rec->snapshots[i];
+
+		row = s->time_ns * opt_rows / duration;
+		nr_snapshots[row]++;
+		for (j = 0; j < s->nr_regions; j++) {
+			struct rec_region *r = &s->regions[j];
+			uint64_t start = rec_packed_off(rec, r);
+			uint64_t end = start + r->end - r->start;
+			double freq = (double)r->nr_accesses / max_nr_accesses;
+
+			for (col = start / col_sz; col < opt_cols &&
+					col * col_sz < end; col++) {
+				uint64_t overlap_start = col * col_sz;
+				uint64_t overlap_end = overlap_start + col_sz;
+
+				if (overlap_start < start)
+					overlap_start = start;
+				if (overlap_end > end)
+					overlap_end = end;
+				heats[row * opt_cols + col] += freq *
+					(overlap_end - overlap_start);
+			}
+		}
+	}
+
+	printf("# heatmap of %lu snapshots over %.3f seconds\n",
+			rec->nr_snapshots, duration / 1e9);
+	printf("# %u rows of %.3f seconds, %u columns of %llu bytes\n",
+			opt_rows, duration / 1e9 / opt_rows, opt_cols,
+			(unsigned long long)col_sz);
+	printf("# %lu areas of %llu bytes, in the address order:\n",
+			rec->nr_areas, (unsigned long long)rec->packed_sz);
+	for (i = 0; i < rec->nr_areas; i++)
+		printf("#   target %u: %llx-%llx\n", rec->areas[i].target,
+				(unsigned long long)rec->areas[i].start,
+				(unsigned long long)rec->areas[i].end);
+
+	for (row = 0; row < opt_rows; row++) {
+		printf("%10.3f |", duration / 1e9 * row / opt_rows);
+		for (col = 0; col < opt_cols; col++) {
+			double heat = 0;
+			int idx;
+
+			if (nr_snapshots[row])
+				heat = heats[row * opt_cols + col] /
+					nr_snapshots[row] / col_sz;
+			idx = heat * (sizeof(heat_chars) - 1);
+			if (heat > 0 && !idx)
+				idx = 1;
+			if (idx > (int)sizeof(heat_chars) - 2)
+				idx = sizeof(heat_chars) - 2;
+			putchar(heat_chars[idx]);
+		}
+		printf("|\n");
+	}
+
+	free(heats);
+	free(nr_snapshots);
+}
+
+static int cmp_u64(const void *p1, const void *p2)
+{
+	uint64_t v1 = *(const uint64_t *)p1, v2 = *(const uint64_t *)p2;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+static void report_wss(struct rec *rec)
+{
+	static const unsigned int percentiles[] = {0, 1, 25, 50, 75, 99, 100};
+	uint64_t *wss = xcalloc(rec->nr_snapshots, sizeof(*wss));
+	double sum = 0;
+	unsigned long i, j;
+
+	for (i = 0; i < rec->nr_snapshots; i++) {
+		struct rec_snapshot *s = &rec->snapshots[i];
+
+		for (j = 0; j < s->nr_regions; j++) {
+			if (s->regions[j].nr_accesses)
+				wss[i] += s->regions[j].end -
+					s->regions[j].start;
+		}
+		sum += wss[i];
+	}
+	qsort(wss, rec->nr_snapshots, sizeof(*wss), cmp_u64);
+
+	printf("# working set size of %lu snapshots\n", rec->nr_snapshots);
+	printf("# <percentile> <wss in bytes>\n");
+	for (i = 0; i < sizeof(percentiles) / sizeof(*percentiles); i++)
+		printf("%3u %llu\n", percentiles[i], (unsigned long long)
+				wss[(rec->nr_snapshots - 1) * percentiles[i] /
+				100]);
+	printf("avg %llu\n",
+			(unsigned long long)(sum / rec->nr_snapshots));
+	free(wss);
+}
+
+static void report(struct rec *rec)
+{
+	switch (opt_report) {
+	case REPORT_HEATMAP:
+		report_heatmap(rec);
+		break;
+	case REPORT_WSS:
+		report_wss(rec);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Record
+ */
+
+static void damon_path(char *buf, const char *file)
+{
+	snprintf(buf, MAX_PATH, "%s/%s", damon_dir, file);
+}
+
+static void damon_write(const char *file, const char *content)
+{
+	char path[MAX_PATH];
+	int fd;
+
+	damon_path(path, file);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		fatal("open %s: %s\n", path, strerror(errno));
+	if (write(fd, content, strlen(content)) != (ssize_t)strlen(content))
+		fatal("write '%s' to %s: %s\n", content, path,
+				strerror(errno));
+	close(fd);
+}
+
+static void damon_read(const char *file, char *buf, size_t sz)
+{
+	char path[MAX_PATH];
+	ssize_t len;
+	int fd;
+
+	damon_path(path, file);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		fatal("open %s: %s\n", path, strerror(errno));
+	len = read(fd, buf, sz - 1);
+	if (len < 0)
+		fatal("read %s: %s\n", path, strerror(errno));
+	buf[len] = '\0';
+	close(fd);
+}
+
+static bool damon_running(void)
+{
+	char buf[8];
+
+	damon_read("monitor_on", buf, sizeof(buf));
+	return !strncmp(buf, "on", 2);
+}
+
+/* Read the snapshots in the ring buffer and advance the tail */
+static void ring_consume(struct damon_ring_hdr *hdr, FILE *f,
+		struct rec *rec, uint64_t *last_ns)
+{
+	char *data = (char *)hdr + hdr->data_off;
+	uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = hdr->tail;
+	struct damon_ring_snapshot *snapshot;
+
+	while (tail < head) {
+		snapshot = (void *)(data + (tail & (hdr->data_sz - 1)));
+		if (!snapshot->size)
+			fatal("corrupted ring buffer\n");
+		if (!(snapshot->flags & DAMON_RING_SNAPSHOT_PAD)) {
+			rec_write_snapshot(f, rec, snapshot, last_ns);
+			rec->nr_snapshots++;
+		}
+		tail += snapshot->size;
+	}
+	__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void record(int argc, char **argv)
+{
+	struct rec rec = {};
+	struct damon_ring_hdr *hdr;
+	struct pollfd pfd;
+	char buf[512], *p;
+	uint64_t last_ns = 0, deadline = 0;
+	unsigned long sz;
+	bool started = false;
+	FILE *f;
+	int i;
+
+	if (argc) {
+		if (damon_running())
+			fatal("DAMON is already running\n");
+		buf[0] = '\0';
+		for (i = 0; i < argc; i++) {
+			strncat(buf, argv[i], sizeof(buf) - strlen(buf) - 2);
+			strcat(buf, i < argc - 1 ? " " : "\n");
+		}
+		damon_write("target_ids", buf);
+		snprintf(buf, sizeof(buf), "%lu", opt_ring_sz);
+		damon_write("ring", buf);
+	}
+
+	damon_read("attrs", buf, sizeof(buf));
+	if (sscanf(buf, "%" SCNu64 " %" SCNu64, &rec.sample_us,
+				&rec.aggr_us) != 2)
+		fatal("cannot parse the attrs: %s\n", buf);
+	damon_read("target_ids", buf, sizeof(buf));
+	for (p = strtok(buf, " \n"); p; p = strtok(NULL, " \n")) {
+		if (rec.nr_targets == DAMON_REC_MAX_TARGETS)
+			fatal("too many targets\n");
+		rec.target_ids[rec.nr_targets++] = strtoull(p, NULL, 0);
+	}
+	if (!rec.nr_targets)
+		fatal("no monitoring target\n");
+	damon_read("ring", buf, sizeof(buf));
+	sz = strtoul(buf, NULL, 0);
+	if (!sz)
+		fatal("the ring buffer is not set\n");
+
+	damon_path(buf, "ring");
+	pfd.fd = open(buf, O_RDWR);
+	if (pfd.fd < 0)
+		fatal("open %s: %s\n", buf, strerror(errno));
+	pfd.events = POLLIN;
+	hdr = mmap(NULL, page_size + sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+			pfd.fd, 0);
+	if (hdr == MAP_FAILED)
+		fatal("mmap %s: %s\n", buf, strerror(errno));
+
+	f = fopen(opt_output, "w");
+	if (!f)
+		fatal("open %s: %s\n", opt_output, strerror(errno));
+	rec_write_hdr(f, &rec);
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+	if (argc) {
+		damon_write("monitor_on", "on");
+		started = true;
+	}
+	if (opt_duration)
+		deadline = now_ns() + opt_duration * 1000000000ULL;
+
+	while (!stop && (!deadline || now_ns() < deadline)) {
+		if (poll(&pfd, 1, 1000) > 0)
+			ring_consume(hdr, f, &rec, &last_ns);
+		else if (!damon_running())
+			break;
+	}
+
+	if (started)
+		damon_write("monitor_on", "off");
+	ring_consume(hdr, f, &rec, &last_ns);
+	fprintf(stderr, "recorded %lu snapshots to %s (%llu overruns)\n",
+			rec.nr_snapshots, opt_output,
+			(unsigned long long)hdr->nr_overruns);
+	munmap(hdr, page_size + sz);
+	close(pfd.fd);
+	if (started)
+		damon_write("ring", "0");
+	if (fclose(f))
+		fatal("write %s: %s\n", opt_output, strerror(errno));
+
+	if (opt_report != REPORT_NONE && rec.nr_snapshots) {
+		struct rec recorded = {};
+
+		rec_load(opt_output, &recorded);
+		report(&recorded);
+	}
+}
+
+/*
+ * Replay
+ */
+
+static void replay_snapshot(struct rec *rec, struct rec_snapshot *s,
+		char *buf, uint64_t buf_sz, unsigned int scale,
+		uint64_t duration_ns, uint64_t *lag_ns)
+{
+	unsigned int max_nr_accesses = rec_max_nr_accesses(rec);
+	uint64_t tick_ns = rec->sample_us * 1000 ?: 1000000;
+	uint64_t nr_ticks = duration_ns / tick_ns ?: 1;
+	uint64_t start_ns = now_ns(), deadline, k;
+	struct timespec ts;
+	unsigned long i;
+
+	for (k = 0; k < nr_ticks && !stop; k++) {
+		for (i = 0; i < s->nr_regions; i++) {
+			struct rec_region *r = &s->regions[i];
+			uint64_t start, end, addr;
+
+			/*
+			 * Spread the recorded number of accesses over the
+			 * sampling intervals of the aggregation interval
+			 */
+			if ((k + 1) * r->nr_accesses / max_nr_accesses ==
+					k * r->nr_accesses / max_nr_accesses)
+				continue;
+			start = rec_packed_off(rec, r) / scale;
+			end = start + (r->end - r->start) / scale;
+			start &= ~(page_size - 1);
+			if (end > buf_sz)
+				end = buf_sz;
+			addr = start;
+			do {
+				(*(volatile char *)(buf + addr))++;
+				addr += page_size;
+			} while (addr < end);
+		}
+
+		deadline = start_ns + (k + 1) * tick_ns;
+		if (now_ns() > deadline) {
+			*lag_ns += now_ns() - deadline;
+			continue;
+		}
+		ts.tv_sec = deadline / 1000000000;
+		ts.tv_nsec = deadline % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+}
+
+static void replay(int argc, char **argv)
+{
+	struct rec rec = {};
+	uint64_t buf_sz, start_ns, prev_ns = 0, duration_ns, lag_ns = 0;
+	unsigned int scale = 1;
+	unsigned long i;
+	char *buf;
+
+	if (argc != 1)
+		fatal("replay needs a record file\n");
+	rec_load(argv[0], &rec);
+
+	while (rec.packed_sz / scale > opt_max_sz)
+		scale *= 2;
+	buf_sz = (rec.packed_sz / scale + page_size - 1) & ~(page_size - 1);
+	buf = mmap(NULL, buf_sz, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		fatal("mmap %llu bytes: %s\n", (unsigned long long)buf_sz,
+				strerror(errno));
+	memset(buf, 0, buf_sz);
+
+	fprintf(stderr, "pid %d replays %lu snapshots of %llu bytes at %p, scaled down by %u\n",
+			getpid(), rec.nr_snapshots,
+			(unsigned long long)rec.packed_sz, buf, scale);
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+	start_ns = now_ns();
+	for (i = 0; i < rec.nr_snapshots && !stop; i++) {
+		struct rec_snapshot *s = &rec.snapshots[i];
+
+		/* Each snapshot is for the aggregation interval before it */
+		duration_ns = i ? s->time_ns - prev_ns : rec.aggr_us * 1000;
+		prev_ns = s->time_ns;
+		replay_snapshot(&rec, s, buf, buf_sz, scale, duration_ns,
+				&lag_ns);
+		/* Report what is replayed, in the replayed time */
+		s->time_ns = now_ns() - start_ns;
+	}
+	rec.nr_snapshots = i;
+
+	fprintf(stderr, "replayed %lu snapshots in %.3f seconds (%.3f seconds of lag)\n",
+			rec.nr_snapshots, (now_ns() - start_ns) / 1e9,
+			lag_ns / 1e9);
+	munmap(buf, buf_sz);
+
+	if (rec.nr_snapshots)
+		report(&rec);
+}
+
+/*
+ * Report
+ */
+
+static void report_cmd(int argc, char **argv)
+{
+	struct rec rec = {};
+
+	if (argc != 1)
+		fatal("report needs a record file\n");
+	if (opt_report == REPORT_NONE)
+		opt_report = REPORT_HEATMAP;
+	rec_load(argv[0], &rec);
+	report(&rec);
+}
+
+static void usage(void)
+{
+	printf(
+"damon-access [options] record [pid...|paddr]\n"
+"damon-access [options] replay <record file>\n"
+"damon-access [options] report <record file>\n"
+"            -o|--output   file          Record file (default damon.rec)\n"
+"            -d|--duration seconds       Stop recording after this time\n"
+"            -b|--ring     bytes         Size of the DAMON ring buffer\n"
+"            -m|--max-mem  MiB           Max memory of the replay\n"
+"            -r|--report   heatmap|wss   Type of the report\n"
+"            -R|--rows     number        Number of the heatmap rows\n"
+"            -C|--cols     number        Number of the heatmap columns\n"
+"            -h|--help                   Show this usage message\n");
+}
+
+static const struct option opts[] = {
+	{ "output"    , 1, NULL, 'o' },
+	{ "duration"  , 1, NULL, 'd' },
+	{ "ring"      , 1, NULL, 'b' },
+	{ "max-mem"   , 1, NULL, 'm' },
+	{ "report"    , 1, NULL, 'r' },
+	{ "rows"      , 1, NULL, 'R' },
+	{ "cols"      , 1, NULL, 'C' },
+	{ "help"      , 0, NULL, 'h' },
+	{ NULL        , 0, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+	const char *debugfs;
+	unsigned int i;
+	int c;
+
+	page_size = getpagesize();
+
+	while ((c = getopt_long(argc, argv, "o:d:b:m:r:R:C:h",
+				opts, NULL)) != -1) {
+		switch (c) {
+		case 'o':
+			opt_output = optarg;
+			break;
+		case 'd':
+			opt_duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			opt_ring_sz = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			opt_max_sz = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			for (i = 0; i < sizeof(report_types) /
+					sizeof(*report_types); i++)
+				if (!strcmp(optarg, report_types[i]))
+					opt_report = i;
+			if (strcmp(optarg, report_types[opt_report]))
+				fatal("unknown report type: %s\n", optarg);
+			break;
+		case 'R':
+			opt_rows = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			opt_cols = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	if (optind >= argc || !opt_rows || !opt_cols || !opt_max_sz) {
+		usage();
+		exit(1);
+	}
+
+	if (!strcmp(argv[optind], "record")) {
+		debugfs = debugfs__mount();
+		if (!debugfs)
+			fatal("mount debugfs: %s\n", strerror(errno));
+		snprintf(damon_dir, sizeof(damon_dir), "%s/damon", debugfs);
+		record(argc - optind - 1, argv + optind + 1);
+	} else if (!strcmp(argv[optind], "replay")) {
+		replay(argc - optind - 1, argv + optind + 1);
+	} else if (!strcmp(argv[optind], "report")) {
+		report_cmd(argc - optind - 1, argv + optind + 1);
+	} else {
+		usage();
+		exit(1);
+	}
+	return 0;
+}